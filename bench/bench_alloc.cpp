@@ -0,0 +1,87 @@
+// bench_alloc.cpp
+// Author: Anurag Choubey
+//
+// Node replacement: each transaction swaps a fresh `size`-byte node into a
+// random slot and drops the old one, with
+//
+//   malloc     malloc inside the transaction (freed again on abort) and free
+//              of the old node after commit. Only safe here because nothing
+//              dereferences the nodes; it is the global-allocator baseline.
+//   tx_malloc  tx_malloc / tx_free, recycled through the epoch limbo.
+//
+// at 1, 2, 4, ... max_threads threads.
+//
+// usage: bench_alloc [max_threads] [txs_per_thread] [size]
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "transaction.h"
+
+#define SLOTS 1024
+
+static double run(int use_tx_malloc, int threads, long txs, size_t size){
+    std::vector<void*> slots(SLOTS, nullptr);
+    std::vector<std::thread> pool;
+
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+
+            for (long i = 0; i < txs; i++){
+                void** slot = &slots[bench_rand(&seed) % SLOTS];
+                while (true){
+                    tx_begin(tx);
+                    void* old = nullptr;
+                    void* fresh = use_tx_malloc ? tx_malloc(tx, size) : malloc(size);
+                    int ok = fresh && tx_read(tx, slot, &old, sizeof(old)) == 0 &&
+                             tx_write(tx, slot, &fresh, sizeof(fresh)) == 0 &&
+                             (!use_tx_malloc || tx_free(tx, old) == 0) &&
+                             tx_commit(tx);
+                    if (ok){
+                        if (!use_tx_malloc) free(old);
+                        break;
+                    }
+                    if (!use_tx_malloc) free(fresh);
+                }
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    double rate = (double)threads * txs * 1e9 / (bench_now_ns() - start);
+
+    if (!use_tx_malloc)
+        for (void* p : slots) free(p);
+    return rate;
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long txs = bench_arg(argc, argv, 2, 200000);
+    size_t size = (size_t)bench_arg(argc, argv, 3, 64);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 1 || txs < 1) return 1;
+
+    printf("impl,threads,size,txs_per_sec\n");
+    for (int t = 1; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+
+        for (int use_tx_malloc = 0; use_tx_malloc <= 1; use_tx_malloc++){
+            if (tx_init(0) != 0) return 1;
+            printf("%s,%d,%zu,%.0f\n", use_tx_malloc ? "tx_malloc" : "malloc", t, size,
+                   run(use_tx_malloc, t, txs, size));
+            fflush(stdout);
+            tx_shutdown();
+        }
+
+        if (t == max_threads) break;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// bench_containers.cpp
+// Author: Anurag Choubey
+//
+// Throughput of the tl2 containers against std containers behind one
+// std::mutex, at 1, 2, 4, ... max_threads threads:
+//
+//   hashmap  tl2::HashMap vs std::unordered_map, 80% get / 10% put / 10% remove
+//   ordered  tl2::SkipList vs std::map, same mix
+//   queue    tl2::Queue vs std::deque, 50% push / 50% pop
+//
+// Maps start half full over KEY_RANGE keys.
+//
+// usage: bench_containers [max_threads] [ops_per_thread]
+
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bench_util.h"
+#include "tl2_hashmap.h"
+#include "tl2_queue.h"
+#include "tl2_skiplist.h"
+
+#define KEY_RANGE (1 << 16)
+
+template<typename F>
+static double run_threads(int threads, long ops, F op){
+    std::vector<std::thread> pool;
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for (long i = 0; i < ops; i++) op(&seed);
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    return (double)threads * ops * 1e9 / (bench_now_ns() - start);
+}
+
+// 0 = get, 1 = put, 2 = remove
+static int map_op(uint64_t r){
+    r %= 10;
+    return r < 8 ? 0 : (r == 8 ? 1 : 2);
+}
+
+template<typename Map>
+static double run_tl2_map(int threads, long ops){
+    Map map;
+    for (uint64_t k = 0; k < KEY_RANGE; k += 2) map.put(k, k);
+
+    return run_threads(threads, ops, [&](uint64_t* seed){
+        uint64_t r = bench_rand(seed);
+        uint64_t key = (r >> 8) % KEY_RANGE, v;
+        switch (map_op(r)){
+        case 0: map.get(key, &v); break;
+        case 1: map.put(key, key); break;
+        default: map.remove(key); break;
+        }
+    });
+}
+
+template<typename Map>
+static double run_locked_map(int threads, long ops){
+    Map map;
+    std::mutex mu;
+    for (uint64_t k = 0; k < KEY_RANGE; k += 2) map[k] = k;
+
+    return run_threads(threads, ops, [&](uint64_t* seed){
+        uint64_t r = bench_rand(seed);
+        uint64_t key = (r >> 8) % KEY_RANGE;
+        std::lock_guard<std::mutex> g(mu);
+        switch (map_op(r)){
+        case 0: { auto it = map.find(key); (void)it; break; }
+        case 1: map[key] = key; break;
+        default: map.erase(key); break;
+        }
+    });
+}
+
+static double run_tl2_queue(int threads, long ops){
+    tl2::Queue<uint64_t> q;
+    for (uint64_t i = 0; i < 1024; i++) q.push(i);
+
+    return run_threads(threads, ops, [&](uint64_t* seed){
+        uint64_t v = bench_rand(seed);
+        if (v & 1) q.push(v);
+        else q.pop(&v);
+    });
+}
+
+static double run_locked_queue(int threads, long ops){
+    std::deque<uint64_t> q;
+    std::mutex mu;
+    for (uint64_t i = 0; i < 1024; i++) q.push_back(i);
+
+    return run_threads(threads, ops, [&](uint64_t* seed){
+        uint64_t v = bench_rand(seed);
+        std::lock_guard<std::mutex> g(mu);
+        if (v & 1) q.push_back(v);
+        else if (!q.empty()) q.pop_front();
+    });
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 64);
+    long ops = bench_arg(argc, argv, 2, 50000);
+    if (max_threads < 1 || ops < 1) return 1;
+
+    // One slice per worker plus the main thread's, which fills the maps.
+    if (tx_init_threads(0, (uint32_t)max_threads + 1) != 0) return 1;
+
+    printf("container,impl,threads,ops_per_sec\n");
+    for (int t = 1; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+
+        printf("hashmap,tl2,%d,%.0f\n", t, run_tl2_map<tl2::HashMap<uint64_t, uint64_t>>(t, ops));
+        printf("hashmap,mutex,%d,%.0f\n", t, run_locked_map<std::unordered_map<uint64_t, uint64_t>>(t, ops));
+        printf("ordered,tl2,%d,%.0f\n", t, run_tl2_map<tl2::SkipList<uint64_t, uint64_t>>(t, ops));
+        printf("ordered,mutex,%d,%.0f\n", t, run_locked_map<std::map<uint64_t, uint64_t>>(t, ops));
+        printf("queue,tl2,%d,%.0f\n", t, run_tl2_queue(t, ops));
+        printf("queue,mutex,%d,%.0f\n", t, run_locked_queue(t, ops));
+        fflush(stdout);
+
+        if (t == max_threads) break;
+    }
+
+    tx_shutdown();
+    return 0;
+}
@@ -0,0 +1,86 @@
+// bench_contention.cpp
+// Author: Anurag Choubey
+//
+// Contention-manager policies under oversubscription: 2x as many threads as
+// hardware threads run transfers over a small set of hot accounts. Reports
+// throughput, abort count and per-transaction latency (including retries).
+//
+// usage: bench_contention [threads] [txs_per_thread] [accounts]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+#include "cm.h"
+#include "transaction.h"
+
+static const char* policy_names[] = {"backoff", "yield", "polka"};
+
+int main(int argc, char** argv){
+    int hw = (int)std::thread::hardware_concurrency();
+    int threads = (int)bench_arg(argc, argv, 1, hw > 0 ? 2 * hw : 4);
+    long txs = bench_arg(argc, argv, 2, 20000);
+    int accounts = (int)bench_arg(argc, argv, 3, 8);
+    if (threads < 1 || txs < 1 || accounts < 1) return 1;
+
+    printf("policy,threads,commits_per_sec,aborts,p50_ns,p99_ns,p999_ns\n");
+    for (int policy = CM_BACKOFF; policy <= CM_POLKA; policy++){
+        cm_set_policy(policy);
+        // Sized for every thread, however many cores there are.
+        if (tx_init_threads(0, (uint32_t)threads) != 0) return 1;
+
+        std::vector<uint64_t> bank(accounts, 1000);
+        std::vector<std::vector<uint64_t>> lat(threads);
+        std::vector<uint64_t> aborts(threads, 0);
+        std::vector<std::thread> workers;
+
+        uint64_t start = bench_now_ns();
+        for (int t = 0; t < threads; t++){
+            workers.emplace_back([&, t](){
+                TransactionContext* tx = tx_thread_init();
+                if (!tx) return;
+                uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+                lat[t].reserve(txs);
+                for (long i = 0; i < txs; i++){
+                    int from = bench_rand(&seed) % accounts;
+                    int to = bench_rand(&seed) % accounts;
+                    uint64_t t0 = bench_now_ns();
+                    while (true){
+                        tx_begin(tx);
+                        uint64_t a, b;
+                        if (tx_read(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                            tx_read(tx, &bank[to], &b, sizeof(b)) == 0){
+                            a--;
+                            b++;
+                            if (tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                                tx_write(tx, &bank[to], &b, sizeof(b)) == 0 &&
+                                tx_commit(tx)) break;
+                        }
+                        aborts[t]++;
+                    }
+                    lat[t].push_back(bench_now_ns() - t0);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        uint64_t elapsed = bench_now_ns() - start;
+
+        std::vector<uint64_t> all;
+        uint64_t total_aborts = 0;
+        for (int t = 0; t < threads; t++){
+            all.insert(all.end(), lat[t].begin(), lat[t].end());
+            total_aborts += aborts[t];
+        }
+
+        printf("%s,%d,%.0f,%llu,%llu,%llu,%llu\n", policy_names[policy], threads,
+               (double)all.size() * 1e9 / elapsed, (unsigned long long)total_aborts,
+               (unsigned long long)bench_percentile(all, 0.5),
+               (unsigned long long)bench_percentile(all, 0.99),
+               (unsigned long long)bench_percentile(all, 0.999));
+
+        tx_shutdown();
+    }
+
+    cm_set_policy(TL2_CM_POLICY);
+    return 0;
+}
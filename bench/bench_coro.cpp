@@ -0,0 +1,212 @@
+// bench_coro.cpp
+// Author: Anurag Choubey
+//
+// Request handlers as coroutines on a small executor: `coroutines` tasks
+// over `threads` workers, each running `txs` requests of one transaction
+// (moving a unit between two of `accounts` hot accounts after reading two
+// more, and spending `tx_ns` computing in between) followed by `work_ns` of
+// non-transactional work, with a hop back to the executor between requests. Two ways to run the transaction:
+//
+//   block    tl2::atomically: a conflict is retried on the spot, backing off
+//            in the contention manager on the worker's own slice
+//   suspend  co_await tl2::atomically(ex, ...): a conflict suspends the
+//            task and the worker runs other requests until the backoff ends;
+//            each attempt borrows a slice
+//
+// Reports requests (tasks) per second, aborts per request and the arena
+// slices used, which stays at most `threads` in both modes.
+//
+// usage: bench_coro [threads] [coroutines] [txs] [accounts] [tx_ns] [work_ns]
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "stats.h"
+#include "tl2_coro.h"
+#include "vlock.h"
+
+#define MODE_BLOCK   0
+#define MODE_SUSPEND 1
+
+struct Task{
+    struct promise_type{
+        Task get_return_object(){ return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ std::terminate(); }
+    };
+};
+
+static thread_local int bench_worker = -1;
+
+// One ready queue and one timer heap per worker. Calls deferred from a
+// worker stay on it; the others are spread round-robin.
+class BenchExecutor{
+public:
+    explicit BenchExecutor(int threads) : workers_(threads), next_(0) {}
+
+    void defer(uint64_t delay_ns, void (*fn)(void*), void* arg){
+        int w = bench_worker >= 0 ? bench_worker
+                                  : (int)(next_.fetch_add(1) % workers_.size());
+        Worker& wk = workers_[w];
+        std::lock_guard<std::mutex> g(wk.m);
+        if (delay_ns == 0){
+            wk.ready.push_back({0, fn, arg});
+        } else {
+            wk.timers.push_back({bench_now_ns() + delay_ns, fn, arg});
+            std::push_heap(wk.timers.begin(), wk.timers.end(), later);
+        }
+    }
+
+    void run(const std::atomic<long>& done, long until){
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < workers_.size(); t++)
+            pool.emplace_back([&, t](){
+                bench_worker = (int)t;
+                while (done.load(std::memory_order_relaxed) < until){
+                    Item it;
+                    if (take(workers_[t], &it)) it.fn(it.arg);
+                    else cpu_relax();
+                }
+                bench_worker = -1;
+            });
+        for (std::thread& th : pool) th.join();
+    }
+
+private:
+    struct Item{ uint64_t due; void (*fn)(void*); void* arg; };
+
+    struct Worker{
+        std::mutex m;
+        std::deque<Item> ready;
+        std::vector<Item> timers;
+    };
+
+    static bool later(const Item& a, const Item& b){ return a.due > b.due; }
+
+    static bool take(Worker& wk, Item* out){
+        std::lock_guard<std::mutex> g(wk.m);
+        if (!wk.timers.empty()){
+            uint64_t now = bench_now_ns();
+            while (!wk.timers.empty() && wk.timers.front().due <= now){
+                std::pop_heap(wk.timers.begin(), wk.timers.end(), later);
+                wk.ready.push_back(wk.timers.back());
+                wk.timers.pop_back();
+            }
+        }
+        if (wk.ready.empty()) return false;
+        *out = wk.ready.front();
+        wk.ready.pop_front();
+        return true;
+    }
+
+    std::vector<Worker> workers_;
+    std::atomic<uint64_t> next_;
+};
+
+struct Hop{
+    BenchExecutor& ex;
+    bool await_ready(){ return false; }
+    void await_suspend(std::coroutine_handle<> h){ ex.defer(0, &Hop::resume, h.address()); }
+    void await_resume(){}
+    static void resume(void* h){ std::coroutine_handle<>::from_address(h).resume(); }
+};
+
+struct Shared{
+    std::vector<tl2::TVar<int64_t>> bank;
+    long txs;
+    uint64_t tx_ns;
+    uint64_t work_ns;
+    int mode;
+    std::atomic<long> done{0};
+};
+
+static void spin_for(uint64_t ns){
+    uint64_t end = bench_now_ns() + ns;
+    while (bench_now_ns() < end) cpu_relax();
+}
+
+static Task client(BenchExecutor& ex, Shared& s, uint64_t seed){
+    co_await Hop{ex};
+    size_t n = s.bank.size();
+    for (long i = 0; i < s.txs; i++){
+        size_t from = bench_rand(&seed) % n, to = bench_rand(&seed) % n;
+        size_t r1 = bench_rand(&seed) % n, r2 = bench_rand(&seed) % n;
+        auto body = [&](tl2::Tx& tx){
+            tx.read(s.bank[r1]);
+            tx.read(s.bank[r2]);
+            spin_for(s.tx_ns);
+            tx.write(s.bank[from], tx.read(s.bank[from]) - 1);
+            tx.write(s.bank[to], tx.read(s.bank[to]) + 1);
+        };
+        if (s.mode == MODE_SUSPEND) co_await tl2::atomically(ex, body);
+        else tl2::atomically(body);
+
+        spin_for(s.work_ns);
+        co_await Hop{ex};
+    }
+    s.done.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void run(int mode, int threads, long coroutines, long txs, long accounts,
+                long tx_ns, long work_ns){
+    if (tx_init(0) != 0) return;
+
+    Shared s;
+    s.bank = std::vector<tl2::TVar<int64_t>>(accounts);
+    for (tl2::TVar<int64_t>& acct : s.bank) acct.unsafe_set(1000);
+    s.txs = txs;
+    s.tx_ns = (uint64_t)tx_ns;
+    s.work_ns = (uint64_t)work_ns;
+    s.mode = mode;
+
+    BenchExecutor ex(threads);
+    for (long c = 0; c < coroutines; c++) client(ex, s, 0x9E3779B97F4A7C15ULL * (c + 1));
+
+    uint64_t start = bench_now_ns();
+    ex.run(s.done, coroutines);
+    uint64_t ns = bench_now_ns() - start;
+
+    int64_t total = 0;
+    for (tl2::TVar<int64_t>& acct : s.bank) total += acct.unsafe_get();
+
+    double tasks = (double)coroutines * txs;
+    double aborts = -1;
+#if TL2_STATS
+    TxStats st;
+    stats_collect(&st);
+    aborts = 0;
+    for (int c = 0; c < STATS_ABORT_CAUSES; c++) aborts += (double)st.aborts[c];
+#endif
+
+    printf("%s,%d,%ld,%ld,%ld,%ld,%.0f,%.3f,%d,%s\n", mode == MODE_SUSPEND ? "suspend" : "block",
+           threads, coroutines, accounts, tx_ns, work_ns, tasks * 1e9 / ns,
+           aborts < 0 ? -1.0 : aborts / tasks, arena_slot_count(),
+           total == accounts * 1000 ? "ok" : "BAD");
+    fflush(stdout);
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int threads = (int)bench_arg(argc, argv, 1, 4);
+    long coroutines = bench_arg(argc, argv, 2, 4096);
+    long txs = bench_arg(argc, argv, 3, 50);
+    long accounts = bench_arg(argc, argv, 4, 64);
+    long tx_ns = bench_arg(argc, argv, 5, 500);
+    long work_ns = bench_arg(argc, argv, 6, 1000);
+    if (threads < 1 || coroutines < 1 || txs < 1 || accounts < 2 || tx_ns < 0 || work_ns < 0)
+        return 1;
+
+    printf("mode,threads,coroutines,accounts,tx_ns,work_ns,tasks_per_sec,aborts_per_task,slices,total\n");
+    run(MODE_BLOCK, threads, coroutines, txs, accounts, tx_ns, work_ns);
+    run(MODE_SUSPEND, threads, coroutines, txs, accounts, tx_ns, work_ns);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// bench_counter.cpp
+// Author: Anurag Choubey
+//
+// Hot counters: every transaction updates two fields all transactions
+// share, an operation count and a high-water mark, and then moves a unit
+// between two random accounts of a large table (rarely conflicting). The
+// counters are updated either
+//
+//   rw       with tx_read + tx_write, so any two overlapping transactions
+//            conflict on them
+//   commute  with tx_add / tx_max, which take no read-set entry
+//
+// at 1, 2, 4, ... max_threads threads. Every `yield_every`-th transaction
+// yields between the counter update and the transfer, so that transactions
+// overlap even with fewer cores than threads.
+//
+// usage: bench_counter [max_threads] [txs_per_thread] [accounts] [yield_every]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "transaction.h"
+
+#define MODE_RW      0
+#define MODE_COMMUTE 1
+
+struct alignas(64) Counters{
+    uint64_t ops;
+    uint64_t high;
+};
+
+static int counters_rw(TransactionContext* tx, Counters* c, uint64_t mark){
+    uint64_t ops, high;
+    if (tx_read(tx, &c->ops, &ops, sizeof(ops)) != 0) return -1;
+    if (tx_read(tx, &c->high, &high, sizeof(high)) != 0) return -1;
+    ops++;
+    if (mark > high) high = mark;
+    if (tx_write(tx, &c->ops, &ops, sizeof(ops)) != 0) return -1;
+    return tx_write(tx, &c->high, &high, sizeof(high));
+}
+
+static int counters_commute(TransactionContext* tx, Counters* c, uint64_t mark){
+    if (tx_add(tx, &c->ops, 1) != 0) return -1;
+    return tx_max(tx, &c->high, mark);
+}
+
+// Returns the number of aborted attempts.
+static uint64_t transfer(TransactionContext* tx, int mode, uint64_t* bank, Counters* c,
+                         long from, long to, uint64_t mark, int yield){
+    uint64_t aborts = 0;
+    while (true){
+        tx_begin(tx);
+        int ok = (mode == MODE_COMMUTE ? counters_commute(tx, c, mark)
+                                       : counters_rw(tx, c, mark)) == 0;
+        if (ok && yield) std::this_thread::yield();
+
+        uint64_t a, b;
+        ok = ok && tx_read(tx, &bank[from], &a, sizeof(a)) == 0 &&
+             tx_read(tx, &bank[to], &b, sizeof(b)) == 0;
+        if (ok){
+            a--;
+            b++;
+            ok = tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                 tx_write(tx, &bank[to], &b, sizeof(b)) == 0;
+        }
+        if (ok && tx_commit(tx)) return aborts;
+        aborts++;
+    }
+}
+
+static void run(int mode, int threads, long txs, long accounts, long yield_every){
+    if (tx_init(0) != 0) return;
+
+    std::vector<uint64_t> bank(accounts, 1000);
+    Counters counters = {0, 0};
+    std::vector<uint64_t> aborts(threads, 0);
+    std::vector<std::thread> pool;
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for (long i = 0; i < txs; i++){
+                long from = (long)(bench_rand(&seed) % accounts);
+                long to = (long)(bench_rand(&seed) % accounts);
+                int yield = yield_every > 0 && i % yield_every == 0;
+                aborts[t] += transfer(tx, mode, bank.data(), &counters, from, to,
+                                      (uint64_t)t * txs + i, yield);
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    uint64_t ns = bench_now_ns() - start;
+
+    uint64_t total_aborts = 0;
+    for (uint64_t a : aborts) total_aborts += a;
+    double commits = (double)threads * txs;
+    printf("%s,%d,%.0f,%.4f\n", mode == MODE_COMMUTE ? "commute" : "rw", threads,
+           commits * 1e9 / ns, total_aborts / commits);
+    if (counters.ops != (uint64_t)threads * txs) fprintf(stderr, "counter broken\n");
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long txs = bench_arg(argc, argv, 2, 200000);
+    long accounts = bench_arg(argc, argv, 3, 1 << 16);
+    long yield_every = bench_arg(argc, argv, 4, 8);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 1 || txs < 1 || accounts < 2 || yield_every < 0) return 1;
+
+    printf("mode,threads,commits_per_sec,aborts_per_commit\n");
+    for (int t = 1; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+        run(MODE_RW, t, txs, accounts, yield_every);
+        run(MODE_COMMUTE, t, txs, accounts, yield_every);
+        fflush(stdout);
+        if (t == max_threads) break;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+// bench_extension.cpp
+// Author: Anurag Choubey
+//
+// Long readers against short writers: half the threads run long update
+// transactions that sum every account in order and store the sum in a
+// private slot, the other half keep transferring among the last
+// HOT_ACCOUNTS accounts, which the readers reach last. Without snapshot
+// extension a long transaction aborts whenever it reaches an account
+// committed since it began; with it, only when an account it already read
+// has changed. Long transactions yield every YIELD_EVERY reads so that
+// writers interleave with them even on few cores. Reports long and short
+// transactions per second, aborts per long transaction and how many reads
+// extended the snapshot.
+//
+// usage: bench_extension [max_threads] [long_txs_per_reader] [accounts]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "stats.h"
+#include "transaction.h"
+
+#define HOT_ACCOUNTS 64
+#define YIELD_EVERY  64
+
+static void run(int extend, int threads, long long_txs, long accounts){
+    tx_set_snapshot_extension(extend);
+    if (tx_init(0) != 0) return;
+
+    int readers = threads / 2, writers = threads - readers;
+    std::vector<uint64_t> bank(accounts, 1000);
+    std::vector<uint64_t> sums(readers, 0);
+    std::vector<long> long_runs(readers, 0), short_txs(writers, 0);
+    std::atomic<int> readers_left{readers};
+    std::vector<std::thread> pool;
+
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < readers; r++){
+        pool.emplace_back([&, r](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            for (long i = 0; i < long_txs; i++){
+                while (true){
+                    long_runs[r]++;
+                    tx_begin(tx);
+                    uint64_t sum = 0, v;
+                    long k = 0;
+                    for (; k < accounts; k++){
+                        if (tx_read(tx, &bank[k], &v, sizeof(v)) != 0) break;
+                        sum += v;
+                        if (k % YIELD_EVERY == YIELD_EVERY - 1) std::this_thread::yield();
+                    }
+                    if (k == accounts && tx_write(tx, &sums[r], &sum, sizeof(sum)) == 0 &&
+                        tx_commit(tx)) break;
+                }
+            }
+            readers_left.fetch_sub(1);
+            tx_thread_exit();
+        });
+    }
+    for (int w = 0; w < writers; w++){
+        pool.emplace_back([&, w](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (w + 1);
+            while (readers_left.load(std::memory_order_relaxed)){
+                long from = accounts - 1 - (long)(bench_rand(&seed) % HOT_ACCOUNTS);
+                long to = accounts - 1 - (long)(bench_rand(&seed) % HOT_ACCOUNTS);
+                if (from == to) continue;
+                while (true){
+                    tx_begin(tx);
+                    uint64_t a, b;
+                    if (tx_read(tx, &bank[from], &a, sizeof(a)) != 0 ||
+                        tx_read(tx, &bank[to], &b, sizeof(b)) != 0) continue;
+                    a--;
+                    b++;
+                    if (tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                        tx_write(tx, &bank[to], &b, sizeof(b)) == 0 &&
+                        tx_commit(tx)) break;
+                }
+                short_txs[w]++;
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    double secs = (double)(bench_now_ns() - start) / 1e9;
+
+    long runs = 0, shorts = 0;
+    for (long n : long_runs) runs += n;
+    for (long n : short_txs) shorts += n;
+    long longs = readers * long_txs;
+
+    TxStats st;
+    stats_collect(&st);
+    printf("%s,%d,%.0f,%.3f,%.0f,%llu\n", extend ? "extend" : "tl2", threads,
+           longs / secs, (double)(runs - longs) / longs, shorts / secs,
+           (unsigned long long)st.extensions);
+
+    uint64_t total = 0;
+    for (uint64_t v : bank) total += v;
+    if (total != (uint64_t)accounts * 1000) fprintf(stderr, "total broken\n");
+    for (uint64_t s : sums)
+        if (s != (uint64_t)accounts * 1000) fprintf(stderr, "inconsistent snapshot\n");
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long long_txs = bench_arg(argc, argv, 2, 50);
+    long accounts = bench_arg(argc, argv, 3, 1024);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 2 || long_txs < 1 || accounts < HOT_ACCOUNTS) return 1;
+
+    printf("mode,threads,long_txs_per_sec,aborts_per_long_tx,short_txs_per_sec,extensions\n");
+    for (int t = 2; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+        run(0, t, long_txs, accounts);
+        run(1, t, long_txs, accounts);
+        fflush(stdout);
+        if (t == max_threads) break;
+    }
+    tx_set_snapshot_extension(1);
+    return 0;
+}
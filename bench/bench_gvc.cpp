@@ -0,0 +1,77 @@
+// bench_gvc.cpp
+// Author: Anurag Choubey
+//
+// Commit throughput of each GVC scheme at 1..max_threads threads. Every
+// thread commits small transactions on its own cache line, so the only
+// shared write is the clock itself.
+//
+// usage: bench_gvc [max_threads] [commits_per_thread]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "gvc.h"
+#include "transaction.h"
+
+static const char* mode_names[] = {"gv1", "gv4", "gv5", "gv6"};
+
+struct alignas(64) Slot{
+    uint64_t value;
+};
+
+static double run(int mode, int threads, long commits, uint64_t* aborts){
+    gvc_set_mode(mode);
+    if (tx_init(0) != 0) return 0;
+
+    std::vector<Slot> slots(threads);
+    std::vector<uint64_t> thread_aborts(threads, 0);
+    std::vector<std::thread> workers;
+
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        workers.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            for (long i = 0; i < commits; i++){
+                while (true){
+                    tx_begin(tx);
+                    uint64_t v;
+                    if (tx_read(tx, &slots[t].value, &v, sizeof(v)) == 0){
+                        v++;
+                        if (tx_write(tx, &slots[t].value, &v, sizeof(v)) == 0 &&
+                            tx_commit(tx)) break;
+                    }
+                    thread_aborts[t]++;
+                }
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    uint64_t elapsed = bench_now_ns() - start;
+
+    *aborts = 0;
+    for (uint64_t a : thread_aborts) *aborts += a;
+
+    tx_shutdown();
+    return (double)threads * commits * 1e9 / elapsed;
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 64);
+    long commits = bench_arg(argc, argv, 2, 200000);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+
+    printf("mode,threads,commits_per_sec,aborts\n");
+    for (int mode = GVC_MODE_GV1; mode <= GVC_MODE_GV6; mode++){
+        for (int threads = 1; threads <= max_threads; threads *= 2){
+            uint64_t aborts = 0;
+            double rate = run(mode, threads, commits, &aborts);
+            printf("%s,%d,%.0f,%llu\n", mode_names[mode], threads, rate,
+                   (unsigned long long)aborts);
+        }
+    }
+
+    return 0;
+}
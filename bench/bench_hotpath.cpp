@@ -0,0 +1,123 @@
+// bench_hotpath.cpp
+// Author: Anurag Choubey
+//
+// Per-access cost of the transactional fast path, single-threaded so that
+// only instruction count and latency differ between builds:
+//
+//   ro_read  read-only transactions of `accesses` tx_read calls
+//   rmw      update transactions reading and then writing `accesses` words
+//   tvar     the same read-modify-write through tl2::TVar / tl2::atomically
+//
+// The same source is built against each library variant (bench_hotpath:
+// out-of-line tl2_core, bench_hotpath_inline: tl2_core_inline,
+// bench_hotpath_lto: the inline variant with LTO, and the PGO build made by
+// the hotpath_pgo target); the hotpath_report target runs them all into one
+// CSV. Instructions come from the hardware counter and read -1 where perf
+// events are unavailable.
+//
+// usage: bench_hotpath [print_header] [txs] [accesses_per_tx]
+
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "tl2.h"
+
+#define TABLE_VARS 4096
+
+#ifndef BENCH_VARIANT
+#if TL2_INLINE
+#define BENCH_VARIANT inline
+#else
+#define BENCH_VARIANT outofline
+#endif
+#endif
+
+#define BENCH_STR2(x) #x
+#define BENCH_STR(x)  BENCH_STR2(x)
+
+static uint64_t table[TABLE_VARS];
+static std::vector<tl2::TVar<uint64_t>> tvars(TABLE_VARS);
+
+static void ro_read(TransactionContext* tx, uint64_t* seed, long accesses){
+    while (true){
+        uint64_t s = *seed, sum = 0, v;
+        tx_begin_readonly(tx);
+        long i = 0;
+        for (; i < accesses; i++){
+            if (tx_read(tx, &table[bench_rand(&s) & (TABLE_VARS - 1)], &v, sizeof(v)) != 0) break;
+            sum += v;
+        }
+        if (i == accesses && tx_commit(tx)){
+            *seed = s + (sum & 1);
+            return;
+        }
+    }
+}
+
+static void rmw(TransactionContext* tx, uint64_t* seed, long accesses){
+    while (true){
+        uint64_t s = *seed, v;
+        tx_begin(tx);
+        long i = 0;
+        for (; i < accesses; i++){
+            uint64_t* addr = &table[bench_rand(&s) & (TABLE_VARS - 1)];
+            if (tx_read(tx, addr, &v, sizeof(v)) != 0) break;
+            v++;
+            if (tx_write(tx, addr, &v, sizeof(v)) != 0) break;
+        }
+        if (i == accesses && tx_commit(tx)){
+            *seed = s;
+            return;
+        }
+    }
+}
+
+static void tvar(TransactionContext*, uint64_t* seed, long accesses){
+    tl2::atomically([&](tl2::Tx& t){
+        uint64_t s = *seed;
+        for (long i = 0; i < accesses; i++){
+            tl2::TVar<uint64_t>& x = tvars[bench_rand(&s) & (TABLE_VARS - 1)];
+            t.write(x, t.read(x) + 1);
+        }
+        *seed = s;
+    });
+}
+
+static void run(const char* name, void (*body)(TransactionContext*, uint64_t*, long),
+                TransactionContext* tx, long txs, long accesses, int per_access){
+    uint64_t seed = 88172645463325252ULL;
+    for (long i = 0; i < txs / 10; i++) body(tx, &seed, accesses); // warm-up
+
+    int fd = bench_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    bench_counter_start(fd);
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < txs; i++) body(tx, &seed, accesses);
+    uint64_t ns = bench_now_ns() - start;
+    long long instructions = bench_counter_stop(fd);
+    bench_counter_close(fd);
+
+    double n = (double)txs * accesses * per_access;
+    printf("%s,%s,%ld,%.2f,%.1f,%.0f\n", BENCH_STR(BENCH_VARIANT), name, accesses,
+           ns / n, instructions < 0 ? -1.0 : instructions / n, n * 1e9 / ns);
+}
+
+int main(int argc, char** argv){
+    int header = (int)bench_arg(argc, argv, 1, 1);
+    long txs = bench_arg(argc, argv, 2, 200000);
+    long accesses = bench_arg(argc, argv, 3, 16);
+    if (txs < 10 || accesses < 1) return 1;
+
+    if (tx_init(0) != 0) return 1;
+    TransactionContext* tx = tx_thread_init();
+    if (!tx) return 1;
+
+    if (header) printf("variant,workload,accesses_per_tx,ns_per_access,instructions_per_access,accesses_per_sec\n");
+    run("ro_read", ro_read, tx, txs, accesses, 1);
+    run("rmw", rmw, tx, txs, accesses, 2);
+    run("tvar", tvar, tx, txs, accesses, 2);
+    fflush(stdout);
+
+    tx_thread_exit();
+    tx_shutdown();
+    return 0;
+}
@@ -0,0 +1,119 @@
+// bench_irrevocable.cpp
+// Author: Anurag Choubey
+//
+// Starvation workload: short writers keep transferring between HOT_ACCOUNTS
+// hot accounts while one thread runs long transactions that read and rewrite
+// all of them. Without the irrevocable fallback the long transactions can
+// abort over and over; with it they finish after `after` aborts. Reports
+// latency percentiles (including retries) for both kinds of transaction.
+//
+// usage: bench_irrevocable [threads] [long_txs] [after]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "transaction.h"
+
+#define HOT_ACCOUNTS 256
+
+static void report(const char* mode, const char* kind, std::vector<uint64_t>& lat){
+    uint64_t p50 = bench_percentile(lat, 0.5); // sorts lat
+    printf("%s,%s,%zu,%llu,%llu,%llu,%llu\n", mode, kind, lat.size(),
+           (unsigned long long)p50,
+           (unsigned long long)bench_percentile(lat, 0.99),
+           (unsigned long long)bench_percentile(lat, 0.999),
+           (unsigned long long)(lat.empty() ? 0 : lat.back()));
+}
+
+static void run(const char* mode, uint32_t after, int threads, long long_txs){
+    tx_set_irrevocable_after(after);
+    if (tx_init(0) != 0) return;
+
+    std::vector<uint64_t> bank(HOT_ACCOUNTS, 1000);
+    std::vector<std::vector<uint64_t>> short_lat(threads - 1);
+    std::vector<uint64_t> long_lat;
+    std::atomic<int> done{0};
+    std::vector<std::thread> pool;
+
+    for (int t = 0; t < threads - 1; t++){
+        pool.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            while (!done.load(std::memory_order_relaxed)){
+                int from = bench_rand(&seed) % HOT_ACCOUNTS;
+                int to = bench_rand(&seed) % HOT_ACCOUNTS;
+                if (from == to) continue;
+                uint64_t t0 = bench_now_ns();
+                while (true){
+                    tx_begin(tx);
+                    uint64_t a, b;
+                    if (tx_read(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                        tx_read(tx, &bank[to], &b, sizeof(b)) == 0){
+                        a--;
+                        b++;
+                        if (tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                            tx_write(tx, &bank[to], &b, sizeof(b)) == 0 &&
+                            tx_commit(tx)) break;
+                    }
+                }
+                short_lat[t].push_back(bench_now_ns() - t0);
+            }
+        });
+    }
+
+    pool.emplace_back([&](){
+        TransactionContext* tx = tx_thread_init();
+        if (!tx) return;
+        for (long i = 0; i < long_txs; i++){
+            uint64_t t0 = bench_now_ns();
+            while (true){
+                // Rotate every balance one account to the right.
+                tx_begin(tx);
+                uint64_t carry, v;
+                int k = 0;
+                if (tx_read(tx, &bank[HOT_ACCOUNTS - 1], &carry, sizeof(carry)) != 0) continue;
+                for (; k < HOT_ACCOUNTS; k++){
+                    if (tx_read(tx, &bank[k], &v, sizeof(v)) != 0 ||
+                        tx_write(tx, &bank[k], &carry, sizeof(carry)) != 0) break;
+                    carry = v;
+                }
+                if (k == HOT_ACCOUNTS && tx_commit(tx)) break;
+            }
+            long_lat.push_back(bench_now_ns() - t0);
+        }
+        done = 1;
+    });
+
+    for (auto& th : pool) th.join();
+
+    std::vector<uint64_t> all_short;
+    for (auto& l : short_lat) all_short.insert(all_short.end(), l.begin(), l.end());
+    report(mode, "long", long_lat);
+    report(mode, "short", all_short);
+
+    uint64_t total = 0;
+    for (uint64_t b : bank) total += b;
+    if (total != (uint64_t)HOT_ACCOUNTS * 1000) fprintf(stderr, "%s: total broken\n", mode);
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int hw = (int)std::thread::hardware_concurrency();
+    int threads = (int)bench_arg(argc, argv, 1, hw > 1 ? hw : 4);
+    long long_txs = bench_arg(argc, argv, 2, 2000);
+    uint32_t after = (uint32_t)bench_arg(argc, argv, 3, TL2_IRREVOCABLE_AFTER);
+    if (threads < 2) threads = 2;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    printf("mode,kind,txs,p50_ns,p99_ns,p999_ns,max_ns\n");
+    run("speculative", 0, threads, long_txs);
+    run("irrevocable", after, threads, long_txs);
+
+    tx_set_irrevocable_after(TL2_IRREVOCABLE_AFTER);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// bench_kcas.cpp
+// Author: Anurag Choubey
+//
+// Small static updates: each operation picks `words` distinct random
+// accounts, takes one unit from the first and adds it to the last (the ones
+// in between are rewritten unchanged), with
+//
+//   tx    tx_begin / tx_read / tx_write / tx_commit, retried on abort
+//   kcas  tl2_kcas on values loaded just before, retried on mismatch
+//
+// for 2- and 4-word updates at 1, 2, 4, ... max_threads threads.
+//
+// usage: bench_kcas [max_threads] [ops_per_thread] [accounts]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "transaction.h"
+
+#define MAX_WORDS 4
+
+static void pick(uint64_t* seed, long accounts, int words, int* idx){
+    for (int k = 0; k < words; k++){
+        int dup;
+        do {
+            idx[k] = (int)(bench_rand(seed) % accounts);
+            dup = 0;
+            for (int j = 0; j < k; j++) dup |= idx[j] == idx[k];
+        } while (dup);
+    }
+}
+
+static void update_tx(TransactionContext* tx, uint64_t* bank, const int* idx, int words){
+    while (true){
+        tx_begin(tx);
+        uint64_t v[MAX_WORDS];
+        int k = 0;
+        for (; k < words; k++)
+            if (tx_read(tx, &bank[idx[k]], &v[k], sizeof(v[k])) != 0) break;
+        if (k < words) continue;
+
+        v[0]--;
+        v[words - 1]++;
+        for (k = 0; k < words; k++)
+            if (tx_write(tx, &bank[idx[k]], &v[k], sizeof(v[k])) != 0) break;
+        if (k == words && tx_commit(tx)) return;
+    }
+}
+
+static void update_kcas(uint64_t* bank, const int* idx, int words){
+    uint64_t* addrs[MAX_WORDS];
+    uint64_t expected[MAX_WORDS], desired[MAX_WORDS];
+    for (int k = 0; k < words; k++) addrs[k] = &bank[idx[k]];
+
+    do {
+        for (int k = 0; k < words; k++)
+            desired[k] = expected[k] = __atomic_load_n(addrs[k], __ATOMIC_RELAXED);
+        desired[0]--;
+        desired[words - 1]++;
+    } while (tl2_kcas(words, addrs, expected, desired) != 1);
+}
+
+static void run(int use_kcas, int words, int threads, long ops, long accounts){
+    if (tx_init(0) != 0) return;
+
+    std::vector<uint64_t> bank(accounts, 1000);
+    std::vector<std::thread> pool;
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            int idx[MAX_WORDS];
+            for (long i = 0; i < ops; i++){
+                pick(&seed, accounts, words, idx);
+                if (use_kcas) update_kcas(bank.data(), idx, words);
+                else update_tx(tx, bank.data(), idx, words);
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    double rate = (double)threads * ops * 1e9 / (bench_now_ns() - start);
+
+    uint64_t total = 0;
+    for (uint64_t v : bank) total += v;
+    printf("%s,%d,%d,%.0f\n", use_kcas ? "kcas" : "tx", words, threads, rate);
+    if (total != (uint64_t)accounts * 1000) fprintf(stderr, "total broken\n");
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long ops = bench_arg(argc, argv, 2, 500000);
+    long accounts = bench_arg(argc, argv, 3, 1024);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 1 || ops < 1 || accounts < MAX_WORDS) return 1;
+
+    printf("impl,words,threads,ops_per_sec\n");
+    for (int t = 1; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+        for (int words = 2; words <= MAX_WORDS; words += 2){
+            run(0, words, t, ops, accounts);
+            run(1, words, t, ops, accounts);
+            fflush(stdout);
+        }
+        if (t == max_threads) break;
+    }
+    return 0;
+}
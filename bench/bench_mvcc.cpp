@@ -0,0 +1,131 @@
+// bench_mvcc.cpp
+// Author: Anurag Choubey
+//
+// Analytics scans against writers: half the threads run read-only
+// transactions that sum every account, the other half keep transferring
+// between random accounts. Scans yield every YIELD_EVERY reads and writers
+// after every transfer, so the two interleave finely even on few cores.
+// Runs once without the version history and once per history depth, and
+// reports scans and transfers per second, aborts per scan, reads served
+// from the history and the history's memory.
+//
+// usage: bench_mvcc [max_threads] [scans_per_reader] [accounts] [buckets]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "mvcc.h"
+#include "stats.h"
+#include "transaction.h"
+
+#define YIELD_EVERY 64
+
+static const unsigned depths[] = {0, 2, 8, 32};
+
+static void run(unsigned depth, int threads, long scans, long accounts, size_t buckets){
+    if (tx_init(0) != 0) return;
+    if (depth){
+        MvConfig cfg = {buckets, depth};
+        if (mv_enable(&cfg) != 0){
+            tx_shutdown();
+            return;
+        }
+    }
+
+    int readers = threads / 2, writers = threads - readers;
+    std::vector<uint64_t> bank(accounts, 1000);
+    std::vector<long> scan_runs(readers, 0), transfers(writers, 0);
+    std::atomic<int> readers_left{readers};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> pool;
+
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < readers; r++){
+        pool.emplace_back([&, r](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            for (long i = 0; i < scans; i++){
+                while (true){
+                    scan_runs[r]++;
+                    tx_begin_readonly(tx);
+                    uint64_t sum = 0, v;
+                    long k = 0;
+                    for (; k < accounts; k++){
+                        if (tx_read(tx, &bank[k], &v, sizeof(v)) != 0) break;
+                        sum += v;
+                        if (k % YIELD_EVERY == YIELD_EVERY - 1) std::this_thread::yield();
+                    }
+                    if (k == accounts && tx_commit(tx)){
+                        if (sum != (uint64_t)accounts * 1000) bad = 1;
+                        break;
+                    }
+                }
+            }
+            readers_left.fetch_sub(1);
+            tx_thread_exit();
+        });
+    }
+    for (int w = 0; w < writers; w++){
+        pool.emplace_back([&, w](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (w + 1);
+            while (readers_left.load(std::memory_order_relaxed)){
+                long from = (long)(bench_rand(&seed) % accounts);
+                long to = (long)(bench_rand(&seed) % accounts);
+                if (from == to) continue;
+                while (true){
+                    tx_begin(tx);
+                    uint64_t a, b;
+                    if (tx_read(tx, &bank[from], &a, sizeof(a)) != 0 ||
+                        tx_read(tx, &bank[to], &b, sizeof(b)) != 0) continue;
+                    a--;
+                    b++;
+                    if (tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                        tx_write(tx, &bank[to], &b, sizeof(b)) == 0 &&
+                        tx_commit(tx)) break;
+                }
+                transfers[w]++;
+                std::this_thread::yield();
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    double secs = (double)(bench_now_ns() - start) / 1e9;
+
+    long runs = 0, moved = 0;
+    for (long n : scan_runs) runs += n;
+    for (long n : transfers) moved += n;
+    long done = readers * scans;
+
+    TxStats st;
+    stats_collect(&st);
+    printf("%u,%d,%.1f,%.3f,%.0f,%llu,%zu\n", depth, threads, done / secs,
+           (double)(runs - done) / done, moved / secs,
+           (unsigned long long)st.mv_reads, mv_bytes());
+    if (bad) fprintf(stderr, "inconsistent scan\n");
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long scans = bench_arg(argc, argv, 2, 20);
+    long accounts = bench_arg(argc, argv, 3, 16384);
+    size_t buckets = (size_t)bench_arg(argc, argv, 4, 1 << 16);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 2 || scans < 1 || accounts < 2) return 1;
+
+    printf("depth,threads,scans_per_sec,aborts_per_scan,transfers_per_sec,mv_reads,history_bytes\n");
+    for (int t = 2; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+        for (unsigned depth : depths) run(depth, t, scans, accounts, buckets);
+        fflush(stdout);
+        if (t == max_threads) break;
+    }
+    return 0;
+}
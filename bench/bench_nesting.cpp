@@ -0,0 +1,91 @@
+// bench_nesting.cpp
+// Author: Anurag Choubey
+//
+// Long composite transactions: each reads PREFIX_READS private variables,
+// then bumps one of HOT_VARS shared counters in a nested step. With the
+// step flattened (tl2::atomically) a conflict on the counter reruns the
+// whole transaction; as a closed nested transaction (tl2::atomically_closed)
+// only the step is rerun. Reports transactions per second and how many
+// body runs each kind took.
+//
+// usage: bench_nesting [max_threads] [txs_per_thread]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "stats.h"
+#include "tl2.h"
+
+#define PREFIX_READS 512
+#define HOT_VARS     4
+
+static void run(int closed, int threads, long txs){
+    if (tx_init(0) != 0) return;
+
+    std::vector<tl2::TVar<uint64_t>> hot(HOT_VARS);
+    std::vector<std::vector<tl2::TVar<uint64_t>>> cold(threads);
+    for (auto& c : cold) c = std::vector<tl2::TVar<uint64_t>>(PREFIX_READS);
+
+    std::vector<long> outer_runs(threads, 0), inner_runs(threads, 0);
+    std::vector<std::thread> pool;
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for (long i = 0; i < txs; i++){
+                tl2::TVar<uint64_t>& h = hot[bench_rand(&seed) % HOT_VARS];
+                auto step = [&](tl2::Tx& tx){
+                    inner_runs[t]++;
+                    tx.write(h, tx.read(h) + 1);
+                };
+                tl2::atomically([&](tl2::Tx& tx){
+                    outer_runs[t]++;
+                    uint64_t sum = 0;
+                    for (auto& v : cold[t]) sum += tx.read(v);
+                    if (closed) tl2::atomically_closed(step);
+                    else tl2::atomically(step);
+                    return sum;
+                });
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    double rate = (double)threads * txs * 1e9 / (bench_now_ns() - start);
+
+    long outer = 0, inner = 0;
+    for (int t = 0; t < threads; t++){
+        outer += outer_runs[t];
+        inner += inner_runs[t];
+    }
+    uint64_t total = 0;
+    for (auto& v : hot) total += v.unsafe_get();
+
+    TxStats st;
+    stats_collect(&st);
+    printf("%s,%d,%.0f,%.3f,%.3f,%llu\n", closed ? "closed" : "flat", threads, rate,
+           (double)outer / ((double)threads * txs), (double)inner / ((double)threads * txs),
+           (unsigned long long)st.nested_retries);
+    if (total != (uint64_t)threads * txs) fprintf(stderr, "lost updates\n");
+
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int max_threads = (int)bench_arg(argc, argv, 1, 8);
+    long txs = bench_arg(argc, argv, 2, 20000);
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+    if (max_threads < 1 || txs < 1) return 1;
+
+    printf("mode,threads,txs_per_sec,outer_runs_per_tx,inner_runs_per_tx,nested_retries\n");
+    for (int t = 1; ; t *= 2){
+        if (t > max_threads) t = max_threads;
+        run(0, t, txs);
+        run(1, t, txs);
+        fflush(stdout);
+        if (t == max_threads) break;
+    }
+    return 0;
+}
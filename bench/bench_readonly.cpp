@@ -0,0 +1,71 @@
+// bench_readonly.cpp
+// Author: Anurag Choubey
+//
+// Per-read cost of a lookup transaction in the default TL2 mode (read set
+// logged and validated) versus tx_begin_readonly.
+//
+// usage: bench_readonly [reads_per_tx] [iterations]
+
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "transaction.h"
+
+#define TABLE_WORDS (1 << 16)
+
+static uint64_t run(TransactionContext* tx, std::vector<uint64_t>& table,
+                    int readonly, long reads, long iters, uint64_t* sink){
+    uint64_t seed = 88172645463325252ULL;
+    uint64_t start = bench_now_ns();
+
+    for (long it = 0; it < iters; it++){
+        while (true){
+            if (readonly) tx_begin_readonly(tx);
+            else tx_begin(tx);
+
+            uint64_t sum = 0, v = 0;
+            long r = 0;
+            for (; r < reads; r++){
+                uint64_t* addr = &table[bench_rand(&seed) & (TABLE_WORDS - 1)];
+                if (tx_read(tx, addr, &v, sizeof(v)) != 0) break;
+                sum += v;
+            }
+            if (r == reads && tx_commit(tx)){
+                *sink += sum;
+                break;
+            }
+        }
+    }
+
+    return bench_now_ns() - start;
+}
+
+int main(int argc, char** argv){
+    long reads = bench_arg(argc, argv, 1, 64);
+    long iters = bench_arg(argc, argv, 2, 100000);
+
+    if (reads < 1 || reads > RS_MAX){
+        fprintf(stderr, "reads_per_tx must be in [1, %d]\n", RS_MAX);
+        return 1;
+    }
+    if (tx_init(0) != 0) return 1;
+    TransactionContext* tx = tx_thread_init();
+    if (!tx) return 1;
+
+    std::vector<uint64_t> table(TABLE_WORDS, 1);
+    uint64_t sink = 0;
+
+    // Warm the table and the lock stripes once.
+    run(tx, table, 0, reads, iters / 10 + 1, &sink);
+
+    uint64_t logged = run(tx, table, 0, reads, iters, &sink);
+    uint64_t ro = run(tx, table, 1, reads, iters, &sink);
+
+    double n = (double)reads * iters;
+    printf("mode,reads_per_tx,ns_per_read\n");
+    printf("logged,%ld,%.2f\n", reads, logged / n);
+    printf("readonly,%ld,%.2f\n", reads, ro / n);
+
+    tx_shutdown();
+    return sink == 0;
+}
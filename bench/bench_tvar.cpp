@@ -0,0 +1,106 @@
+// bench_tvar.cpp
+// Author: Anurag Choubey
+//
+// Cost per access of the same read-modify-write transaction written against
+// the raw tx_read / tx_write calls and against tl2::TVar / tl2::atomically,
+// for 4-, 8- and 16-byte values.
+//
+// usage: bench_tvar [vars_per_tx] [iterations]
+
+#include <cstdio>
+#include <vector>
+#include "bench_util.h"
+#include "tl2.h"
+
+#define TABLE_VARS 4096
+
+struct Wide{
+    uint64_t lo, hi;
+};
+
+template<typename T>
+static T bump(T v){ return v + 1; }
+
+static Wide bump(Wide v){ return Wide{v.lo + 1, v.hi}; }
+
+template<typename T>
+static uint64_t run_raw(TransactionContext* tx, std::vector<tl2::TVar<T>>& table,
+                        long vars, long iters){
+    uint64_t seed = 88172645463325252ULL;
+    uint64_t start = bench_now_ns();
+
+    for (long it = 0; it < iters; it++){
+        uint64_t s = seed;
+        while (true){
+            seed = s;
+            tx_begin(tx);
+
+            long i = 0;
+            for (; i < vars; i++){
+                void* addr = table[bench_rand(&seed) & (TABLE_VARS - 1)].addr();
+                T v;
+                if (tx_read(tx, addr, &v, sizeof(v)) != 0) break;
+                v = bump(v);
+                if (tx_write(tx, addr, &v, sizeof(v)) != 0) break;
+            }
+            if (i == vars && tx_commit(tx)) break;
+        }
+    }
+
+    return bench_now_ns() - start;
+}
+
+template<typename T>
+static uint64_t run_typed(std::vector<tl2::TVar<T>>& table, long vars, long iters){
+    uint64_t seed = 88172645463325252ULL;
+    uint64_t start = bench_now_ns();
+
+    for (long it = 0; it < iters; it++){
+        uint64_t s = seed;
+        tl2::atomically([&](tl2::Tx& tx){
+            seed = s;
+            for (long i = 0; i < vars; i++){
+                tl2::TVar<T>& var = table[bench_rand(&seed) & (TABLE_VARS - 1)];
+                tx.write(var, bump(tx.read(var)));
+            }
+        });
+    }
+
+    return bench_now_ns() - start;
+}
+
+template<typename T>
+static void report(TransactionContext* tx, long vars, long iters){
+    std::vector<tl2::TVar<T>> table(TABLE_VARS);
+
+    // Warm the table and the lock stripes once.
+    run_raw(tx, table, vars, iters / 10 + 1);
+
+    uint64_t raw = run_raw(tx, table, vars, iters);
+    uint64_t typed = run_typed(table, vars, iters);
+
+    double n = (double)vars * iters;
+    printf("raw,%zu,%ld,%.2f\n", sizeof(T), vars, raw / n);
+    printf("tvar,%zu,%ld,%.2f\n", sizeof(T), vars, typed / n);
+}
+
+int main(int argc, char** argv){
+    long vars = bench_arg(argc, argv, 1, 16);
+    long iters = bench_arg(argc, argv, 2, 200000);
+
+    if (vars < 1 || vars > WS_SLOTS){
+        fprintf(stderr, "vars_per_tx must be in [1, %d]\n", WS_SLOTS);
+        return 1;
+    }
+    if (tx_init(0) != 0) return 1;
+    TransactionContext* tx = tx_thread_init();
+    if (!tx) return 1;
+
+    printf("api,bytes,vars_per_tx,ns_per_access\n");
+    report<uint32_t>(tx, vars, iters);
+    report<uint64_t>(tx, vars, iters);
+    report<Wide>(tx, vars, iters);
+
+    tx_shutdown();
+    return 0;
+}
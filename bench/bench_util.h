@@ -0,0 +1,98 @@
+// bench_util.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+static inline uint64_t bench_now_ns(){
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// xorshift64: cheap enough not to show up in per-access timings.
+static inline uint64_t bench_rand(uint64_t* state){
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Sorts `samples` in place; q in [0, 1].
+static inline uint64_t bench_percentile(std::vector<uint64_t>& samples, double q){
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t i = (size_t)(q * (samples.size() - 1));
+    return samples[i];
+}
+
+static inline long bench_arg(int argc, char** argv, int i, long fallback){
+    return argc > i ? strtol(argv[i], nullptr, 10) : fallback;
+}
+
+// Hardware counters for the calling thread and its children. Returns -1 where
+// perf events are unavailable (other OSes, containers, perf_event_paranoid),
+// in which case callers report the counter as missing.
+static inline int bench_counter_open(uint32_t type, uint64_t config){
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)type;
+    (void)config;
+    return -1;
+#endif
+}
+
+static inline void bench_counter_start(int fd){
+#ifdef __linux__
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#else
+    (void)fd;
+#endif
+}
+
+static inline long long bench_counter_stop(int fd){
+#ifdef __linux__
+    if (fd < 0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+    return value;
+#else
+    (void)fd;
+    return -1;
+#endif
+}
+
+static inline void bench_counter_close(int fd){
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#else
+    (void)fd;
+#endif
+}
@@ -0,0 +1,113 @@
+// bench_vlock_layout.cpp
+// Author: Anurag Choubey
+//
+// Lock-table layouts under two workloads:
+//   fields: thread t repeatedly commits to field t of a shared struct, so the
+//           transactions never conflict but packed stripes share a line;
+//   random: transactions update random words of a 64 MB table, which spreads
+//           lock accesses over the whole table and stresses the TLB.
+// dTLB load misses come from perf events and print as -1 when unavailable.
+//
+// usage: bench_vlock_layout [threads] [txs_per_thread]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+#include "transaction.h"
+#include "vlock.h"
+
+#define TABLE_WORDS (8 << 20)
+
+struct Layout{
+    const char* name;
+    size_t stripes;
+    unsigned stride;
+    int scatter;
+    int huge;
+};
+
+static const Layout layouts[] = {
+    {"packed",        NUM_STRIPES,      1, 0, 0},
+    {"packed_huge",   NUM_STRIPES,      1, 0, 1},
+    {"padded",        NUM_STRIPES / 8,  8, 0, 0},
+    {"padded_huge",   NUM_STRIPES / 8,  8, 0, 1},
+    {"scatter",       NUM_STRIPES,      1, 1, 0},
+    {"scatter_huge",  NUM_STRIPES,      1, 1, 1},
+};
+
+struct alignas(64) HotStruct{
+    uint64_t field[8];
+};
+
+static void txn_increment(TransactionContext* tx, uint64_t* addr){
+    while (true){
+        tx_begin(tx);
+        uint64_t v;
+        if (tx_read(tx, addr, &v, sizeof(v)) != 0) continue;
+        v++;
+        if (tx_write(tx, addr, &v, sizeof(v)) != 0) continue;
+        if (tx_commit(tx)) return;
+    }
+}
+
+static double run(int workload, int threads, long txs, std::vector<uint64_t>& table,
+                  HotStruct* hot, long long* tlb_misses){
+    int fd = bench_counter_open(PERF_TYPE_HW_CACHE,
+                                PERF_COUNT_HW_CACHE_DTLB |
+                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    std::vector<std::thread> workers;
+
+    bench_counter_start(fd);
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        workers.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            if (!tx) return;
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for (long i = 0; i < txs; i++){
+                if (workload == 0)
+                    txn_increment(tx, &hot->field[t & 7]);
+                else
+                    txn_increment(tx, &table[bench_rand(&seed) % TABLE_WORDS]);
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    uint64_t elapsed = bench_now_ns() - start;
+    *tlb_misses = bench_counter_stop(fd);
+    bench_counter_close(fd);
+
+    return (double)threads * txs * 1e9 / elapsed;
+}
+
+int main(int argc, char** argv){
+    int threads = (int)bench_arg(argc, argv, 1, 8);
+    long txs = bench_arg(argc, argv, 2, 200000);
+
+    std::vector<uint64_t> table(TABLE_WORDS, 0);
+    HotStruct hot = {};
+
+    printf("layout,workload,threads,commits_per_sec,dtlb_load_misses,huge_pages\n");
+    for (const Layout& l : layouts){
+        VLockConfig cfg;
+        vlock_default_config(&cfg);
+        cfg.stripes = l.stripes;
+        cfg.stride = l.stride;
+        cfg.scatter = l.scatter;
+        cfg.try_huge_pages = l.huge;
+        if (vlock_init_config(&cfg) != 0) return 1;
+
+        for (int workload = 0; workload < 2; workload++){
+            if (tx_init(0) != 0) return 1;
+            long long misses = 0;
+            double rate = run(workload, threads, txs, table, &hot, &misses);
+            printf("%s,%s,%d,%.0f,%lld,%d\n", l.name, workload ? "random" : "fields",
+                   threads, rate, misses, vlock_uses_huge_pages);
+            tx_shutdown();
+        }
+    }
+
+    return 0;
+}
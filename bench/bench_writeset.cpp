@@ -0,0 +1,64 @@
+// bench_writeset.cpp
+// Author: Anurag Choubey
+//
+// Write-set costs at 8, 128 and 2048 entries: filling the set, looking up
+// present and absent addresses, and rewriting entries that are already there.
+//
+// usage: bench_writeset [rounds]
+
+#include <cstdio>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "tset.h"
+
+int main(int argc, char** argv){
+    long rounds = bench_arg(argc, argv, 1, 2000);
+    static const int sizes[] = {8, 128, WS_SLOTS};
+
+    vlock_init();
+    char* slice = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, slice);
+
+    std::vector<uint64_t> vars(2 * WS_SLOTS);
+    uint64_t sink = 0;
+
+    printf("entries,add_ns,hit_ns,miss_ns,rewrite_ns\n");
+    for (int n : sizes){
+        uint64_t add = 0, hit = 0, miss = 0, rewrite = 0;
+
+        for (long r = 0; r < rounds; r++){
+            writeset_reset(&ws);
+
+            uint64_t t0 = bench_now_ns();
+            for (int i = 0; i < n; i++)
+                writeset_add(&ws, &vars[i], &vars[i], sizeof(uint64_t));
+            uint64_t t1 = bench_now_ns();
+
+            WriteEntry* e = nullptr;
+            for (int i = 0; i < n; i++)
+                sink += writeset_lookup(&ws, &vars[i], &e);
+            uint64_t t2 = bench_now_ns();
+
+            for (int i = 0; i < n; i++)
+                sink += writeset_lookup(&ws, &vars[WS_SLOTS + i], &e);
+            uint64_t t3 = bench_now_ns();
+
+            for (int i = 0; i < n; i++)
+                writeset_add(&ws, &vars[i], &vars[n - 1 - i], sizeof(uint64_t));
+            uint64_t t4 = bench_now_ns();
+
+            add += t1 - t0;
+            hit += t2 - t1;
+            miss += t3 - t2;
+            rewrite += t4 - t3;
+        }
+
+        double ops = (double)n * rounds;
+        printf("%d,%.2f,%.2f,%.2f,%.2f\n", n, add / ops, hit / ops, miss / ops, rewrite / ops);
+    }
+
+    delete[] slice;
+    return sink == 0;
+}
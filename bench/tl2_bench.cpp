@@ -0,0 +1,739 @@
+// tl2_bench.cpp
+// Author: Anurag Choubey
+//
+// STAMP-style workload suite. Each workload runs at 1, 2, 4, ... up to
+// max_threads threads, on a normal-page and/or a huge-page arena, and
+// reports one row per run:
+//
+//   bank     transfers between `accounts` accounts (fewer = more contention)
+//   hashmap  80% lookup / 10% insert / 10% remove, chained buckets
+//   list     the same mix on a sorted linked list
+//   rbtree   the same mix on a red-black tree
+//   scan     1 in 16 transactions sums SCAN_VARS accounts read-only, the
+//            rest are short transfers over the same accounts
+//
+// Latency is per transaction, including its retries. `valid` is 1 when the
+// structure's invariants still hold after the run.
+//
+// usage: tl2_bench [max_threads] [txs_per_thread] [accounts] [json] [pages] [hot]
+//        pages: 0 = normal, 1 = huge, 2 = both (default)
+//        hot:   if > 0, profile conflicts and write each run's `hot` hottest
+//               stripes to stderr
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "bench_util.h"
+#include "profile.h"
+#include "tl2.h"
+
+#define KEY_RANGE   (1 << 16)
+#define LIST_RANGE  256
+#define MAP_BUCKETS (1 << 14)
+#define SCAN_VARS   4096
+#define SCAN_EVERY  16
+#define PROFILE_SAMPLE 8
+
+struct BenchConfig{
+    long accounts;
+};
+
+// Per-thread state handed to every operation. Nodes unlinked by a committed
+// remove may still be read by concurrent transactions, so they are only
+// freed once the run is over; `spare` keeps a node that a failed insert did
+// not use.
+struct Worker{
+    uint64_t seed;
+    uint32_t attempts;
+    void* spare;
+    std::vector<void*> garbage;
+};
+
+struct Workload{
+    const char* name;
+    void* (*create)(const BenchConfig* cfg);
+    void  (*op)(void* state, Worker* w);
+    int   (*check)(void* state);
+    void  (*destroy)(void* state);
+};
+
+// Nodes hold only TVars and plain fields, so raw storage is enough.
+template<typename N>
+static N* node_take(Worker* w){
+    if (!w->spare) w->spare = new (malloc(sizeof(N))) N();
+    return (N*)w->spare;
+}
+
+static int pick_op(Worker* w){
+    uint64_t r = bench_rand(&w->seed) % 10;
+    return r < 8 ? 0 : (r == 8 ? 1 : 2);
+}
+
+// --- bank ------------------------------------------------------------------
+
+struct Bank{
+    long n;
+    std::vector<tl2::TVar<int64_t>> accounts;
+    explicit Bank(long count) : n(count), accounts(count) {}
+};
+
+static void* bank_create(const BenchConfig* cfg){
+    Bank* b = new Bank(cfg->accounts < 2 ? 2 : cfg->accounts);
+    for (auto& a : b->accounts) a.unsafe_set(1000);
+    return b;
+}
+
+static void bank_transfer(Bank* b, Worker* w){
+    long from = (long)(bench_rand(&w->seed) % b->n);
+    long to = (long)(bench_rand(&w->seed) % b->n);
+
+    tl2::atomically([&](tl2::Tx& tx){
+        w->attempts++;
+        tx.write(b->accounts[from], tx.read(b->accounts[from]) - 1);
+        tx.write(b->accounts[to], tx.read(b->accounts[to]) + 1);
+    });
+}
+
+static void bank_op(void* state, Worker* w){
+    bank_transfer((Bank*)state, w);
+}
+
+static int64_t bank_total(Bank* b){
+    return tl2::atomically_readonly([&](tl2::Tx& tx){
+        int64_t sum = 0;
+        for (auto& a : b->accounts) sum += tx.read(a);
+        return sum;
+    });
+}
+
+static int bank_check(void* state){
+    Bank* b = (Bank*)state;
+    return bank_total(b) == 1000 * b->n;
+}
+
+static void bank_destroy(void* state){
+    delete (Bank*)state;
+}
+
+// --- scan ------------------------------------------------------------------
+
+static void* scan_create(const BenchConfig*){
+    BenchConfig cfg = {SCAN_VARS};
+    return bank_create(&cfg);
+}
+
+// A scan that sees a torn snapshot would break the total, so it is checked
+// on every scan, not only at the end.
+static int scan_torn = 0;
+
+static void scan_op(void* state, Worker* w){
+    Bank* b = (Bank*)state;
+    if (bench_rand(&w->seed) % SCAN_EVERY){
+        bank_transfer(b, w);
+        return;
+    }
+
+    int64_t sum = tl2::atomically_readonly([&](tl2::Tx& tx){
+        w->attempts++;
+        int64_t s = 0;
+        for (auto& a : b->accounts) s += tx.read(a);
+        return s;
+    });
+    if (sum != 1000 * b->n) __atomic_store_n(&scan_torn, 1, __ATOMIC_RELAXED);
+}
+
+static int scan_check(void* state){
+    return bank_check(state) && !__atomic_load_n(&scan_torn, __ATOMIC_RELAXED);
+}
+
+// --- hashmap ---------------------------------------------------------------
+
+struct HNode{
+    uint64_t key;
+    tl2::TVar<uint64_t> value;
+    tl2::TVar<HNode*> next;
+};
+
+struct HashMap{
+    std::vector<tl2::TVar<HNode*>> buckets;
+    HashMap() : buckets(MAP_BUCKETS) {}
+};
+
+static tl2::TVar<HNode*>& hmap_bucket(HashMap* m, uint64_t key){
+    return m->buckets[(key * 0x9E3779B97F4A7C15ULL) >> (64 - 14)];
+}
+
+// Returns the link that points at key's node, or at the null after the
+// chain's last node.
+static tl2::TVar<HNode*>* hmap_find(tl2::Tx& tx, HashMap* m, uint64_t key){
+    tl2::TVar<HNode*>* link = &hmap_bucket(m, key);
+    for (HNode* n = tx.read(*link); n && n->key != key; n = tx.read(*link))
+        link = &n->next;
+    return link;
+}
+
+static int hmap_insert(HashMap* m, Worker* w, uint64_t key){
+    HNode* node = node_take<HNode>(w);
+    node->key = key;
+
+    int inserted = tl2::atomically([&](tl2::Tx& tx){
+        w->attempts++;
+        tl2::TVar<HNode*>* link = hmap_find(tx, m, key);
+        if (tx.read(*link)) return 0;
+        tx.write(node->value, key);
+        tx.write(node->next, (HNode*)nullptr);
+        tx.write(*link, node);
+        return 1;
+    });
+    if (inserted) w->spare = nullptr;
+    return inserted;
+}
+
+static void* hmap_create(const BenchConfig*){
+    HashMap* m = new HashMap();
+    Worker w = {0x2545F4914F6CDD1DULL, 0, nullptr, {}};
+    for (uint64_t k = 0; k < KEY_RANGE; k += 2)
+        hmap_insert(m, &w, k);
+    free(w.spare);
+    return m;
+}
+
+static void hmap_op(void* state, Worker* w){
+    HashMap* m = (HashMap*)state;
+    uint64_t key = bench_rand(&w->seed) % KEY_RANGE;
+
+    switch (pick_op(w)){
+    case 0:
+        tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            HNode* n = tx.read(*hmap_find(tx, m, key));
+            return n ? tx.read(n->value) : 0;
+        });
+        break;
+    case 1:
+        hmap_insert(m, w, key);
+        break;
+    default: {
+        HNode* removed = tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            tl2::TVar<HNode*>* link = hmap_find(tx, m, key);
+            HNode* n = tx.read(*link);
+            if (n) tx.write(*link, tx.read(n->next));
+            return n;
+        });
+        if (removed) w->garbage.push_back(removed);
+    }
+    }
+}
+
+static int hmap_check(void* state){
+    HashMap* m = (HashMap*)state;
+    for (size_t b = 0; b < m->buckets.size(); b++)
+        for (HNode* n = m->buckets[b].unsafe_get(); n; n = n->next.unsafe_get())
+            if (&hmap_bucket(m, n->key) != &m->buckets[b] || n->value.unsafe_get() != n->key)
+                return 0;
+    return 1;
+}
+
+static void hmap_destroy(void* state){
+    HashMap* m = (HashMap*)state;
+    for (auto& b : m->buckets){
+        HNode* n = b.unsafe_get();
+        while (n){
+            HNode* next = n->next.unsafe_get();
+            free(n);
+            n = next;
+        }
+    }
+    delete m;
+}
+
+// --- sorted list -----------------------------------------------------------
+
+struct LNode{
+    uint64_t key;
+    tl2::TVar<LNode*> next;
+};
+
+struct List{
+    tl2::TVar<LNode*> head;
+};
+
+// Link to the first node with a key >= key.
+static tl2::TVar<LNode*>* list_find(tl2::Tx& tx, List* l, uint64_t key){
+    tl2::TVar<LNode*>* link = &l->head;
+    for (LNode* n = tx.read(*link); n && n->key < key; n = tx.read(*link))
+        link = &n->next;
+    return link;
+}
+
+static int list_insert(List* l, Worker* w, uint64_t key){
+    LNode* node = node_take<LNode>(w);
+    node->key = key;
+
+    int inserted = tl2::atomically([&](tl2::Tx& tx){
+        w->attempts++;
+        tl2::TVar<LNode*>* link = list_find(tx, l, key);
+        LNode* n = tx.read(*link);
+        if (n && n->key == key) return 0;
+        tx.write(node->next, n);
+        tx.write(*link, node);
+        return 1;
+    });
+    if (inserted) w->spare = nullptr;
+    return inserted;
+}
+
+static void* list_create(const BenchConfig*){
+    List* l = new List();
+    Worker w = {0x2545F4914F6CDD1DULL, 0, nullptr, {}};
+    for (uint64_t k = 0; k < LIST_RANGE; k += 2)
+        list_insert(l, &w, k);
+    free(w.spare);
+    return l;
+}
+
+static void list_op(void* state, Worker* w){
+    List* l = (List*)state;
+    uint64_t key = bench_rand(&w->seed) % LIST_RANGE;
+
+    switch (pick_op(w)){
+    case 0:
+        tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            LNode* n = tx.read(*list_find(tx, l, key));
+            return n && n->key == key;
+        });
+        break;
+    case 1:
+        list_insert(l, w, key);
+        break;
+    default: {
+        LNode* removed = tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            tl2::TVar<LNode*>* link = list_find(tx, l, key);
+            LNode* n = tx.read(*link);
+            if (!n || n->key != key) return (LNode*)nullptr;
+            tx.write(*link, tx.read(n->next));
+            return n;
+        });
+        if (removed) w->garbage.push_back(removed);
+    }
+    }
+}
+
+static int list_check(void* state){
+    LNode* prev = nullptr;
+    for (LNode* n = ((List*)state)->head.unsafe_get(); n; n = n->next.unsafe_get()){
+        if (prev && prev->key >= n->key) return 0;
+        prev = n;
+    }
+    return 1;
+}
+
+static void list_destroy(void* state){
+    List* l = (List*)state;
+    LNode* n = l->head.unsafe_get();
+    while (n){
+        LNode* next = n->next.unsafe_get();
+        free(n);
+        n = next;
+    }
+    delete l;
+}
+
+// --- red-black tree --------------------------------------------------------
+// CLRS insert/delete with null leaves. TL2 reads are always consistent, so
+// the tree invariants hold inside every transaction.
+
+struct RbNode{
+    uint64_t key;
+    tl2::TVar<uint64_t> value;
+    tl2::TVar<RbNode*> left, right, parent;
+    tl2::TVar<uint8_t> red;
+};
+
+struct RbTree{
+    tl2::TVar<RbNode*> root;
+};
+
+static int rb_is_red(tl2::Tx& tx, RbNode* n){
+    return n && tx.read(n->red);
+}
+
+static void rb_replace_child(tl2::Tx& tx, RbTree* t, RbNode* p, RbNode* old, RbNode* repl){
+    if (!p) tx.write(t->root, repl);
+    else if (tx.read(p->left) == old) tx.write(p->left, repl);
+    else tx.write(p->right, repl);
+}
+
+static void rb_rotate_left(tl2::Tx& tx, RbTree* t, RbNode* x){
+    RbNode* y = tx.read(x->right);
+    RbNode* b = tx.read(y->left);
+    tx.write(x->right, b);
+    if (b) tx.write(b->parent, x);
+    RbNode* p = tx.read(x->parent);
+    tx.write(y->parent, p);
+    rb_replace_child(tx, t, p, x, y);
+    tx.write(y->left, x);
+    tx.write(x->parent, y);
+}
+
+static void rb_rotate_right(tl2::Tx& tx, RbTree* t, RbNode* x){
+    RbNode* y = tx.read(x->left);
+    RbNode* b = tx.read(y->right);
+    tx.write(x->left, b);
+    if (b) tx.write(b->parent, x);
+    RbNode* p = tx.read(x->parent);
+    tx.write(y->parent, p);
+    rb_replace_child(tx, t, p, x, y);
+    tx.write(y->right, x);
+    tx.write(x->parent, y);
+}
+
+static RbNode* rb_find(tl2::Tx& tx, RbTree* t, uint64_t key){
+    RbNode* n = tx.read(t->root);
+    while (n && n->key != key)
+        n = key < n->key ? tx.read(n->left) : tx.read(n->right);
+    return n;
+}
+
+static int rb_insert_tx(tl2::Tx& tx, RbTree* t, RbNode* z){
+    RbNode* p = nullptr;
+    RbNode* n = tx.read(t->root);
+    while (n){
+        if (z->key == n->key) return 0;
+        p = n;
+        n = z->key < n->key ? tx.read(n->left) : tx.read(n->right);
+    }
+
+    tx.write(z->value, z->key);
+    tx.write(z->left, (RbNode*)nullptr);
+    tx.write(z->right, (RbNode*)nullptr);
+    tx.write(z->parent, p);
+    tx.write(z->red, (uint8_t)1);
+    if (!p) tx.write(t->root, z);
+    else if (z->key < p->key) tx.write(p->left, z);
+    else tx.write(p->right, z);
+
+    while (rb_is_red(tx, p = tx.read(z->parent))){
+        RbNode* g = tx.read(p->parent);
+        int left = tx.read(g->left) == p;
+        RbNode* u = left ? tx.read(g->right) : tx.read(g->left);
+
+        if (rb_is_red(tx, u)){
+            tx.write(p->red, (uint8_t)0);
+            tx.write(u->red, (uint8_t)0);
+            tx.write(g->red, (uint8_t)1);
+            z = g;
+            continue;
+        }
+        if (z == (left ? tx.read(p->right) : tx.read(p->left))){
+            z = p;
+            if (left) rb_rotate_left(tx, t, z);
+            else rb_rotate_right(tx, t, z);
+            p = tx.read(z->parent);
+        }
+        tx.write(p->red, (uint8_t)0);
+        tx.write(g->red, (uint8_t)1);
+        if (left) rb_rotate_right(tx, t, g);
+        else rb_rotate_left(tx, t, g);
+    }
+    tx.write(tx.read(t->root)->red, (uint8_t)0);
+    return 1;
+}
+
+static void rb_transplant(tl2::Tx& tx, RbTree* t, RbNode* u, RbNode* v){
+    RbNode* p = tx.read(u->parent);
+    rb_replace_child(tx, t, p, u, v);
+    if (v) tx.write(v->parent, p);
+}
+
+static void rb_erase_fixup(tl2::Tx& tx, RbTree* t, RbNode* x, RbNode* xp){
+    while (x != tx.read(t->root) && !rb_is_red(tx, x)){
+        int left = tx.read(xp->left) == x;
+        RbNode* w = left ? tx.read(xp->right) : tx.read(xp->left);
+
+        if (rb_is_red(tx, w)){
+            tx.write(w->red, (uint8_t)0);
+            tx.write(xp->red, (uint8_t)1);
+            if (left) rb_rotate_left(tx, t, xp);
+            else rb_rotate_right(tx, t, xp);
+            w = left ? tx.read(xp->right) : tx.read(xp->left);
+        }
+
+        RbNode* near = left ? tx.read(w->left) : tx.read(w->right);
+        RbNode* far = left ? tx.read(w->right) : tx.read(w->left);
+        if (!rb_is_red(tx, near) && !rb_is_red(tx, far)){
+            tx.write(w->red, (uint8_t)1);
+            x = xp;
+            xp = tx.read(x->parent);
+            continue;
+        }
+
+        if (!rb_is_red(tx, far)){
+            tx.write(near->red, (uint8_t)0);
+            tx.write(w->red, (uint8_t)1);
+            if (left) rb_rotate_right(tx, t, w);
+            else rb_rotate_left(tx, t, w);
+            w = left ? tx.read(xp->right) : tx.read(xp->left);
+            far = left ? tx.read(w->right) : tx.read(w->left);
+        }
+        tx.write(w->red, tx.read(xp->red));
+        tx.write(xp->red, (uint8_t)0);
+        tx.write(far->red, (uint8_t)0);
+        if (left) rb_rotate_left(tx, t, xp);
+        else rb_rotate_right(tx, t, xp);
+        x = tx.read(t->root);
+        xp = nullptr;
+    }
+    if (x) tx.write(x->red, (uint8_t)0);
+}
+
+static RbNode* rb_erase_tx(tl2::Tx& tx, RbTree* t, uint64_t key){
+    RbNode* z = rb_find(tx, t, key);
+    if (!z) return nullptr;
+
+    RbNode* zl = tx.read(z->left);
+    RbNode* zr = tx.read(z->right);
+    int removed_red = tx.read(z->red);
+    RbNode *x, *xp;
+
+    if (!zl || !zr){
+        x = zl ? zl : zr;
+        xp = tx.read(z->parent);
+        rb_transplant(tx, t, z, x);
+    } else {
+        RbNode* y = zr;
+        for (RbNode* l = tx.read(y->left); l; l = tx.read(y->left))
+            y = l;
+        removed_red = tx.read(y->red);
+        x = tx.read(y->right);
+
+        if (tx.read(y->parent) == z){
+            xp = y;
+        } else {
+            xp = tx.read(y->parent);
+            rb_transplant(tx, t, y, x);
+            tx.write(y->right, zr);
+            tx.write(zr->parent, y);
+        }
+        rb_transplant(tx, t, z, y);
+        tx.write(y->left, zl);
+        tx.write(zl->parent, y);
+        tx.write(y->red, tx.read(z->red));
+    }
+
+    if (!removed_red) rb_erase_fixup(tx, t, x, xp);
+    return z;
+}
+
+static int rb_insert(RbTree* t, Worker* w, uint64_t key){
+    RbNode* node = node_take<RbNode>(w);
+    node->key = key;
+
+    int inserted = tl2::atomically([&](tl2::Tx& tx){
+        w->attempts++;
+        return rb_insert_tx(tx, t, node);
+    });
+    if (inserted) w->spare = nullptr;
+    return inserted;
+}
+
+static void* rb_create(const BenchConfig*){
+    RbTree* t = new RbTree();
+    Worker w = {0x2545F4914F6CDD1DULL, 0, nullptr, {}};
+    for (uint64_t k = 0; k < KEY_RANGE; k += 2)
+        rb_insert(t, &w, (k * 40503) % KEY_RANGE);
+    free(w.spare);
+    return t;
+}
+
+static void rb_op(void* state, Worker* w){
+    RbTree* t = (RbTree*)state;
+    uint64_t key = bench_rand(&w->seed) % KEY_RANGE;
+
+    switch (pick_op(w)){
+    case 0:
+        tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            RbNode* n = rb_find(tx, t, key);
+            return n ? tx.read(n->value) : 0;
+        });
+        break;
+    case 1:
+        rb_insert(t, w, key);
+        break;
+    default: {
+        RbNode* removed = tl2::atomically([&](tl2::Tx& tx){
+            w->attempts++;
+            return rb_erase_tx(tx, t, key);
+        });
+        if (removed) w->garbage.push_back(removed);
+    }
+    }
+}
+
+// Black height of the subtree, or -1 if it breaks an invariant.
+static int rb_check_node(RbNode* n, RbNode* parent, uint64_t lo, uint64_t hi){
+    if (!n) return 1;
+    if (n->parent.unsafe_get() != parent || n->key < lo || n->key > hi) return -1;
+
+    RbNode* l = n->left.unsafe_get();
+    RbNode* r = n->right.unsafe_get();
+    if (n->red.unsafe_get() && ((l && l->red.unsafe_get()) || (r && r->red.unsafe_get())))
+        return -1;
+
+    int lh = rb_check_node(l, n, lo, n->key ? n->key - 1 : 0);
+    int rh = rb_check_node(r, n, n->key + 1, hi);
+    if (lh < 0 || lh != rh || (l && l->key >= n->key)) return -1;
+    return lh + !n->red.unsafe_get();
+}
+
+static int rb_check(void* state){
+    RbNode* root = ((RbTree*)state)->root.unsafe_get();
+    return (!root || !root->red.unsafe_get()) && rb_check_node(root, nullptr, 0, UINT64_MAX) > 0;
+}
+
+static void rb_free(RbNode* n){
+    if (!n) return;
+    rb_free(n->left.unsafe_get());
+    rb_free(n->right.unsafe_get());
+    free(n);
+}
+
+static void rb_destroy(void* state){
+    RbTree* t = (RbTree*)state;
+    rb_free(t->root.unsafe_get());
+    delete t;
+}
+
+// ---------------------------------------------------------------------------
+
+static const Workload workloads[] = {
+    {"bank", bank_create, bank_op, bank_check, bank_destroy},
+    {"hashmap", hmap_create, hmap_op, hmap_check, hmap_destroy},
+    {"list", list_create, list_op, list_check, list_destroy},
+    {"rbtree", rb_create, rb_op, rb_check, rb_destroy},
+    {"scan", scan_create, scan_op, scan_check, bank_destroy},
+};
+
+static void run(const Workload* wl, const BenchConfig* cfg, int huge, int threads,
+                long txs, int json, int hot, int* first_row){
+    if (tx_init(huge) != 0){
+        fprintf(stderr, "tx_init failed\n");
+        exit(1);
+    }
+    scan_torn = 0;
+    void* state = wl->create(cfg);
+
+    std::vector<Worker> workers(threads);
+    std::vector<std::vector<uint64_t>> lat(threads);
+    std::vector<std::thread> pool;
+
+    if (hot > 0) profile_start(PROFILE_SAMPLE);
+    uint64_t start = bench_now_ns();
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            Worker* w = &workers[t];
+            w->seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            w->attempts = 0;
+            w->spare = nullptr;
+            lat[t].reserve(txs);
+
+            for (long i = 0; i < txs; i++){
+                uint64_t t0 = bench_now_ns();
+                wl->op(state, w);
+                lat[t].push_back(bench_now_ns() - t0);
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+    uint64_t elapsed = bench_now_ns() - start;
+
+    if (hot > 0){
+        profile_stop();
+        fprintf(stderr, "# %s, %s pages, %d threads\n", wl->name, huge ? "huge" : "normal", threads);
+        profile_dump(stderr, hot);
+    }
+
+    int valid = wl->check(state);
+
+    std::vector<uint64_t> all;
+    uint64_t attempts = 0;
+    for (int t = 0; t < threads; t++){
+        all.insert(all.end(), lat[t].begin(), lat[t].end());
+        attempts += workers[t].attempts;
+        for (void* p : workers[t].garbage) free(p);
+        free(workers[t].spare);
+    }
+
+    uint64_t commits = all.size();
+    uint64_t aborts = attempts - commits;
+    const char* pages = huge ? "huge" : "normal";
+    double cps = (double)commits * 1e9 / elapsed;
+    double abort_rate = attempts ? (double)aborts / attempts : 0.0;
+    unsigned long long p50 = bench_percentile(all, 0.5);
+    unsigned long long p99 = bench_percentile(all, 0.99);
+    unsigned long long p999 = bench_percentile(all, 0.999);
+
+    if (json){
+        printf("%s\n  {\"workload\": \"%s\", \"pages\": \"%s\", \"huge_active\": %d, "
+               "\"threads\": %d, \"commits\": %llu, \"commits_per_sec\": %.0f, "
+               "\"aborts\": %llu, \"abort_rate\": %.4f, \"p50_ns\": %llu, "
+               "\"p99_ns\": %llu, \"p999_ns\": %llu, \"valid\": %d}",
+               *first_row ? "" : ",", wl->name, pages, arena_uses_huge_pages, threads,
+               (unsigned long long)commits, cps, (unsigned long long)aborts, abort_rate,
+               p50, p99, p999, valid);
+    } else {
+        printf("%s,%s,%d,%d,%llu,%.0f,%llu,%.4f,%llu,%llu,%llu,%d\n",
+               wl->name, pages, arena_uses_huge_pages, threads,
+               (unsigned long long)commits, cps, (unsigned long long)aborts, abort_rate,
+               p50, p99, p999, valid);
+    }
+    fflush(stdout);
+    *first_row = 0;
+
+    wl->destroy(state);
+    tx_shutdown();
+}
+
+int main(int argc, char** argv){
+    int hw = (int)std::thread::hardware_concurrency();
+    int max_threads = (int)bench_arg(argc, argv, 1, hw > 0 ? hw : 4);
+    long txs = bench_arg(argc, argv, 2, 20000);
+    BenchConfig cfg = {bench_arg(argc, argv, 3, 1024)};
+    int json = (int)bench_arg(argc, argv, 4, 0);
+    int pages = (int)bench_arg(argc, argv, 5, 2);
+    int hot = (int)bench_arg(argc, argv, 6, 0);
+
+    // The main thread keeps a slice for setup and checks.
+    if (max_threads > MAX_THREADS - 1) max_threads = MAX_THREADS - 1;
+    if (max_threads < 1 || txs < 1){
+        fprintf(stderr, "usage: tl2_bench [max_threads] [txs_per_thread] [accounts] [json] [pages] [hot]\n");
+        return 1;
+    }
+
+    if (json) printf("[");
+    else printf("workload,pages,huge_active,threads,commits,commits_per_sec,aborts,"
+                "abort_rate,p50_ns,p99_ns,p999_ns,valid\n");
+
+    int first_row = 1;
+    for (int huge = 0; huge <= 1; huge++){
+        if (pages != 2 && pages != huge) continue;
+        for (const Workload& wl : workloads){
+            for (int t = 1; ; t *= 2){
+                if (t > max_threads) t = max_threads;
+                run(&wl, &cfg, huge, t, txs, json, hot, &first_row);
+                if (t == max_threads) break;
+            }
+        }
+    }
+
+    if (json) printf("\n]\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+# tl2_pgo.cmake
+# Author: Anurag Choubey
+#
+# Two-phase profile-guided build of bench_hotpath_inline, driven by the
+# hotpath_pgo target:
+#
+#   cmake -DTL2_SOURCE_DIR=<src> -DTL2_PGO_BUILD=<dir> [-DTL2_CXX=<c++>] -P tl2_pgo.cmake
+#
+# Phase one configures <dir> with TL2_PGO=generate, builds the instrumented
+# binary and runs the hot-path workload as training; phase two reconfigures
+# the same tree with TL2_PGO=use and rebuilds. Both phases share the tree
+# because GCC names its profile files after the object paths.
+
+if (NOT TL2_SOURCE_DIR OR NOT TL2_PGO_BUILD)
+    message(FATAL_ERROR "tl2_pgo.cmake needs TL2_SOURCE_DIR and TL2_PGO_BUILD")
+endif()
+
+set(compiler_args "")
+if (TL2_CXX)
+    set(compiler_args -DCMAKE_CXX_COMPILER=${TL2_CXX})
+endif()
+
+function(tl2_pgo_phase phase)
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -S ${TL2_SOURCE_DIR} -B ${TL2_PGO_BUILD}
+                -DCMAKE_BUILD_TYPE=Release -DTL2_BUILD_BENCH=ON -DTL2_PGO=${phase}
+                ${compiler_args}
+        RESULT_VARIABLE rc OUTPUT_QUIET)
+    if (rc)
+        message(FATAL_ERROR "PGO ${phase}: configure failed")
+    endif()
+
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} --build ${TL2_PGO_BUILD} --target bench_hotpath_inline
+        RESULT_VARIABLE rc OUTPUT_QUIET)
+    if (rc)
+        message(FATAL_ERROR "PGO ${phase}: build failed")
+    endif()
+endfunction()
+
+# Stale profiles from an earlier run would be merged into this one.
+file(GLOB_RECURSE stale ${TL2_PGO_BUILD}/*.gcda)
+if (stale)
+    file(REMOVE ${stale})
+endif()
+file(REMOVE_RECURSE ${TL2_PGO_BUILD}/pgo-data)
+
+tl2_pgo_phase(generate)
+execute_process(
+    COMMAND ${TL2_PGO_BUILD}/bench_hotpath_inline 0 50000
+    RESULT_VARIABLE rc OUTPUT_QUIET)
+if (rc)
+    message(FATAL_ERROR "PGO training run failed")
+endif()
+
+# Clang writes raw profiles that have to be merged first.
+file(GLOB raw ${TL2_PGO_BUILD}/pgo-data/*.profraw)
+if (raw)
+    find_program(LLVM_PROFDATA NAMES llvm-profdata)
+    if (NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "PGO: llvm-profdata not found")
+    endif()
+    execute_process(
+        COMMAND ${LLVM_PROFDATA} merge -o ${TL2_PGO_BUILD}/pgo-data/default.profdata ${raw}
+        RESULT_VARIABLE rc)
+    if (rc)
+        message(FATAL_ERROR "PGO: llvm-profdata merge failed")
+    endif()
+endif()
+
+tl2_pgo_phase(use)
+message(STATUS "PGO build: ${TL2_PGO_BUILD}/bench_hotpath_inline")
@@ -0,0 +1,108 @@
+// alloc.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "arena.h"
+
+// Block allocator behind tx_malloc / tx_free. Each arena slice owns one pool
+// per size class (16 << cls bytes), carved from ALLOC_CHUNK_SIZE-aligned
+// mmap chunks, so a block finds its chunk header, and with it its class, by
+// masking its address. Larger blocks get a chunk of their own.
+//
+// A freed block may still be read by transactions that started before the
+// free committed, so it is not reused at once: it is "retired" into a batch
+// tagged with the global epoch. A transaction announces the epoch it started
+// in; the epoch advances only when every running transaction has seen the
+// current one, so a batch tagged e can be reused once the epoch reaches
+// e + 2. Reclaimed blocks go to the pool of the thread that freed them;
+// beyond ALLOC_CACHE_MAX free blocks in a class, half move to a shared depot
+// that other threads refill from.
+//
+// Pools, chunk lists and the limbo live at ALLOC_OFFSET in the slice and
+// are only touched by the owning thread; chunks are unmapped by
+// alloc_destroy (tx_shutdown).
+#define ALLOC_CLASSES     9                  // 16 .. 4096 bytes
+#define ALLOC_MAX_SMALL   (16 << (ALLOC_CLASSES - 1))
+#define ALLOC_ALIGN       16
+#define ALLOC_CHUNK_SIZE  (256 * 1024)       // a power of two
+#define ALLOC_CHUNK_HDR   64
+#define ALLOC_LARGE       0xFFFFFFFFu
+#define ALLOC_LOG_MAX     128                // tx_malloc / tx_free per transaction
+#define ALLOC_BATCH       61                 // blocks per limbo batch
+#define ALLOC_CACHE_MAX   1024               // free blocks per class before spilling
+
+struct AllocChunk{
+    uint32_t cls;       // ALLOC_LARGE for a single large block
+    uint32_t pad;
+    size_t bytes;       // mapping length
+    AllocChunk* next;
+    AllocChunk* prev;   // large chunks only
+};
+
+// Lives inside a small block, so it is recycled like one.
+struct AllocBatch{
+    AllocBatch* next;
+    uint64_t epoch;
+    uint32_t count;
+    void* blocks[ALLOC_BATCH];
+};
+
+struct AllocState{
+    // epoch << 1 | 1 while a transaction runs, 0 otherwise. Read by other
+    // threads advancing the epoch, so it has the first line to itself.
+    alignas(64) std::atomic<uint64_t> epoch;
+
+    alignas(64) void* free_list[ALLOC_CLASSES];
+    uint32_t free_count[ALLOC_CLASSES];
+    char* carve[ALLOC_CLASSES];
+    char* carve_end[ALLOC_CLASSES];
+    AllocChunk* chunks;
+
+    AllocBatch* open;           // filling
+    AllocBatch* limbo_head;     // sealed, oldest first
+    AllocBatch* limbo_tail;
+
+    // The running transaction's allocations (freed if it aborts) and frees
+    // (retired if it commits).
+    uint32_t fresh_count;
+    uint32_t freed_count;
+    void* fresh[ALLOC_LOG_MAX];
+    void* freed[ALLOC_LOG_MAX];
+};
+
+static_assert(sizeof(AllocBatch) <= ALLOC_MAX_SMALL, "AllocBatch must fit a small block");
+static_assert(sizeof(AllocState) <= ALLOC_BYTES, "AllocState does not fit in its slice region");
+
+static inline AllocState* alloc_slice(char* slice){
+    return (AllocState*)(slice + ALLOC_OFFSET);
+}
+
+// Size class for size (<= ALLOC_MAX_SMALL).
+static inline uint32_t alloc_class(size_t size){
+    return size <= 16 ? 0 : 60 - (uint32_t)__builtin_clzll(size - 1);
+}
+
+// A block of at least size bytes, ALLOC_ALIGN-aligned, or nullptr if no
+// memory could be mapped.
+void* alloc_block(char* slice, size_t size);
+
+// Back to the slice's pool now; nothing may still be reading p.
+void  alloc_release(char* slice, void* p);
+
+// Back to the pool once no running transaction can still be reading p.
+void  alloc_retire(char* slice, void* p);
+
+// Transaction boundaries: announce the current epoch / announce none.
+void  alloc_enter(char* slice);
+void  alloc_leave(char* slice);
+
+// Moves the epoch on if every running transaction has seen it; returns the
+// epoch afterwards.
+uint64_t alloc_try_advance();
+
+// Unmaps every chunk of every slice. Only at shutdown, before arena_destroy.
+void  alloc_destroy();
@@ -8,22 +8,43 @@
 #include <cstdint>
 
 #define MAX_THREADS    64
+#define MAX_NUMA_NODES 64
 #define PAGE_SIZE      4096 
 #define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-#define WS_KEYS_OFFSET   0
-#define WS_KEYS_BYTES    (2048 * sizeof(void*))
+#define WS_TABLE_OFFSET  0
+#define WS_TABLE_BYTES   (2048 * sizeof(void*))
 
-#define WS_VALUES_OFFSET (WS_KEYS_OFFSET + WS_KEYS_BYTES)
-#define WS_VALUES_BYTES  (2048 * 144)
+#define WS_LOG_OFFSET    (WS_TABLE_OFFSET + WS_TABLE_BYTES)
+#define WS_LOG_BYTES     (2048 * 64)
 
-#define RS_OFFSET        (WS_VALUES_OFFSET + WS_VALUES_BYTES)
+#define RS_OFFSET        (WS_LOG_OFFSET + WS_LOG_BYTES)
 #define RS_BYTES         (2048 * sizeof(void*))
 
 #define BLOOM_OFFSET     (RS_OFFSET + RS_BYTES)
-#define BLOOM_BYTES_SZ   1224
+#define BLOOM_BYTES_SZ   (17 * sizeof(uint64_t))
 
-#define SLICE_RAW        (BLOOM_OFFSET + BLOOM_BYTES_SZ)
+#define WS_LOCKS_OFFSET  (BLOOM_OFFSET + BLOOM_BYTES_SZ)
+#define WS_LOCKS_BYTES   (2048 * sizeof(void*))
+
+#define WS_INDEX_OFFSET  (WS_LOCKS_OFFSET + WS_LOCKS_BYTES)
+#define WS_INDEX_BYTES   (4096 * sizeof(uint32_t))
+
+#define RS_DEDUP_OFFSET  (WS_INDEX_OFFSET + WS_INDEX_BYTES)
+#define RS_DEDUP_BYTES   (1024 * sizeof(uint16_t))
+
+#define TX_CTX_OFFSET    (((RS_DEDUP_OFFSET + RS_DEDUP_BYTES + 63) / 64) * 64)
+#define TX_CTX_BYTES     320
+
+#define STATS_OFFSET     (TX_CTX_OFFSET + TX_CTX_BYTES)
+#define STATS_BYTES      384
+
+#define ALLOC_OFFSET     (STATS_OFFSET + STATS_BYTES)
+#define ALLOC_BYTES      2560
+
+#define MV_OFFSET        (ALLOC_OFFSET + ALLOC_BYTES)
+#define MV_BYTES         64
+#define SLICE_RAW        (MV_OFFSET + MV_BYTES)
 #define SLICE_SIZE       (((SLICE_RAW + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE)
 #define ARENA_RAW        (MAX_THREADS * SLICE_SIZE)
 #define ARENA_SIZE       (((ARENA_RAW + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE)
@@ -31,8 +52,41 @@
 extern char* arena_base;
 extern std::atomic<uint32_t> arena_next_slot;
 extern int arena_uses_huge_pages;
+extern uint32_t arena_capacity;
+extern size_t arena_size;
 
+// arena_init reserves MAX_THREADS slices; arena_init_threads any number.
+// The reservation is MAP_NORESERVE, so untouched slices cost no memory.
+//
+// Slots are split into one contiguous range per NUMA node, each bound to its
+// node with MPOL_PREFERRED, and a registering thread is served from the range
+// of the node it runs on (falling back to other nodes when that range is
+// full). arena_init_numa takes the node count explicitly, e.g. to fake a
+// topology; 0 detects it. On single-node machines, or where mbind is not
+// available, placement is left to first touch.
 int   arena_init(int try_huge_pages);
+int   arena_init_threads(int try_huge_pages, uint32_t max_threads);
+int   arena_init_numa(int try_huge_pages, uint32_t max_threads, int nodes);
 void  arena_destroy();
+
+// Released slices go on a lock-free free list and are handed out again
+// before any fresh slot is used.
 char* arena_register_thread();
+int   arena_release_thread(char* slice);
+
+// Number of slices handed out at some point, whether or not they are in use
+// now: the sum of the per-node ranges' high-water marks. Slot ids are not
+// dense (each range starts at its node's first slot), so walk slices with
+// arena_slot_slice over [0, arena_max_threads()), skipping nullptr.
 int   arena_slot_count();
+int   arena_max_threads();
+
+// Slice for slot id in [0, arena_max_threads()), or nullptr if that slot
+// has never been handed out.
+char* arena_slot_slice(int slot);
+
+// Diagnostics: node count of the arena and the node a slice's range is bound
+// to (-1 for a pointer outside the arena).
+int   arena_numa_nodes();
+int   arena_slice_node(char* slice);
+int   arena_current_node();
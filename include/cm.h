@@ -0,0 +1,64 @@
+// cm.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Contention-management policies.
+//   CM_BACKOFF: randomized exponential backoff with pause; a committer gives
+//               up on a held stripe after CM_MAX_TRIES bounded spins.
+//   CM_YIELD:   like CM_BACKOFF, but yields the CPU once a wait or a retry
+//               streak reaches CM_YIELD_AFTER, so a preempted lock holder
+//               can run.
+//   CM_POLKA:   Polka: Karma priority plus backoff, waiter against holder.
+//               Karma is the work (reads and writes) a transaction has
+//               invested across its aborted attempts. Committers publish
+//               theirs for the stripes they lock; a waiter waits
+//               CM_MAX_TRIES/2 tries, plus one per CM_KARMA_UNIT by which
+//               its karma exceeds the holder's, before aborting itself. A
+//               holder is already committing and is never aborted, so
+//               priority decides how long the waiter insists.
+#define CM_BACKOFF 0
+#define CM_YIELD   1
+#define CM_POLKA   2
+
+#ifndef TL2_CM_POLICY
+#define TL2_CM_POLICY CM_BACKOFF
+#endif
+
+#define CM_SPIN_BUDGET  64
+#define CM_MAX_TRIES    8
+#define CM_YIELD_AFTER  4
+#define CM_KARMA_UNIT   16
+#define CM_MAX_BACKOFF  12
+
+// Published holder karma, hashed by stripe. A stripe whose entry belongs to
+// another stripe, or whose holder did not publish (irrevocable transactions,
+// tl2_kcas), reads as a holder with no karma; entries are not cleared on
+// release, so a waiter may see the previous holder's.
+#define CM_HOLDER_SLOTS 4096 // a power of two
+
+struct CMState{
+    uint32_t attempts;
+    uint64_t karma;
+    uint64_t seed;
+};
+
+extern int cm_policy;
+
+int  cm_set_policy(int policy);
+void cm_init(CMState* cm, uint64_t seed);
+
+// A commit found `lock` still held after `tries` bounded spins. Waits
+// according to the policy and returns 1 to try again or 0 to abort.
+int  cm_on_busy(CMState* cm, uint32_t tries, const std::atomic<uint64_t>* lock);
+
+// Under CM_POLKA, called by a commit for each stripe it has locked.
+void cm_publish(const CMState* cm, const std::atomic<uint64_t>* lock);
+
+// Called by tx_begin when restarting an aborted transaction, with the work
+// the failed attempt did.
+void cm_on_abort(CMState* cm, uint32_t work);
+void cm_on_commit(CMState* cm);
@@ -3,10 +3,48 @@
 
 #pragma once
 #include <atomic>
+#include <cstdint>
+#include "tl2_inline.h"
+
+// Commit timestamp schemes (names follow the TL2 paper).
+//   GV1: every writing commit does a fetch_add.
+//   GV4: pass-on-failure; a committer that loses the CAS adopts the winner's
+//        timestamp instead of retrying.
+//   GV5: committers use gvc + 1 without storing it; the clock only advances
+//        when a reader aborts on a version newer than its snapshot.
+//   GV6: GV5, with every GVC_SAMPLE_PERIOD-th commit of a thread doing a GV4
+//        increment so the clock still moves under write-only loads.
+#define GVC_MODE_GV1 0
+#define GVC_MODE_GV4 1
+#define GVC_MODE_GV5 2
+#define GVC_MODE_GV6 3
+
+#ifndef TL2_GVC_MODE
+#define TL2_GVC_MODE GVC_MODE_GV1
+#endif
+
+#define GVC_SAMPLE_PERIOD 32
 
 extern std::atomic<uint64_t> gvc;
+extern int gvc_mode;
 
 void gvc_init();
+int  gvc_set_mode(int mode);
 uint64_t gvc_get();
-uint64_t gvc_read();
+TL2_HOT uint64_t gvc_read();
 uint64_t gvc_inc();
+
+// Write version for a committer that already holds its stripe locks.
+// *unique is set when no other commit can share the returned version, which
+// is what allows skipping read-set validation when wv == rv + 1.
+uint64_t gvc_commit_version(int* unique);
+
+// Called when a read finds a stripe version newer than the snapshot, so that
+// the GV5/GV6 clock catches up and the retry can succeed.
+void gvc_observe(uint64_t version);
+
+#if TL2_INLINE || defined(TL2_GVC_IMPL)
+TL2_HOT uint64_t gvc_read(){
+    return gvc.load(std::memory_order_acquire);
+}
+#endif
@@ -0,0 +1,100 @@
+// mvcc.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "arena.h"
+
+// Optional version history, so that read-only transactions can read the
+// value a location had at their snapshot instead of aborting when a writer
+// has moved its stripe past read_version.
+//
+// While enabled, every commit records the old contents of each 8-byte word
+// it overwrites, tagged with its write version, before writing back. The
+// records live in a hash table of MvConfig::buckets buckets of
+// MvConfig::depth entries, each bucket guarded by a seqlock. A read-only
+// read at snapshot rv that finds its stripe too new takes the record of the
+// word with the smallest version above rv (the first overwrite after the
+// snapshot), or, if there is none, the value it just read when its stripe
+// was unlocked and unchanged across the copy. Only reads that fall within
+// one aligned word can be served this way.
+//
+// Read-only transactions announce their snapshot at MV_OFFSET in their
+// slice. The minimum announced snapshot (the horizon) bounds what anyone
+// may still ask for, so records at or below it are reused first; a bucket
+// that has to overwrite a newer record raises its floor to that record's
+// version, and reads at snapshots below the floor abort as before.
+// Irrevocable transactions write in place without records, so their commit
+// raises a global floor instead.
+//
+// Memory is buckets * mv_bucket_bytes(depth), mapped by mv_enable.
+#define MV_DEPTH_MAX 32
+
+struct MvConfig{
+    size_t buckets;     // a power of two
+    unsigned depth;     // records per bucket, 1 .. MV_DEPTH_MAX
+};
+
+struct MvEntry{
+    uint64_t addr;      // 8-byte aligned word, 0 if unused
+    uint64_t version;   // write version of the commit that overwrote it
+    uint64_t value;     // contents before that commit
+};
+
+struct MvBucket{
+    std::atomic<uint64_t> seq;  // odd while a committer is writing the bucket
+    uint64_t floor;             // newest version evicted from the bucket
+    MvEntry entries[1];         // depth entries
+};
+
+// snapshot << 1 | 1 while a read-only transaction runs, 0 otherwise.
+struct MvSlot{
+    alignas(64) std::atomic<uint64_t> snapshot;
+};
+
+static_assert(sizeof(MvSlot) <= MV_BYTES, "MvSlot does not fit in its slice region");
+
+static inline MvSlot* mv_slot(char* slice){
+    return (MvSlot*)(slice + MV_OFFSET);
+}
+
+static inline size_t mv_bucket_bytes(unsigned depth){
+    return (offsetof(MvBucket, entries) + depth * sizeof(MvEntry) + 63) & ~(size_t)63;
+}
+
+extern std::atomic<int> mv_on;
+
+static inline int mv_enabled(){
+    return mv_on.load(std::memory_order_relaxed);
+}
+
+void   mv_default_config(MvConfig* cfg);
+
+// Not thread-safe: call while no transactions are running. Returns -1 for a
+// bad configuration, for stripes narrower than a word, or if the table
+// cannot be mapped. tx_shutdown calls mv_disable.
+int    mv_enable(const MvConfig* cfg);
+void   mv_disable();
+
+// Bytes of history mapped, 0 while disabled.
+size_t mv_bytes();
+
+// Read-only transaction boundaries: announce a snapshot no newer than the
+// read_version sampled right after, or none.
+void   mv_enter(char* slice);
+void   mv_leave(char* slice);
+
+// Committer side, with the stripes of [addr, addr + size) locked and before
+// writing them back.
+void   mv_record(void* addr, size_t size, uint64_t version);
+
+// Irrevocable commit at `version`: snapshots below it lose the history.
+void   mv_raise_floor(uint64_t version);
+
+// Fills dst with the size bytes at addr as of snapshot rv and returns 1, or
+// returns 0. `stable` says dst already holds a copy taken with the stripe
+// unlocked and unchanged.
+int    mv_read(void* addr, void* dst, size_t size, uint64_t rv, int stable);
@@ -0,0 +1,65 @@
+// profile.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "stats.h"
+
+// Conflict profiler: attributes aborts to lock stripes. While running, every
+// sample_period-th conflict on a thread records the stripe (vlock_index) and,
+// where known, the address involved into a fixed lock-free table of heavy
+// hitters. Reads know their address and commits know their written
+// addresses; a commit-time validation failure only knows the stripe.
+//
+// The table is Space-Saving over a probe window: a stripe whose window is
+// full replaces the least-counted stripe in it and inherits that count as
+// its error, so count - error never overstates a stripe's own events and a
+// stripe that turns hot late still reaches the top.
+//
+// A stripe that collects several distinct addresses is a false conflict
+// between unrelated data that hashes to the same lock word: spread that data
+// out or give the table more stripes.
+#define PROFILE_SLOTS  4096 // stripes tracked, a power of two
+#define PROFILE_BITS   12
+#define PROFILE_PROBES 16   // linear probes, the eviction window
+#define PROFILE_ADDRS  4    // distinct addresses remembered per stripe
+
+// Causes are the conflict half of the STATS_ABORT_* codes.
+#define PROFILE_CAUSES 4
+
+struct ProfileHot{
+    size_t stripe;
+    uint64_t count;                    // sampled events, all causes, plus error
+    uint64_t error;                    // events inherited from evicted stripes
+    uint64_t by_cause[PROFILE_CAUSES]; // the stripe's own events
+    uint32_t n_addrs;                  // PROFILE_ADDRS + 1 means "more"
+    void* addrs[PROFILE_ADDRS];
+};
+
+extern std::atomic<uint32_t> profile_period;
+
+static inline int profile_active(){
+    return profile_period.load(std::memory_order_relaxed) != 0;
+}
+
+// Start and stop at quiescent points: start clears the table.
+int  profile_start(uint32_t sample_period);
+void profile_stop();
+
+// Called on the abort paths; a no-op unless the profiler is running.
+void profile_record(int cause, const std::atomic<uint64_t>* lock, void* addr);
+
+// Copies up to n of the hottest stripes into out, hottest first, and returns
+// how many were copied.
+int  profile_top(ProfileHot* out, int n);
+
+// Sampled events lost because another thread took over the slot they were
+// about to evict.
+uint64_t profile_dropped();
+
+// Writes the top n stripes as CSV, events scaled back up by the period.
+void profile_dump(FILE* f, int n);
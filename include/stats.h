@@ -0,0 +1,83 @@
+// stats.h
+// Author: Anurag Choubey
+
+#pragma once
+
+#include <cstdint>
+#include "arena.h"
+
+// Per-thread counters at STATS_OFFSET in each arena slice. Only the owning
+// thread writes them, with relaxed stores and no atomic RMW, so the cost is
+// a few plain increments on a line nobody else writes. Build with
+// -DTL2_STATS=0 to compile every update out.
+#ifndef TL2_STATS
+#define TL2_STATS 1
+#endif
+
+// Abort causes.
+//   STATS_ABORT_READ_LOCKED:     a read found its stripe locked
+//   STATS_ABORT_READ_VALIDATE:   a read found its stripe newer than rv
+//   STATS_ABORT_COMMIT_LOCKED:   the contention manager gave up on a held
+//                                stripe at commit
+//   STATS_ABORT_COMMIT_VALIDATE: commit-time read-set validation failed
+//   STATS_ABORT_OVERFLOW:        the read set, write set or spill area is full
+//   STATS_ABORT_USER:            tx_abort, or a write in a read-only tx
+#define STATS_ABORT_READ_LOCKED     0
+#define STATS_ABORT_READ_VALIDATE   1
+#define STATS_ABORT_COMMIT_LOCKED   2
+#define STATS_ABORT_COMMIT_VALIDATE 3
+#define STATS_ABORT_OVERFLOW        4
+#define STATS_ABORT_USER            5
+#define STATS_ABORT_CAUSES          6
+
+// Set sizes of committed transactions in log2 buckets: bucket 0 counts
+// empty sets, bucket b counts sizes in [2^(b-1), 2^b), the last bucket
+// everything above.
+#define STATS_HIST_BUCKETS 14
+
+struct TxStats{
+    uint64_t commits;
+    uint64_t readonly_commits;
+    uint64_t irrevocable_commits;
+    uint64_t nested_retries;    // closed nested levels rolled back and rerun
+    uint64_t extensions;        // reads that moved read_version instead of aborting
+    uint64_t mv_reads;          // read-only reads served from the version history
+    uint64_t aborts[STATS_ABORT_CAUSES];
+    uint64_t lock_spins;        // pause iterations on held stripes at commit
+    uint64_t ws_lookups;        // write-set lookups made by reads
+    uint64_t filter_false_pos;  // lookups that passed the filter but missed
+    uint64_t rs_hist[STATS_HIST_BUCKETS];
+    uint64_t ws_hist[STATS_HIST_BUCKETS];
+};
+
+static_assert(sizeof(TxStats) <= STATS_BYTES, "TxStats does not fit in its slice region");
+
+static inline TxStats* stats_slice(char* slice){
+    return (TxStats*)(slice + STATS_OFFSET);
+}
+
+static inline void stats_add(uint64_t* counter, uint64_t n){
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t stats_bucket(uint32_t n){
+    uint32_t b = n ? 32 - (uint32_t)__builtin_clz(n) : 0;
+    return b < STATS_HIST_BUCKETS ? b : STATS_HIST_BUCKETS - 1;
+}
+
+#if TL2_STATS
+#define TX_STAT(expr) (expr)
+#else
+// Unevaluated, but still type-checked and counted as a use of its operands.
+#define TX_STAT(expr) ((void)sizeof((expr), 0))
+#endif
+
+// Sums the counters of every slice handed out so far (arena_slot_slice over
+// all slots, since NUMA ranges leave gaps), including slices of threads that
+// have exited, while other threads keep running. Each counter
+// is read atomically but the set is not a snapshot. Returns the number of
+// slices read.
+int  stats_collect(TxStats* out);
+
+// Zeroes every slice's counters; meant for quiescent points between runs.
+void stats_reset();
@@ -0,0 +1,484 @@
+// tl2.h
+// Author: Anurag Choubey
+//
+// Typed front end over transaction.h:
+//
+//     tl2::TVar<int64_t> a(100), b(0);
+//     tl2::atomically([&](tl2::Tx& tx){
+//         tx.write(a, tx.read(a) - 10);
+//         tx.write(b, tx.read(b) + 10);
+//     });
+//
+// The body is rerun until it commits, so it must not have side effects
+// outside its TVars. Sizes are known at compile time, so 1/2/4/8/16-byte
+// values are copied with fixed-width loads and stores instead of memcpy.
+//
+// Called inside another transaction, atomically just runs the body as part
+// of it (flattened nesting); atomically_closed makes it a closed nested
+// transaction whose conflicts rerun only that body.
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "alloc.h"
+#include "transaction.h"
+#include "vlock.h"
+
+namespace tl2 {
+
+// Thrown out of Tx::read / Tx::write once the transaction has aborted;
+// atomically catches it and retries.
+struct TxAbort{};
+
+class Graveyard;
+
+namespace detail {
+
+template<typename T>
+constexpr size_t tvar_align(){
+    return (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8 || sizeof(T) == 16) &&
+           sizeof(T) > alignof(T) ? sizeof(T) : alignof(T);
+}
+
+// Copies N bytes from a location other threads may be writing. Word-sized
+// copies are single relaxed loads; the stripe version check decides whether
+// the value is usable.
+template<size_t N>
+inline void load_fixed(void* dst, const void* src){
+    if constexpr (N == 1){
+        uint8_t v = __atomic_load_n((const uint8_t*)src, __ATOMIC_RELAXED);
+        memcpy(dst, &v, 1);
+    } else if constexpr (N == 2){
+        uint16_t v = __atomic_load_n((const uint16_t*)src, __ATOMIC_RELAXED);
+        memcpy(dst, &v, 2);
+    } else if constexpr (N == 4){
+        uint32_t v = __atomic_load_n((const uint32_t*)src, __ATOMIC_RELAXED);
+        memcpy(dst, &v, 4);
+    } else if constexpr (N == 8){
+        uint64_t v = __atomic_load_n((const uint64_t*)src, __ATOMIC_RELAXED);
+        memcpy(dst, &v, 8);
+    } else if constexpr (N == 16){
+        uint64_t v[2];
+        v[0] = __atomic_load_n((const uint64_t*)src, __ATOMIC_RELAXED);
+        v[1] = __atomic_load_n((const uint64_t*)src + 1, __ATOMIC_RELAXED);
+        memcpy(dst, v, 16);
+    } else {
+        memcpy(dst, src, N);
+    }
+}
+
+struct Retired{
+    void* p;
+    void (*del)(void*);
+    Retired* next;
+};
+
+// Allocations and retirements of the running attempt. Fresh objects are
+// freed if the attempt aborts; retired ones go to their graveyard only if it
+// commits. `upgrade` asks the next attempt to run irrevocably.
+struct TxLog{
+    struct Fresh{ void* p; void (*del)(void*); };
+    struct Retire{ void* p; void (*del)(void*); Graveyard* to; };
+    std::vector<Fresh> fresh;
+    std::vector<Retire> retired;
+    int upgrade = 0;
+};
+
+inline TxLog& tx_log(){
+    static thread_local TxLog log;
+    return log;
+}
+
+template<typename N>
+void delete_as(void* p){ delete static_cast<N*>(p); }
+
+// The context of the attempt running on this thread when it is not the
+// thread's own (a borrowed one, see tl2_coro.h), so that atomically calls
+// inside it nest instead of starting a transaction of their own.
+inline TransactionContext*& tx_current(){
+    static thread_local TransactionContext* ctx = nullptr;
+    return ctx;
+}
+
+} // namespace detail
+
+// Objects unlinked by committed transactions. Concurrent transactions may
+// still be reading them, so they are only freed when the graveyard (usually
+// a member of the container that owned them) is destroyed. Trivially
+// destructible objects should rather use Tx::alloc / Tx::free, which
+// recycle memory as soon as no transaction can read it.
+class Graveyard{
+public:
+    Graveyard() : head_(nullptr) {}
+    Graveyard(const Graveyard&) = delete;
+    Graveyard& operator=(const Graveyard&) = delete;
+
+    ~Graveyard(){
+        detail::Retired* r = head_.load(std::memory_order_acquire);
+        while (r){
+            detail::Retired* next = r->next;
+            r->del(r->p);
+            delete r;
+            r = next;
+        }
+    }
+
+    void push(void* p, void (*del)(void*)){
+        detail::Retired* r = new detail::Retired{p, del, head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(r->next, r, std::memory_order_release,
+                                            std::memory_order_relaxed)) {}
+    }
+
+private:
+    std::atomic<detail::Retired*> head_;
+};
+
+// A transactional variable. Only read or write it through a Tx (or through
+// unsafe_get / unsafe_set while no transaction can touch it).
+template<typename T>
+class TVar{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "TVar<T> requires a trivially copyable T");
+    static_assert(sizeof(T) <= INLINE_CAP,
+                  "TVar<T> must fit in an inline write-set payload (INLINE_CAP)");
+
+public:
+    TVar() : value_() {}
+    explicit TVar(const T& v) : value_(v) {}
+
+    TVar(const TVar&) = delete;
+    TVar& operator=(const TVar&) = delete;
+
+    void* addr() const { return (void*)&value_; }
+
+    T unsafe_get() const { return value_; }
+    void unsafe_set(const T& v){ value_ = v; }
+
+private:
+    alignas(detail::tvar_align<T>()) T value_;
+};
+
+// Handle passed to the body of atomically.
+class Tx{
+public:
+    explicit Tx(TransactionContext* tx) : tx_(tx) {}
+
+    template<typename T>
+    T read(const TVar<T>& var){
+        TransactionContext* tx = tx_;
+        if (tx->status != ACTIVE) throw TxAbort{};
+
+        void* addr = var.addr();
+        T out;
+
+        // Irrevocable: memory is stable and already holds our writes.
+        if (tx->irrevocable){
+            detail::load_fixed<sizeof(T)>(&out, addr);
+            return out;
+        }
+
+        WriteEntry* e = nullptr;
+        if (!tx->read_only && tx->ws.count &&
+            writeset_lookup(&tx->ws, addr, &e) == 1){
+            if (e->op == WS_OP_WRITE){
+                memcpy(&out, e->buf, sizeof(T));
+                return out;
+            }
+            // A pending add / min / max / or: tx_read settles it.
+            if (tx_read(tx, addr, &out, sizeof(T)) != 0) throw TxAbort{};
+            return out;
+        }
+
+        std::atomic<uint64_t>* lock = vlock_ptr(addr);
+        int r;
+        do {
+            uint64_t pre = lock->load(std::memory_order_acquire);
+            detail::load_fixed<sizeof(T)>(&out, addr);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            r = tx_read_check(tx, addr, &out, sizeof(T), lock, pre);
+        } while (r == TX_READ_RETRY);
+        if (r != 0) throw TxAbort{};
+        return out;
+    }
+
+    template<typename T>
+    void write(TVar<T>& var, const T& value){
+        TransactionContext* tx = tx_;
+        if (tx->status != ACTIVE) throw TxAbort{};
+
+        // Payloads are 8-byte aligned, so the copy below is a plain store.
+        char* buf = tx->read_only || tx->irrevocable ? nullptr
+                  : writeset_reserve(&tx->ws, var.addr(), sizeof(T));
+        if (buf){
+            memcpy(buf, &value, sizeof(T));
+            return;
+        }
+
+        // Irrevocable writes go in place; otherwise let tx_write report the
+        // failure and set the abort state.
+        int rc = tx_write(tx, var.addr(), &value, sizeof(T));
+        if (rc == -2) throw std::logic_error("tl2: write inside a read-only transaction");
+        if (rc != 0) throw TxAbort{};
+    }
+
+    // Commutative updates of a 64-bit integer (tx_commute): they take no
+    // read-set entry, so concurrent transactions updating the same counter
+    // this way do not conflict. min / max compare as T.
+    template<typename T>
+    void add(TVar<T>& var, T delta){ commute(var, WS_OP_ADD, (uint64_t)delta); }
+
+    template<typename T>
+    void min(TVar<T>& var, T v){
+        commute(var, std::is_signed<T>::value ? WS_OP_IMIN : WS_OP_MIN, (uint64_t)v);
+    }
+
+    template<typename T>
+    void max(TVar<T>& var, T v){
+        commute(var, std::is_signed<T>::value ? WS_OP_IMAX : WS_OP_MAX, (uint64_t)v);
+    }
+
+    template<typename T>
+    void bit_or(TVar<T>& var, T bits){ commute(var, WS_OP_OR, (uint64_t)bits); }
+
+    // tx_malloc: memory from the thread's pool, returned if this attempt
+    // aborts. Throws std::bad_alloc if no memory can be mapped.
+    void* allocate(size_t bytes){
+        void* p = tx_malloc(tx_, bytes);
+        if (!p){
+            if (tx_->status != ACTIVE) throw TxAbort{};
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    // A trivially destructible N in allocate()d memory. Until the attempt
+    // commits nobody else can reach it, so it may be initialized directly.
+    template<typename N, typename... Args>
+    N* alloc(Args&&... args){
+        static_assert(std::is_trivially_destructible<N>::value,
+                      "Tx::alloc needs a trivially destructible type; use make");
+        static_assert(alignof(N) <= ALLOC_ALIGN, "Tx::alloc cannot align N");
+        return new (allocate(sizeof(N))) N(std::forward<Args>(args)...);
+    }
+
+    // tx_free: p (from allocate / alloc) is recycled once this transaction
+    // commits and no running transaction can still read it. The caller must
+    // have unlinked it in this transaction.
+    void free(void* p){
+        int rc = tx_free(tx_, p);
+        if (rc == -2) throw std::logic_error("tl2: free inside a read-only transaction");
+        if (rc != 0) throw TxAbort{};
+    }
+
+    // New object owned by the current attempt: freed if it aborts. Until
+    // the attempt commits nobody else can reach it, so it may be initialized
+    // directly (TVar::unsafe_set) instead of through write().
+    template<typename N, typename... Args>
+    N* make(Args&&... args){
+        N* n = new N(std::forward<Args>(args)...);
+        adopt(n, &detail::delete_as<N>);
+        return n;
+    }
+
+    // Same, for objects allocated by the caller.
+    void adopt(void* p, void (*del)(void*)){
+        detail::tx_log().fresh.push_back({p, del});
+    }
+
+    // Hands p to `to` once the transaction commits; the caller must have
+    // unlinked it in this transaction.
+    template<typename N>
+    void retire(N* p, Graveyard* to){
+        retire(p, &detail::delete_as<N>, to);
+    }
+
+    void retire(void* p, void (*del)(void*), Graveyard* to){
+        detail::tx_log().retired.push_back({p, del, to});
+    }
+
+    TransactionContext* context() const { return tx_; }
+
+private:
+    template<typename T>
+    void commute(TVar<T>& var, uint32_t op, uint64_t operand){
+        static_assert(std::is_integral<T>::value && sizeof(T) == 8,
+                      "commutative updates need a 64-bit integer TVar");
+        int rc = tx_commute(tx_, (uint64_t*)var.addr(), op, operand);
+        if (rc == -2) throw std::logic_error("tl2: write inside a read-only transaction");
+        if (rc != 0) throw TxAbort{};
+    }
+
+    TransactionContext* tx_;
+};
+
+namespace detail {
+
+inline void log_committed(TxLog& log){
+    log.fresh.clear();
+    for (const TxLog::Retire& r : log.retired) r.to->push(r.p, r.del);
+    log.retired.clear();
+}
+
+inline void log_aborted(TxLog& log){
+    for (const TxLog::Fresh& f : log.fresh) f.del(f.p);
+    log.fresh.clear();
+    log.retired.clear();
+}
+
+// Undoes a closed nested level's part of the log.
+inline void log_rollback(TxLog& log, size_t fresh, size_t retired){
+    for (size_t i = fresh; i < log.fresh.size(); i++) log.fresh[i].del(log.fresh[i].p);
+    log.fresh.resize(fresh);
+    log.retired.resize(retired);
+}
+
+#define TL2_RUN_NORMAL      0
+#define TL2_RUN_READONLY    1
+#define TL2_RUN_IRREVOCABLE 2
+#define TL2_RUN_CLOSED      3
+
+// Body of a closed nested level: a conflict inside it rolls back to its
+// checkpoint and reruns it (tx_retry_nested), and only when that fails does
+// TxAbort reach the outermost run. Other exceptions undo just this level.
+// Without a checkpoint (read-only or irrevocable outer transaction, or too
+// deep) it is flattened.
+template<typename F>
+auto run_closed(F& body, TransactionContext* ctx) -> decltype(body(std::declval<Tx&>())){
+    using R = decltype(body(std::declval<Tx&>()));
+
+    Tx tx(ctx);
+    if (ctx->read_only || ctx->irrevocable || ctx->nest_top == TX_NEST_MAX) return body(tx);
+
+    TxLog& log = tx_log();
+    size_t fresh = log.fresh.size(), retired = log.retired.size();
+
+    tx_begin_closed(ctx);
+    while (true){
+        try {
+            if constexpr (std::is_void<R>::value){
+                body(tx);
+                if (tx_commit(ctx)) return;
+            } else {
+                R result = body(tx);
+                if (tx_commit(ctx)) return result;
+            }
+        } catch (const TxAbort&){
+            if (log.upgrade) throw;
+        } catch (...){
+            log_rollback(log, fresh, retired);
+            tx_abort(ctx);
+            throw;
+        }
+        log_rollback(log, fresh, retired);
+        if (tx_retry_nested(ctx) != 0) throw TxAbort{};
+    }
+}
+
+// Inside a running transaction: the body joins it. An irrevocable body
+// cannot join a speculative transaction, so that one restarts irrevocably.
+template<typename F>
+auto run_nested(F& body, int mode, TransactionContext* ctx) -> decltype(body(std::declval<Tx&>())){
+    if (mode == TL2_RUN_CLOSED) return run_closed(body, ctx);
+
+    if (mode == TL2_RUN_IRREVOCABLE && !ctx->irrevocable){
+        tx_log().upgrade = 1;
+        throw TxAbort{};
+    }
+
+    Tx tx(ctx);
+    return body(tx);
+}
+
+template<typename F>
+auto run(F& body, int mode) -> decltype(body(std::declval<Tx&>())){
+    using R = decltype(body(std::declval<Tx&>()));
+
+    TransactionContext* ctx = tx_current();
+    if (!ctx) ctx = tx_thread_init();
+    if (!ctx) throw std::runtime_error("tl2: no arena slice for this thread");
+    if (ctx->status == ACTIVE) return run_nested(body, mode, ctx);
+
+    Tx tx(ctx);
+    TxLog& log = tx_log();
+    while (true){
+        if (log.upgrade){
+            log.upgrade = 0;
+            tx_begin_irrevocable(ctx);
+        } else if (mode == TL2_RUN_READONLY) tx_begin_readonly(ctx);
+        else if (mode == TL2_RUN_IRREVOCABLE) tx_begin_irrevocable(ctx);
+        else tx_begin(ctx);
+
+        try {
+            if constexpr (std::is_void<R>::value){
+                body(tx);
+                if (tx_commit(ctx)){
+                    log_committed(log);
+                    return;
+                }
+            } else {
+                R result = body(tx);
+                if (tx_commit(ctx)){
+                    log_committed(log);
+                    return result;
+                }
+            }
+        } catch (const TxAbort&){
+            // Conflict: tx_begin backs off through the contention manager.
+            // After an upgrade request the transaction is still active;
+            // abort it level by level.
+            while (ctx->status == ACTIVE) tx_abort(ctx);
+        } catch (...){
+            // An irrevocable run's writes stay, so its allocations may be
+            // reachable: keep them as if it had committed.
+            int kept = ctx->irrevocable;
+            tx_abort(ctx);
+            if (kept) log_committed(log);
+            else log_aborted(log);
+            throw;
+        }
+        log_aborted(log);
+    }
+}
+
+} // namespace detail
+
+// Runs body(Tx&) as a transaction, retrying until it commits, and returns
+// whatever the committed run returned. Exceptions other than TxAbort abort
+// the transaction and propagate. After tx_irrevocable_after() consecutive
+// conflicts the body is run once more irrevocably; an exception thrown then
+// cannot undo the writes already made.
+template<typename F>
+auto atomically(F&& body) -> decltype(body(std::declval<Tx&>())){
+    return detail::run(body, TL2_RUN_NORMAL);
+}
+
+// Same, as a tx_begin_readonly transaction; writes throw std::logic_error.
+template<typename F>
+auto atomically_readonly(F&& body) -> decltype(body(std::declval<Tx&>())){
+    return detail::run(body, TL2_RUN_READONLY);
+}
+
+// Runs body exactly once, irrevocably (tx_begin_irrevocable): for bodies
+// with side effects such as I/O. Serializes against all writers. Nested in
+// a speculative transaction, it restarts that transaction irrevocably.
+template<typename F>
+auto atomically_irrevocable(F&& body) -> decltype(body(std::declval<Tx&>())){
+    return detail::run(body, TL2_RUN_IRREVOCABLE);
+}
+
+// Same as atomically, but nested inside another transaction it is a closed
+// nested transaction: a conflict inside it rolls back and reruns only this
+// body, as long as what the enclosing transaction read is still current.
+// An exception escaping it undoes only its own writes.
+template<typename F>
+auto atomically_closed(F&& body) -> decltype(body(std::declval<Tx&>())){
+    return detail::run(body, TL2_RUN_CLOSED);
+}
+
+} // namespace tl2
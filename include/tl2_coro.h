@@ -0,0 +1,204 @@
+// tl2_coro.h
+// Author: Anurag Choubey
+//
+// Transactions for C++20 coroutines:
+//
+//     Task transfer(Executor& ex){
+//         int64_t left = co_await tl2::atomically(ex, [&](tl2::Tx& tx){
+//             tx.write(b, tx.read(b) + 10);
+//             tx.write(a, tx.read(a) - 10);
+//             return tx.read(a);
+//         });
+//     }
+//
+// Each attempt runs the body to completion on the current thread, with a
+// context borrowed for that attempt only (tx_context_borrow), so neither a
+// suspended coroutine nor a worker thread keeps an arena slice. The first
+// attempt runs without suspending. When an attempt aborts, or no slice is
+// free, the coroutine suspends and the executor runs the next attempt after
+// a randomized exponential backoff; the worker runs other tasks meanwhile
+// instead of spinning on a stripe or in the contention manager. The
+// coroutine resumes on whichever thread runs the attempt that commits.
+//
+// The executor only needs
+//
+//     void defer(uint64_t delay_ns, void (*fn)(void*), void* arg);
+//
+// calling fn(arg) on one of its threads no sooner than delay_ns from now.
+//
+// Bodies follow the rules of tl2.h atomically (atomically calls inside them
+// nest) and cannot co_await. After tx_irrevocable_after() conflicts the next
+// attempt runs irrevocably; waiting for the irrevocable token does block
+// the thread.
+
+#pragma once
+
+#if __cplusplus < 202002L
+#error "tl2_coro.h needs C++20"
+#endif
+
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "tl2.h"
+
+// Backoff after the n-th conflict of a transaction: a random delay below
+// TL2_CORO_BACKOFF_NS << min(n, TL2_CORO_BACKOFF_MAX).
+#ifndef TL2_CORO_BACKOFF_NS
+#define TL2_CORO_BACKOFF_NS 1000
+#endif
+#define TL2_CORO_BACKOFF_MAX 10
+
+namespace tl2 {
+
+template<typename E>
+concept TxExecutor = requires(E& e, uint64_t delay_ns, void (*fn)(void*), void* arg){
+    e.defer(delay_ns, fn, arg);
+};
+
+// The awaitable returned by atomically(exec, body). It holds the body and
+// the retry state, and lives in the awaiting coroutine's frame while that is
+// suspended.
+template<typename E, typename F, int Mode>
+class TxAwaiter{
+    using R = decltype(std::declval<F&>()(std::declval<Tx&>()));
+    struct Unit{};
+    using Stored = std::conditional_t<std::is_void_v<R>, Unit, R>;
+
+public:
+    TxAwaiter(E& exec, F body)
+        : exec_(exec), body_(std::move(body)), seed_((uint64_t)(uintptr_t)this | 1) {}
+
+    bool await_ready(){ return attempt(); }
+
+    void await_suspend(std::coroutine_handle<> h){
+        handle_ = h;
+        exec_.defer(backoff(), &TxAwaiter::retry, this);
+    }
+
+    R await_resume(){
+        if (error_) std::rethrow_exception(error_);
+        if constexpr (!std::is_void_v<R>) return std::move(*result_);
+    }
+
+    // Attempts made and attempts that did not commit (conflicts, and tries
+    // that found no free slice).
+    uint32_t attempts() const { return attempts_; }
+    uint32_t conflicts() const { return conflicts_; }
+
+private:
+    // Runs on the executor. The awaiter may be gone once the coroutine has
+    // resumed, so nothing touches it after that.
+    static void retry(void* arg){
+        TxAwaiter* self = static_cast<TxAwaiter*>(arg);
+        try {
+            if (!self->attempt()){
+                self->exec_.defer(self->backoff(), &TxAwaiter::retry, self);
+                return;
+            }
+        } catch (...){
+            self->error_ = std::current_exception();
+        }
+        self->handle_.resume();
+    }
+
+    uint64_t backoff(){
+        uint64_t x = seed_;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        seed_ = x;
+        uint32_t exp = conflicts_ < TL2_CORO_BACKOFF_MAX ? conflicts_ : TL2_CORO_BACKOFF_MAX;
+        return x % ((uint64_t)TL2_CORO_BACKOFF_NS << exp);
+    }
+
+    // One attempt on a borrowed context, like one round of detail::run:
+    // returns 1 once committed (with the result stored), 0 to retry later.
+    // Exceptions other than TxAbort abort the attempt and propagate.
+    int attempt(){
+        attempts_++;
+        TransactionContext* ctx = tx_context_borrow();
+        if (!ctx){
+            conflicts_++;
+            return 0;
+        }
+
+        detail::TxLog& log = detail::tx_log();
+        TransactionContext* outer = detail::tx_current();
+        detail::tx_current() = ctx;
+
+        uint32_t after = tx_irrevocable_after();
+        if (upgrade_ || (after && conflicts_ >= after))
+            tx_begin_irrevocable(ctx);
+        else if (Mode == TL2_RUN_READONLY) tx_begin_readonly(ctx);
+        else tx_begin(ctx);
+
+        Tx tx(ctx);
+        int committed = 0;
+        try {
+            if constexpr (std::is_void_v<R>){
+                body_(tx);
+                committed = tx_commit(ctx);
+            } else {
+                Stored result = body_(tx);
+                if (tx_commit(ctx)){
+                    result_.emplace(std::move(result));
+                    committed = 1;
+                }
+            }
+        } catch (const TxAbort&){
+            // An irrevocable body nested in this speculative attempt: the
+            // request is per transaction, not per thread.
+            upgrade_ = log.upgrade;
+            log.upgrade = 0;
+        } catch (...){
+            int kept = ctx->irrevocable;
+            tx_abort(ctx);
+            if (kept) detail::log_committed(log);
+            else detail::log_aborted(log);
+            detail::tx_current() = outer;
+            tx_context_return(ctx);
+            throw;
+        }
+
+        if (committed){
+            detail::log_committed(log);
+            upgrade_ = 0;
+        } else {
+            detail::log_aborted(log);
+            conflicts_++;
+        }
+        detail::tx_current() = outer;
+        tx_context_return(ctx);
+        return committed;
+    }
+
+    E& exec_;
+    F body_;
+    uint64_t seed_;
+    uint32_t attempts_ = 0;
+    uint32_t conflicts_ = 0;
+    int upgrade_ = 0;
+    std::coroutine_handle<> handle_;
+    std::optional<Stored> result_;
+    std::exception_ptr error_;
+};
+
+// co_await atomically(exec, body) runs body(Tx&) as a transaction and
+// yields whatever the committed attempt returned; see the top of this file.
+template<TxExecutor E, typename F>
+TxAwaiter<E, std::decay_t<F>, TL2_RUN_NORMAL> atomically(E& exec, F&& body){
+    return {exec, std::forward<F>(body)};
+}
+
+// Same, as read-only transactions; writes throw std::logic_error.
+template<TxExecutor E, typename F>
+TxAwaiter<E, std::decay_t<F>, TL2_RUN_READONLY> atomically_readonly(E& exec, F&& body){
+    return {exec, std::forward<F>(body)};
+}
+
+} // namespace tl2
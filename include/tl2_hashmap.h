@@ -0,0 +1,233 @@
+// tl2_hashmap.h
+// Author: Anurag Choubey
+//
+// Transactional chained hash map. Every operation takes the caller's Tx, so
+// it composes with other TVar accesses and containers in one transaction;
+// the overloads without a Tx run their own.
+//
+// The table doubles when an insert walks a chain of MAP_MAX_CHAIN nodes.
+// Growing is incremental: the new table is published at once, and each later
+// put/remove moves MAP_MIGRATE_BATCH more buckets of the old table into it,
+// so no single transaction has to touch the whole map. Until a bucket has
+// been moved, lookups for it still go to the old table.
+//
+// Nodes and tables come from tx_malloc, so the map must be created and
+// destroyed between tx_init and tx_shutdown.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include "tl2.h"
+
+#define MAP_MAX_CHAIN     8
+#define MAP_MIGRATE_BATCH 8
+#define MAP_MAX_BUCKETS   ((size_t)1 << 26)
+
+namespace tl2 {
+
+template<typename K, typename V, typename Hash = std::hash<K>>
+class HashMap{
+    static_assert(std::is_trivially_copyable<K>::value,
+                  "HashMap keys must be trivially copyable");
+
+    struct Node{
+        K key;
+        TVar<V> value;
+        TVar<Node*> next;
+    };
+
+    struct Table{
+        size_t mask;
+        TVar<Node*> buckets[1]; // really mask + 1
+    };
+
+public:
+    // `buckets` is rounded up to a power of two.
+    explicit HashMap(size_t buckets = 64){
+        size_t n = 1;
+        while (n < buckets && n < MAP_MAX_BUCKETS) n <<= 1;
+        cur_.unsafe_set(init_table(tx_malloc_private(table_bytes(n)), n));
+    }
+
+    HashMap(const HashMap&) = delete;
+    HashMap& operator=(const HashMap&) = delete;
+
+    // Not thread-safe: no transaction may be using the map.
+    ~HashMap(){
+        Table* old = old_.unsafe_get();
+        if (old){
+            for (size_t i = moved_.unsafe_get(); i <= old->mask; i++)
+                free_chain(old->buckets[i].unsafe_get());
+            tx_free_private(old);
+        }
+        Table* t = cur_.unsafe_get();
+        for (size_t i = 0; i <= t->mask; i++)
+            free_chain(t->buckets[i].unsafe_get());
+        tx_free_private(t);
+    }
+
+    bool get(Tx& tx, const K& key, V* out){
+        Node* n = tx.read(*find(tx, key, nullptr));
+        if (!n) return false;
+        if (out) *out = tx.read(n->value);
+        return true;
+    }
+
+    bool contains(Tx& tx, const K& key){
+        return get(tx, key, nullptr);
+    }
+
+    // Inserts or overwrites; returns true if the key was new.
+    bool put(Tx& tx, const K& key, const V& value){
+        migrate(tx);
+
+        size_t chain = 0;
+        TVar<Node*>* link = find(tx, key, &chain);
+        Node* n = tx.read(*link);
+        if (n){
+            tx.write(n->value, value);
+            return false;
+        }
+
+        n = tx.alloc<Node>();
+        n->key = key;
+        n->value.unsafe_set(value);
+        tx.write(*link, n);
+
+        if (chain >= MAP_MAX_CHAIN) grow(tx);
+        return true;
+    }
+
+    bool remove(Tx& tx, const K& key, V* out = nullptr){
+        migrate(tx);
+
+        TVar<Node*>* link = find(tx, key, nullptr);
+        Node* n = tx.read(*link);
+        if (!n) return false;
+
+        if (out) *out = tx.read(n->value);
+        tx.write(*link, tx.read(n->next));
+        tx.free(n);
+        return true;
+    }
+
+    // Current bucket count of the (newest) table.
+    size_t buckets(Tx& tx){
+        return tx.read(cur_)->mask + 1;
+    }
+
+    bool get(const K& key, V* out){
+        return atomically_readonly([&](Tx& tx){ return get(tx, key, out); });
+    }
+
+    bool contains(const K& key){
+        return atomically_readonly([&](Tx& tx){ return contains(tx, key); });
+    }
+
+    bool put(const K& key, const V& value){
+        return atomically([&](Tx& tx){ return put(tx, key, value); });
+    }
+
+    bool remove(const K& key, V* out = nullptr){
+        return atomically([&](Tx& tx){ return remove(tx, key, out); });
+    }
+
+private:
+    static uint64_t hash(const K& key){
+        uint64_t h = (uint64_t)Hash{}(key) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+    }
+
+    static void free_chain(Node* n){
+        while (n){
+            Node* next = n->next.unsafe_get();
+            tx_free_private(n);
+            n = next;
+        }
+    }
+
+    static size_t table_bytes(size_t n){
+        return sizeof(Table) + (n - 1) * sizeof(TVar<Node*>);
+    }
+
+    static Table* init_table(void* mem, size_t n){
+        if (!mem) throw std::bad_alloc();
+        Table* t = new (mem) Table();
+        for (size_t i = 1; i < n; i++)
+            new (&t->buckets[i]) TVar<Node*>();
+        t->mask = n - 1;
+        return t;
+    }
+
+    TVar<Node*>* bucket(Tx& tx, uint64_t h){
+        Table* old = tx.read(old_);
+        if (old){
+            size_t i = h & old->mask;
+            if (i >= tx.read(moved_)) return &old->buckets[i];
+        }
+        Table* t = tx.read(cur_);
+        return &t->buckets[h & t->mask];
+    }
+
+    // The link holding key's node, or the null link ending its chain.
+    TVar<Node*>* find(Tx& tx, const K& key, size_t* chain){
+        TVar<Node*>* link = bucket(tx, hash(key));
+        size_t len = 0;
+        for (Node* n = tx.read(*link); n && !(n->key == key); n = tx.read(*link)){
+            link = &n->next;
+            len++;
+        }
+        if (chain) *chain = len;
+        return link;
+    }
+
+    void grow(Tx& tx){
+        if (tx.read(old_)) return;
+
+        Table* t = tx.read(cur_);
+        size_t n = (t->mask + 1) * 2;
+        if (n > MAP_MAX_BUCKETS) return;
+
+        tx.write(old_, t);
+        tx.write(cur_, init_table(tx.allocate(table_bytes(n)), n));
+        tx.write(moved_, (size_t)0);
+    }
+
+    // Moves the next MAP_MIGRATE_BATCH buckets of the old table, relinking
+    // their nodes at the head of their new buckets.
+    void migrate(Tx& tx){
+        Table* old = tx.read(old_);
+        if (!old) return;
+
+        Table* t = tx.read(cur_);
+        size_t from = tx.read(moved_);
+        size_t to = from + MAP_MIGRATE_BATCH;
+        if (to > old->mask + 1) to = old->mask + 1;
+
+        for (size_t i = from; i < to; i++){
+            Node* n = tx.read(old->buckets[i]);
+            while (n){
+                Node* next = tx.read(n->next);
+                TVar<Node*>* head = &t->buckets[hash(n->key) & t->mask];
+                tx.write(n->next, tx.read(*head));
+                tx.write(*head, n);
+                n = next;
+            }
+        }
+
+        tx.write(moved_, to);
+        if (to == old->mask + 1){
+            tx.write(old_, (Table*)nullptr);
+            tx.free(old);
+        }
+    }
+
+    TVar<Table*> cur_;
+    TVar<Table*> old_;
+    TVar<size_t> moved_;
+};
+
+} // namespace tl2
@@ -0,0 +1,27 @@
+// tl2_inline.h
+// Author: Anurag Choubey
+
+#pragma once
+
+// The per-access helpers (vlock_ptr and friends, gvc_read, writeset_lookup,
+// readset_add) are declared TL2_HOT and defined once, in their headers.
+// tl2_core compiles them out of line in the module's own translation unit
+// (which defines TL2_<MODULE>_IMPL before including the header) and always
+// checks their arguments. With TL2_INLINE=1, set by the tl2_core_inline
+// target for itself and everything linking it, they are static inline in
+// every caller and TL2_ARG_CHECK only runs in builds without NDEBUG.
+#ifndef TL2_INLINE
+#define TL2_INLINE 0
+#endif
+
+#if TL2_INLINE
+#define TL2_HOT static inline
+#else
+#define TL2_HOT
+#endif
+
+#if TL2_INLINE && defined(NDEBUG)
+#define TL2_ARG_CHECK(cond, ret) ((void)0)
+#else
+#define TL2_ARG_CHECK(cond, ret) do { if (!(cond)) return (ret); } while (0)
+#endif
@@ -0,0 +1,85 @@
+// tl2_queue.h
+// Author: Anurag Choubey
+//
+// Transactional unbounded FIFO queue: a singly linked list with head and
+// tail TVars. Pushes touch the tail, pops the head, so they only conflict
+// with each other while the queue holds at most one element. Operations
+// take the caller's Tx and compose like the other tl2 containers. Nodes come
+// from tx_malloc, so the queue must be destroyed before tx_shutdown.
+
+#pragma once
+
+#include <type_traits>
+#include "tl2.h"
+
+namespace tl2 {
+
+template<typename T>
+class Queue{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Queue elements must be trivially copyable");
+
+    // `value` is written before the node is published and never changed,
+    // so it is read directly.
+    struct Node{
+        T value;
+        TVar<Node*> next;
+    };
+
+public:
+    Queue() {}
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    // Not thread-safe: no transaction may be using the queue.
+    ~Queue(){
+        Node* n = head_.unsafe_get();
+        while (n){
+            Node* next = n->next.unsafe_get();
+            tx_free_private(n);
+            n = next;
+        }
+    }
+
+    void push(Tx& tx, const T& value){
+        Node* n = tx.alloc<Node>();
+        n->value = value;
+
+        Node* tail = tx.read(tail_);
+        if (tail) tx.write(tail->next, n);
+        else tx.write(head_, n);
+        tx.write(tail_, n);
+    }
+
+    bool pop(Tx& tx, T* out){
+        Node* n = tx.read(head_);
+        if (!n) return false;
+
+        Node* next = tx.read(n->next);
+        tx.write(head_, next);
+        if (!next) tx.write(tail_, (Node*)nullptr);
+
+        if (out) *out = n->value;
+        tx.free(n);
+        return true;
+    }
+
+    bool empty(Tx& tx){
+        return tx.read(head_) == nullptr;
+    }
+
+    void push(const T& value){
+        atomically([&](Tx& tx){ push(tx, value); });
+    }
+
+    bool pop(T* out){
+        return atomically([&](Tx& tx){ return pop(tx, out); });
+    }
+
+private:
+    TVar<Node*> head_;
+    TVar<Node*> tail_;
+};
+
+} // namespace tl2
@@ -0,0 +1,162 @@
+// tl2_skiplist.h
+// Author: Anurag Choubey
+//
+// Transactional ordered map as a skip list. Operations take the caller's Tx
+// and compose like the other tl2 containers; the overloads without a Tx run
+// their own. Node heights are geometric with p = 1/4, capped at
+// SKIP_MAX_LEVEL, and each node is allocated with exactly its height's
+// worth of links. Nodes come from tx_malloc, so the list must be created
+// and destroyed between tx_init and tx_shutdown.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include "tl2.h"
+
+#define SKIP_MAX_LEVEL 16
+
+namespace tl2 {
+
+template<typename K, typename V>
+class SkipList{
+    static_assert(std::is_trivially_copyable<K>::value,
+                  "SkipList keys must be trivially copyable");
+
+    struct Node{
+        K key;
+        TVar<V> value;
+        int height;
+        TVar<Node*> next[1]; // really `height` links
+    };
+
+public:
+    SkipList() : head_(init(tx_malloc_private(bytes(SKIP_MAX_LEVEL)), K(), SKIP_MAX_LEVEL)) {}
+
+    SkipList(const SkipList&) = delete;
+    SkipList& operator=(const SkipList&) = delete;
+
+    // Not thread-safe: no transaction may be using the list.
+    ~SkipList(){
+        Node* n = head_;
+        while (n){
+            Node* next = n->next[0].unsafe_get();
+            tx_free_private(n);
+            n = next;
+        }
+    }
+
+    bool get(Tx& tx, const K& key, V* out){
+        Node* n = tx.read(seek(tx, key, nullptr)->next[0]);
+        if (!n || !(n->key == key)) return false;
+        if (out) *out = tx.read(n->value);
+        return true;
+    }
+
+    bool contains(Tx& tx, const K& key){
+        return get(tx, key, nullptr);
+    }
+
+    // Smallest key >= key.
+    bool ceiling(Tx& tx, const K& key, K* out_key, V* out_value){
+        Node* n = tx.read(seek(tx, key, nullptr)->next[0]);
+        if (!n) return false;
+        if (out_key) *out_key = n->key;
+        if (out_value) *out_value = tx.read(n->value);
+        return true;
+    }
+
+    // Inserts or overwrites; returns true if the key was new.
+    bool put(Tx& tx, const K& key, const V& value){
+        Node* preds[SKIP_MAX_LEVEL];
+        Node* n = tx.read(seek(tx, key, preds)->next[0]);
+        if (n && n->key == key){
+            tx.write(n->value, value);
+            return false;
+        }
+
+        int h = random_height();
+        n = init(tx.allocate(bytes(h)), key, h);
+        n->value.unsafe_set(value);
+        for (int i = 0; i < h; i++){
+            n->next[i].unsafe_set(tx.read(preds[i]->next[i]));
+            tx.write(preds[i]->next[i], n);
+        }
+        return true;
+    }
+
+    bool remove(Tx& tx, const K& key, V* out = nullptr){
+        Node* preds[SKIP_MAX_LEVEL];
+        Node* n = tx.read(seek(tx, key, preds)->next[0]);
+        if (!n || !(n->key == key)) return false;
+
+        if (out) *out = tx.read(n->value);
+        for (int i = 0; i < n->height; i++)
+            tx.write(preds[i]->next[i], tx.read(n->next[i]));
+        tx.free(n);
+        return true;
+    }
+
+    bool get(const K& key, V* out){
+        return atomically_readonly([&](Tx& tx){ return get(tx, key, out); });
+    }
+
+    bool contains(const K& key){
+        return atomically_readonly([&](Tx& tx){ return contains(tx, key); });
+    }
+
+    bool put(const K& key, const V& value){
+        return atomically([&](Tx& tx){ return put(tx, key, value); });
+    }
+
+    bool remove(const K& key, V* out = nullptr){
+        return atomically([&](Tx& tx){ return remove(tx, key, out); });
+    }
+
+private:
+    static size_t bytes(int height){
+        return sizeof(Node) + (size_t)(height - 1) * sizeof(TVar<Node*>);
+    }
+
+    static Node* init(void* mem, const K& key, int height){
+        if (!mem) throw std::bad_alloc();
+        Node* n = new (mem) Node();
+        for (int i = 1; i < height; i++)
+            new (&n->next[i]) TVar<Node*>();
+        n->key = key;
+        n->height = height;
+        return n;
+    }
+
+    static int random_height(){
+        static thread_local uint64_t seed = 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)&seed;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+
+        int h = 1;
+        uint64_t bits = seed;
+        while (h < SKIP_MAX_LEVEL && (bits & 3) == 0){
+            h++;
+            bits >>= 2;
+        }
+        return h;
+    }
+
+    // Last node before key on the bottom level; with preds, also the last
+    // node before key on every level.
+    Node* seek(Tx& tx, const K& key, Node** preds){
+        Node* x = head_;
+        for (int i = SKIP_MAX_LEVEL - 1; i >= 0; i--){
+            for (Node* n = tx.read(x->next[i]); n && n->key < key; n = tx.read(x->next[i]))
+                x = n;
+            if (preds) preds[i] = x;
+        }
+        return x;
+    }
+
+    Node* head_;
+};
+
+} // namespace tl2
@@ -1,16 +1,211 @@
 // transaction.h
+// Author: Anurag Choubey
 
-#include <unordered_set>
-#include <unordered_map>
+#pragma once
 
-typedef enum 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "cm.h"
+#include "tset.h"
+
+typedef enum
 {
     ACTIVE,
     ABORTED,
     COMMITTED
 } Status;
 
+// Consecutive aborts after which tx_begin restarts a transaction in
+// irrevocable mode; 0 disables the fallback.
+#ifndef TL2_IRREVOCABLE_AFTER
+#define TL2_IRREVOCABLE_AFTER 32
+#endif
+
+// Closed nested levels that get a checkpoint; deeper ones are flattened.
+#define TX_NEST_MAX 8
+
+// Rollbacks of one closed nested level before the whole transaction
+// restarts instead.
+#ifndef TL2_NEST_RETRIES
+#define TL2_NEST_RETRIES 8
+#endif
+
+// Log sizes at the start of a closed nested level, to truncate back to.
+struct TxCheckpoint{
+    uint16_t ws_count;
+    uint16_t rs_count;
+    uint16_t fresh_count;
+    uint16_t freed_count;
+    uint16_t depth;
+    uint16_t retries;
+};
+
+// Lives at TX_CTX_OFFSET inside the owning thread's arena slice.
+// `committing` is set while a speculative commit may write memory; an
+// irrevocable transaction waits for every slice's flag to clear.
 struct TransactionContext{
     uint64_t read_version;
     Status status;
-}
\ No newline at end of file
+    int read_only;
+    int retry;
+    int irrevocable;
+    int borrowed;        // from tx_context_borrow
+    std::atomic<uint32_t> committing;
+    char* slice;
+    CMState cm;
+    WriteSet ws;
+    ReadSet rs;
+    uint16_t depth;      // open nested levels
+    uint16_t nest_top;
+    TxCheckpoint nest[TX_NEST_MAX];
+};
+
+// Process-wide setup: resets the clock and lock table and maps the arena
+// with room for MAX_THREADS (or max_threads) concurrently bound threads.
+int  tx_init(int try_huge_pages);
+int  tx_init_threads(int try_huge_pages, uint32_t max_threads);
+void tx_shutdown();
+
+// Binds the calling thread to an arena slice (once) and returns its context.
+// The slice is returned to the arena by tx_thread_exit, which also runs
+// automatically when the thread exits.
+TransactionContext* tx_thread_init();
+void tx_thread_exit();
+
+// A context of its own for code that moves between threads, such as a
+// coroutine (see tl2_coro.h): tx_context_borrow takes a free slice and
+// returns a context in it, or nullptr if every slice is in use;
+// tx_context_return aborts whatever is still active in it and gives the
+// slice back, returning 0 (or -1 for a context that was not borrowed).
+// Borrow per attempt, so that many tasks share a few slices. A borrowed
+// context is used by one thread at a time and never waits by itself: a
+// commit that finds a stripe still held after a bounded spin aborts, and
+// tx_begin after a conflict does not back off. Irrevocable mode still
+// waits for the token.
+TransactionContext* tx_context_borrow();
+int  tx_context_return(TransactionContext* tx);
+
+// tx_read / tx_write return 0 on success and -1 once the transaction has
+// aborted; the caller must then restart from tx_begin.
+// tx_commit returns 1 if committed, 0 if aborted. Calling tx_begin after a
+// conflict abort is a retry and goes through the contention manager first;
+// tx_abort is a voluntary abort and is not.
+// tx_begin_readonly starts a transaction that logs nothing: each read is
+// checked against read_version inline and commit is free; with the version
+// history enabled (mv_enable), a stripe newer than read_version is read from
+// the history when it can be. tx_write inside it returns -2 and aborts;
+// restart it with tx_begin.
+// A location must always be accessed through the same address and size;
+// it is protected by the stripe of that address.
+int  tx_begin(TransactionContext* tx);
+int  tx_begin_readonly(TransactionContext* tx);
+int  tx_read(TransactionContext* tx, void* addr, void* dst, size_t size);
+int  tx_write(TransactionContext* tx, void* addr, const void* src, size_t size);
+int  tx_commit(TransactionContext* tx);
+void tx_abort(TransactionContext* tx);
+
+// Commutative updates of an aligned 64-bit word (hot counters, statistics,
+// flags): tx_add adds delta (wrapping, so it serves int64_t too), tx_min /
+// tx_max keep the smaller / larger value, tx_or sets bits; tx_commute takes
+// any WS_OP_* operation other than WS_OP_WRITE (WS_OP_IMIN / WS_OP_IMAX
+// compare as int64_t). The operation goes into the write set as an operand
+// and takes no read-set entry, so transactions that only update the same
+// word this way do not conflict: each applies its operand to the value the
+// word has at its commit, under the stripe lock. Repeated operations of one
+// kind on a word merge in the log. Reading the word in the same transaction
+// settles it: the read is logged as usual and the entry becomes a plain
+// write of the value seen, as does mixing it with tx_write or with another
+// kind of operation. Return values are those of tx_write, and -1 for a bad
+// op or a misaligned addr.
+int  tx_commute(TransactionContext* tx, uint64_t* addr, uint32_t op, uint64_t operand);
+int  tx_add(TransactionContext* tx, uint64_t* addr, uint64_t delta);
+int  tx_min(TransactionContext* tx, uint64_t* addr, uint64_t v);
+int  tx_max(TransactionContext* tx, uint64_t* addr, uint64_t v);
+int  tx_or(TransactionContext* tx, uint64_t* addr, uint64_t bits);
+
+// Irrevocable mode bounds the latency of transactions that keep losing, and
+// runs transactions that must not be re-executed (I/O). The transaction
+// takes a global token, waits for in-flight speculative commits to finish
+// and holds off new ones until it ends. It then runs without validation:
+// reads come straight from memory, and each write locks its stripe and
+// stores in place. Commit releases those stripes with a fresh version.
+// Read-only transactions keep running and committing meanwhile.
+//
+// It cannot abort: tx_read / tx_write / tx_commit always succeed (tx_write
+// fails only if it has no room to remember another stripe), and tx_abort
+// ends it without undoing its writes. tx_begin switches to it after
+// tx_irrevocable_after() consecutive conflict aborts; tx_begin_irrevocable
+// starts one directly.
+int      tx_begin_irrevocable(TransactionContext* tx);
+void     tx_set_irrevocable_after(uint32_t aborts);
+uint32_t tx_irrevocable_after();
+
+// Snapshot extension (LSA): a read that finds its stripe newer than
+// read_version re-samples the clock and, if every stripe read so far is
+// still at or below the old snapshot, moves read_version forward and goes on
+// instead of aborting. Only update transactions can extend; read-only ones
+// log no reads to revalidate. On by default.
+void tx_set_snapshot_extension(int enabled);
+int  tx_snapshot_extension();
+
+// Memory for objects shared through transactions (pools in alloc.h; no
+// global allocator on these paths). tx_malloc returns an ALLOC_ALIGN-aligned
+// block that goes back to the pool if the transaction aborts, or nullptr
+// after aborting (allocation log full, or no memory). tx_free hands p back
+// once the transaction commits and no running transaction can still be
+// reading it; like tx_write it returns 0, -1 after aborting, or -2 (and
+// aborts) in a read-only transaction. In an irrevocable transaction both
+// are final at once.
+void* tx_malloc(TransactionContext* tx, size_t size);
+int   tx_free(TransactionContext* tx, void* p);
+
+// The same memory outside transactions, for building or tearing down data
+// that no transaction can reach; tx_free_private frees at once. Only
+// between tx_init and tx_shutdown, which unmaps every pool.
+void* tx_malloc_private(size_t size);
+void  tx_free_private(void* p);
+
+// Nesting. tx_begin (or tx_begin_readonly) on a transaction that is already
+// active opens a flattened nested level: it only counts depth, and the
+// matching tx_commit closes it and returns 1; the work commits with the
+// outermost transaction. Any abort aborts the whole transaction, so code
+// at a nested level must not retry by itself: on failure it returns to the
+// outermost level, which restarts from tx_begin.
+//
+// tx_begin_closed opens a closed nested level instead (outside a
+// transaction it is tx_begin). It checkpoints the write set, read set and
+// allocation logs. After a conflict inside it, tx_retry_nested rolls back
+// to the checkpoint, extends read_version if everything read before the
+// checkpoint is still unchanged, and returns 0: rerun the level's body
+// without calling tx_begin_closed again. It returns -1 if the whole
+// transaction has to restart instead (older reads changed, or
+// TL2_NEST_RETRIES rollbacks of this level were spent). tx_abort inside a
+// closed level undoes only that level and closes it. Read-only and
+// irrevocable transactions, and levels past TX_NEST_MAX, nest flattened.
+// tx_begin_irrevocable nests only inside an irrevocable transaction and
+// returns -1 inside a speculative one.
+int  tx_begin_closed(TransactionContext* tx);
+int  tx_retry_nested(TransactionContext* tx);
+
+// Multi-word compare-and-swap without a transaction, for tiny static
+// updates: if *addrs[i] == expected[i] for every i, stores desired[i] into
+// each and returns 1; otherwise changes nothing and returns 0. Returns -1
+// for n == 0, n > KCAS_MAX or inside a running transaction. It locks the
+// stripes of all words in sorted order, like a commit, and publishes them
+// under one write version, so it is atomic with respect to transactions on
+// the same words. It waits while an irrevocable transaction runs.
+#define KCAS_MAX 16
+int  tl2_kcas(size_t n, uint64_t* const addrs[], const uint64_t expected[],
+              const uint64_t desired[]);
+
+// Second half of a read for callers that copy the data themselves (the
+// tl2.h templates): sample `pre` from addr's stripe with acquire ordering,
+// copy size bytes to dst, issue an acquire fence, then call this. Returns 0
+// (dst may have been replaced from the version history, see mvcc.h), -1
+// after aborting, or TX_READ_RETRY when the snapshot was extended to cover
+// the stripe: the copy may predate a commit at that same version, so the
+// whole read (sample, copy, fence, check) must be done again.
+#define TX_READ_RETRY 1
+int  tx_read_check(TransactionContext* tx, void* addr, void* dst, size_t size,
+                   std::atomic<uint64_t>* lock, uint64_t pre);
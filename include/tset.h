@@ -5,25 +5,97 @@
 
 #include <atomic>
 #include "vlock.h"
-#include "bloom.h"
 #include <cstddef>
 #include <cstdint>
+#include "arena.h"
+#include "stats.h"
+#include "tl2_inline.h"
 
 #define WS_SLOTS 2048
 #define RS_MAX 2048
 #define INLINE_CAP 128
-#define BLOOM_BYTES 1224 //(1024 entries, 1% FPR, rounded to 8-byte boundary)
+#define FILTER_WORDS 16 // 1024-bit pointer filter, two probes per address
+
+// The write set is a packed redo log. Each entry is a WriteEntry header
+// followed by its payload rounded up to 8 bytes; payloads over INLINE_CAP
+// live in the spill area instead. Records fill the slice's WS_LOG region
+// first and then continue in the spill area, as do the entry table and
+// the index once they outgrow their WS_SLOTS-sized slice regions.
+#define WS_MAX_ENTRIES 65535
+#define WS_SPILL_BYTES (256UL * 1024 * 1024) // per-thread reservation, MAP_NORESERVE
+// Spill pages above WS_SPILL_KEEP stay resident while transactions keep
+// using them, and are handed back to the kernel in one madvise once
+// WS_SPILL_IDLE resets in a row have stayed below it. A thread that keeps
+// running large write sets pays no syscall or refault per transaction; one
+// that ran a single large transaction does not hold its pages for good.
+#define WS_SPILL_KEEP  (1UL * 1024 * 1024)
+#define WS_SPILL_IDLE  64
+
+// Open-addressed index over the entries: each slot holds (gen << 16 | entry).
+// Slots stamped with an older generation read as empty, so reset is O(1).
+#define WS_INDEX_SLOTS 4096
+#define WS_INDEX_BITS  12
+
+// Read-set dedup: a direct-mapped table remembering, per hash bucket, the
+// entry that last logged a stripe there. Entries at or past `count` are
+// stale, so the table never needs clearing.
+#define RS_DEDUP_SLOTS 1024
+#define RS_DEDUP_BITS  10
+
+// Validation loads RS_BATCH lock words at a time and prefetches the stripes
+// RS_PREFETCH entries ahead.
+#define RS_BATCH    8
+#define RS_PREFETCH 16
+
+// What an entry does to its location at write-back. WS_OP_WRITE stores the
+// payload; the others are commutative updates of an aligned 64-bit word by
+// the 8-byte operand in the payload, applied to the value the word has at
+// commit (IMIN / IMAX compare as int64_t, ADD wraps).
+#define WS_OP_WRITE 0
+#define WS_OP_ADD   1
+#define WS_OP_MIN   2
+#define WS_OP_MAX   3
+#define WS_OP_IMIN  4
+#define WS_OP_IMAX  5
+#define WS_OP_OR    6
+#define WS_OP_NONE  0xFF // writeset_reserve_op: no previous entry at this level
 
 struct WriteEntry{
+    void* addr;
     std::atomic<uint64_t>* lock;
-    size_t size;
-    char buf[INLINE_CAP];
+    uint32_t size;
+    uint32_t cap;
+    char* buf;
+    uint32_t op;
+};
+
+// Lives at BLOOM_OFFSET in the slice. `dirty` has bit i set once words[i]
+// is non-zero, so reset only clears the words that were touched.
+struct PtrFilter{
+    uint64_t dirty;
+    uint64_t words[FILTER_WORDS];
 };
 
+// Entries below `floor` belong to an enclosing closed nested transaction
+// and are frozen: writing their address again appends a newer entry that
+// shadows them, so that a rollback to the checkpoint is a truncation.
+// Write-back goes in entry order, so the newest entry wins.
 struct WriteSet{
     char* base;
     uint16_t count;
-    struct bloom bf;
+    uint16_t floor;
+    uint16_t gen;
+    uint16_t table_cap;
+    uint8_t index_bits;
+    PtrFilter* filter;
+    WriteEntry** table;
+    uint32_t* index;
+    char* log_cur;
+    char* log_end;
+    char* spill;
+    size_t spill_used;
+    size_t spill_high;   // resident extent of the spill area
+    uint32_t spill_idle; // resets in a row within WS_SPILL_KEEP
 };
 
 struct ReadEntry{
@@ -35,17 +107,125 @@ struct ReadSet{
     uint16_t count;
 };
 
+void ptrfilter_reset(PtrFilter* f);
+void ptrfilter_add(PtrFilter* f, void* addr);
+TL2_HOT int ptrfilter_check(const PtrFilter* f, void* addr);
+
 int writeset_init(WriteSet* set, char* slice_base);
 int writeset_reset(WriteSet* set);
-int writeset_add(WriteSet* set, void* addr, void* src, size_t size);
-int writeset_lookup(WriteSet* set, void* addr, WriteEntry** entry);
-void** writeset_keys(WriteSet* set);
-WriteEntry* writeset_values(WriteSet* set);
+int writeset_add(WriteSet* set, void* addr, const void* src, size_t size);
+TL2_HOT int writeset_lookup(WriteSet* set, void* addr, WriteEntry** entry);
+WriteEntry** writeset_entries(WriteSet* set);
+void writeset_destroy(WriteSet* set);
+
+// Drops entries [count, set->count) and rebuilds the index and filter over
+// the rest. O(count); for nested rollbacks.
+int writeset_truncate(WriteSet* set, uint16_t count);
+
+// Returns the payload buffer for addr (existing or new), sized for `size`
+// bytes, for the caller to fill; nullptr if the log is exhausted.
+char* writeset_reserve(WriteSet* set, void* addr, size_t size);
+
+// Same for an entry of operation `op`. *prev is the operation the reused
+// entry had, whose payload the buffer still holds, or WS_OP_NONE for a new
+// entry (including one shadowing a frozen entry).
+char* writeset_reserve_op(WriteSet* set, void* addr, size_t size, uint32_t op, uint32_t* prev);
+
+// The value `cur` takes under operation op with `operand`; also merges two
+// operands of the same commutative op.
+static inline uint64_t writeset_apply(uint32_t op, uint64_t cur, uint64_t operand){
+    switch (op){
+    case WS_OP_ADD:  return cur + operand;
+    case WS_OP_MIN:  return operand < cur ? operand : cur;
+    case WS_OP_MAX:  return operand > cur ? operand : cur;
+    case WS_OP_IMIN: return (int64_t)operand < (int64_t)cur ? operand : cur;
+    case WS_OP_IMAX: return (int64_t)operand > (int64_t)cur ? operand : cur;
+    case WS_OP_OR:   return cur | operand;
+    default:         return operand;
+    }
+}
+
+// Scratch for `n` stripe pointers at commit: the slice's WS_LOCKS region,
+// or the spill area for larger write sets.
+std::atomic<uint64_t>** writeset_lock_buffer(WriteSet* set, uint32_t n);
 
 int readset_init(ReadSet* set, char* slice_base);
 int readset_reset(ReadSet* set);
-int readset_add(ReadSet* set, std::atomic<uint64_t>* lock);
+TL2_HOT int readset_add(ReadSet* set, std::atomic<uint64_t>* lock);
 int readset_validate(ReadSet* set, uint64_t rv);
+int readset_validate_owned(ReadSet* set, uint64_t rv,
+                           std::atomic<uint64_t>** owned, uint16_t n_owned);
+// Slow path for diagnostics: the first stripe that fails validation, or
+// nullptr if the read set is (now) valid.
+std::atomic<uint64_t>* readset_find_invalid(ReadSet* set, uint64_t rv,
+                                            std::atomic<uint64_t>** owned, uint16_t n_owned);
+
+#if TL2_INLINE || defined(TL2_TSET_IMPL)
+// One multiply yields both probe positions: bits 54..63 and 44..53.
+static inline uint64_t ptrfilter_hash(void* addr){
+    return ((uintptr_t)addr >> 3) * 0x9E3779B97F4A7C15ULL;
+}
+
+TL2_HOT int ptrfilter_check(const PtrFilter* f, void* addr){
+    uint64_t h = ptrfilter_hash(addr);
+    uint32_t a = (uint32_t)(h >> 54);
+    uint32_t b = (uint32_t)(h >> 44) & 1023;
+
+    return ((f->words[a >> 6] >> (a & 63)) & (f->words[b >> 6] >> (b & 63)) & 1) != 0;
+}
+
+static inline uint32_t writeset_hash(void* addr, uint8_t bits){
+    return (uint32_t)((((uintptr_t)addr >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+// Returns the index slot holding addr, or the empty slot where it belongs.
+static inline uint32_t* writeset_probe(WriteSet* set, void* addr){
+    uint32_t* index = set->index;
+    uint32_t mask = (1U << set->index_bits) - 1;
+
+    for (uint32_t h = writeset_hash(addr, set->index_bits);; h = (h + 1) & mask){
+        uint32_t slot = index[h];
+        if ((slot >> 16) != set->gen) return &index[h];
+        if (set->table[slot & 0xFFFF]->addr == addr) return &index[h];
+    }
+}
+
+TL2_HOT int writeset_lookup(WriteSet* set, void* addr, WriteEntry** entry){
+    TL2_ARG_CHECK(set && addr && entry, -1);
+    *entry = nullptr;
+
+    if (!ptrfilter_check(set->filter, addr)) return 0;
+
+    uint32_t slot = *writeset_probe(set, addr);
+    if ((slot >> 16) != set->gen){
+        TX_STAT(stats_add(&stats_slice(set->base)->filter_false_pos, 1));
+        return 0;
+    }
+
+    *entry = set->table[slot & 0xFFFF];
+    return 1;
+}
+
+static inline uint32_t readset_hash(std::atomic<uint64_t>* lock){
+    return (uint32_t)((((uintptr_t)lock >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - RS_DEDUP_BITS));
+}
+
+TL2_HOT int readset_add(ReadSet* set, std::atomic<uint64_t>* lock){
+    TL2_ARG_CHECK(set && lock, -1);
+
+    ReadEntry* entries = (ReadEntry*)(set->base + RS_OFFSET);
+    uint16_t* dedup = (uint16_t*)(set->base + RS_DEDUP_OFFSET);
+    uint32_t h = readset_hash(lock);
+
+    uint16_t prev = dedup[h];
+    if (prev < set->count && entries[prev].lock == lock) return 0;
 
+    if (set->count >= RS_MAX) return -1;
 
+    entries[set->count].lock = lock;
+    dedup[h] = set->count;
 
+    set->count++;
+    return 0;
+}
+#endif
@@ -4,18 +4,85 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include "tl2_inline.h"
 
 constexpr size_t NUM_STRIPES = 1 << 20;
 constexpr size_t LOCK_SIZE = sizeof(uint64_t);
 
+// Lock table layout, fixed between vlock_init_config calls.
+//   stripes:      number of lock words, a power of two
+//   granularity:  log2 of the bytes of memory one stripe covers
+//   stride:       lock words between consecutive stripes (8 gives every
+//                 stripe its own cache line)
+//   scatter:      permute stripe indices so neighbouring addresses do not
+//                 share a lock cache line
+//   try_huge_pages: back the table with huge pages where available
+struct VLockConfig{
+    size_t stripes;
+    unsigned granularity;
+    unsigned stride;
+    int scatter;
+    int try_huge_pages;
+};
+
 extern std::atomic<uint64_t>* lockMap;
+extern VLockConfig vlock_cfg;
+extern size_t vlock_mask;
+
+static inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+extern int vlock_uses_huge_pages;
 
 void vlock_acquire(std::atomic<uint64_t>* lock);
+// Spins at most `spins` times on a held lock; returns 1 if acquired, else 0.
+int  vlock_try_acquire(std::atomic<uint64_t>* lock, uint32_t spins);
+// Same, adding the pause iterations it spent to *spun.
+int  vlock_try_acquire_counted(std::atomic<uint64_t>* lock, uint32_t spins, uint32_t* spun);
 void vlock_release(std::atomic<uint64_t>* lock, uint64_t new_version);
-size_t vlock_index(void* addr);
-std::atomic<uint64_t>* vlock_ptr(void* addr);
-uint64_t vlock_get_version(const std::atomic<uint64_t>* lock);
-bool vlock_is_locked(const std::atomic<uint64_t>* lock);
+TL2_HOT size_t vlock_index(void* addr);
+TL2_HOT std::atomic<uint64_t>* vlock_ptr(void* addr);
+// Inverse of vlock_ptr: the stripe index of a lock word.
+TL2_HOT size_t vlock_lock_index(const std::atomic<uint64_t>* lock);
+TL2_HOT uint64_t vlock_get_version(const std::atomic<uint64_t>* lock);
+TL2_HOT bool vlock_is_locked(const std::atomic<uint64_t>* lock);
 void vlock_clear_all();
 void vlock_init();
-void vlock_reset();
\ No newline at end of file
+void vlock_reset();
+
+void vlock_default_config(VLockConfig* cfg);
+int  vlock_init_config(const VLockConfig* cfg);
+void vlock_get_config(VLockConfig* cfg);
+size_t vlock_stripe_count();
+
+#if TL2_INLINE || defined(TL2_VLOCK_IMPL)
+TL2_HOT size_t vlock_index(void* addr){
+    size_t idx = ((uintptr_t)addr >> vlock_cfg.granularity) & vlock_mask;
+    if (vlock_cfg.scatter){
+        // Odd multiplier: a permutation of the stripe space that sends
+        // neighbouring stripes far apart.
+        idx = (idx * 0x9E3779B97F4A7C15ULL) & vlock_mask;
+    }
+    return idx;
+}
+
+TL2_HOT std::atomic<uint64_t>* vlock_ptr(void* addr){
+    return &lockMap[vlock_index(addr) * vlock_cfg.stride];
+}
+
+TL2_HOT size_t vlock_lock_index(const std::atomic<uint64_t>* lock){
+    return (size_t)(lock - lockMap) / vlock_cfg.stride;
+}
+
+TL2_HOT uint64_t vlock_get_version(const std::atomic<uint64_t>* lock){
+    return lock->load(std::memory_order_relaxed) >> 1;
+}
+
+TL2_HOT bool vlock_is_locked(const std::atomic<uint64_t>* lock){
+    return (lock->load(std::memory_order_relaxed) & 1ULL);
+}
+#endif
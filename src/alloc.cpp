@@ -0,0 +1,267 @@
+// alloc.cpp
+// Author: Anurag Choubey
+
+#include <sys/mman.h>
+#include <cstring>
+#include <mutex>
+#include "alloc.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static std::atomic<uint64_t> alloc_epoch{0};
+
+// Blocks spilled by threads holding too many, as chains of
+// ALLOC_CACHE_MAX / 2: word 0 links the blocks of a chain, word 1 of a
+// chain's first block links the chains. Only touched when a pool runs dry
+// or overflows.
+struct AllocDepot{
+    std::mutex mu;
+    std::atomic<void*> chains{nullptr};
+};
+
+static AllocDepot alloc_depot[ALLOC_CLASSES];
+
+// Every live large chunk, so that alloc_destroy can unmap them.
+static std::mutex alloc_large_mu;
+static AllocChunk* alloc_large = nullptr;
+
+static inline AllocChunk* alloc_chunk_of(void* p){
+    return (AllocChunk*)((uintptr_t)p & ~(uintptr_t)(ALLOC_CHUNK_SIZE - 1));
+}
+
+// Maps `bytes` (a multiple of PAGE_SIZE) aligned to ALLOC_CHUNK_SIZE by
+// over-mapping and trimming both ends.
+static AllocChunk* alloc_map(size_t bytes){
+    size_t span = bytes + ALLOC_CHUNK_SIZE;
+    char* raw = (char*)mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+
+    char* base = (char*)(((uintptr_t)raw + ALLOC_CHUNK_SIZE - 1) & ~(uintptr_t)(ALLOC_CHUNK_SIZE - 1));
+    if (base > raw) munmap(raw, base - raw);
+    size_t tail = (size_t)((raw + span) - (base + bytes));
+    if (tail) munmap(base + bytes, tail);
+
+    AllocChunk* c = (AllocChunk*)base;
+    c->bytes = bytes;
+    return c;
+}
+
+static void* alloc_large_block(size_t size){
+    size_t bytes = (size + ALLOC_CHUNK_HDR + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    AllocChunk* c = alloc_map(bytes);
+    if (!c) return nullptr;
+
+    c->cls = ALLOC_LARGE;
+    c->prev = nullptr;
+    {
+        std::lock_guard<std::mutex> g(alloc_large_mu);
+        c->next = alloc_large;
+        if (alloc_large) alloc_large->prev = c;
+        alloc_large = c;
+    }
+    return (char*)c + ALLOC_CHUNK_HDR;
+}
+
+static void alloc_unmap_large(AllocChunk* c){
+    {
+        std::lock_guard<std::mutex> g(alloc_large_mu);
+        if (c->prev) c->prev->next = c->next;
+        else alloc_large = c->next;
+        if (c->next) c->next->prev = c->prev;
+    }
+    munmap(c, c->bytes);
+}
+
+static inline void* alloc_pop(AllocState* st, uint32_t cls){
+    void* p = st->free_list[cls];
+    st->free_list[cls] = *(void**)p;
+    st->free_count[cls]--;
+    return p;
+}
+
+static void alloc_push(AllocState* st, uint32_t cls, void* p){
+    *(void**)p = st->free_list[cls];
+    st->free_list[cls] = p;
+    if (++st->free_count[cls] < ALLOC_CACHE_MAX) return;
+
+    // Spill the newest half to the depot as one chain.
+    void* head = st->free_list[cls];
+    void* last = head;
+    for (uint32_t i = 1; i < ALLOC_CACHE_MAX / 2; i++) last = *(void**)last;
+    st->free_list[cls] = *(void**)last;
+    st->free_count[cls] -= ALLOC_CACHE_MAX / 2;
+    *(void**)last = nullptr;
+
+    AllocDepot* d = &alloc_depot[cls];
+    std::lock_guard<std::mutex> g(d->mu);
+    ((void**)head)[1] = d->chains.load(std::memory_order_relaxed);
+    d->chains.store(head, std::memory_order_relaxed);
+}
+
+// Refills an empty pool from the depot.
+static int alloc_take_chain(AllocState* st, uint32_t cls){
+    AllocDepot* d = &alloc_depot[cls];
+    if (!d->chains.load(std::memory_order_relaxed)) return 0;
+
+    std::lock_guard<std::mutex> g(d->mu);
+    void* head = d->chains.load(std::memory_order_relaxed);
+    if (!head) return 0;
+    d->chains.store(((void**)head)[1], std::memory_order_relaxed);
+
+    st->free_list[cls] = head;
+    st->free_count[cls] = ALLOC_CACHE_MAX / 2;
+    return 1;
+}
+
+static void alloc_put(AllocState* st, void* p){
+    AllocChunk* c = alloc_chunk_of(p);
+    if (c->cls == ALLOC_LARGE) alloc_unmap_large(c);
+    else alloc_push(st, c->cls, p);
+}
+
+// The open batch joins the limbo, tagged with the epoch its last block was
+// retired in.
+static void alloc_seal(AllocState* st){
+    AllocBatch* b = st->open;
+    if (!b || !b->count) return;
+
+    b->epoch = alloc_epoch.load(std::memory_order_seq_cst);
+    b->next = nullptr;
+    if (st->limbo_tail) st->limbo_tail->next = b;
+    else st->limbo_head = b;
+    st->limbo_tail = b;
+    st->open = nullptr;
+}
+
+static void alloc_reclaim(AllocState* st, uint64_t epoch){
+    while (st->limbo_head && st->limbo_head->epoch + 2 <= epoch){
+        AllocBatch* b = st->limbo_head;
+        st->limbo_head = b->next;
+        if (!st->limbo_head) st->limbo_tail = nullptr;
+
+        for (uint32_t i = 0; i < b->count; i++) alloc_put(st, b->blocks[i]);
+        alloc_put(st, b);
+    }
+}
+
+// Slow path of alloc_block: carve from the class's chunk, then try the
+// depot and the limbo before mapping a new chunk.
+static void* alloc_refill(AllocState* st, uint32_t cls){
+    size_t bytes = (size_t)16 << cls;
+
+    char* p = st->carve[cls];
+    if (p && p + bytes <= st->carve_end[cls]){
+        st->carve[cls] = p + bytes;
+        return p;
+    }
+
+    if (!alloc_take_chain(st, cls) && (st->open || st->limbo_head)){
+        alloc_seal(st);
+        alloc_reclaim(st, alloc_try_advance());
+    }
+    if (st->free_list[cls]) return alloc_pop(st, cls);
+
+    AllocChunk* c = alloc_map(ALLOC_CHUNK_SIZE);
+    if (!c) return nullptr;
+    c->cls = cls;
+    c->next = st->chunks;
+    st->chunks = c;
+
+    p = (char*)c + ALLOC_CHUNK_HDR;
+    st->carve[cls] = p + bytes;
+    st->carve_end[cls] = (char*)c + ALLOC_CHUNK_SIZE;
+    return p;
+}
+
+void* alloc_block(char* slice, size_t size){
+    if (size > ALLOC_MAX_SMALL) return alloc_large_block(size);
+
+    AllocState* st = alloc_slice(slice);
+    uint32_t cls = alloc_class(size);
+    if (st->free_list[cls]) return alloc_pop(st, cls);
+    return alloc_refill(st, cls);
+}
+
+void alloc_release(char* slice, void* p){
+    if (p) alloc_put(alloc_slice(slice), p);
+}
+
+void alloc_retire(char* slice, void* p){
+    if (!p) return;
+    AllocState* st = alloc_slice(slice);
+
+    if (!st->open){
+        AllocBatch* b = (AllocBatch*)alloc_block(slice, sizeof(AllocBatch));
+        if (!b) return; // out of memory: p is leaked
+        b->count = 0;
+        st->open = b;
+    }
+
+    st->open->blocks[st->open->count++] = p;
+    if (st->open->count == ALLOC_BATCH){
+        alloc_seal(st);
+        alloc_reclaim(st, alloc_try_advance());
+    }
+}
+
+// A stale (smaller) epoch only holds the epoch back, so the relaxed load is
+// enough; the seq_cst store orders the announcement before our first read
+// against alloc_try_advance's scan.
+void alloc_enter(char* slice){
+    uint64_t e = alloc_epoch.load(std::memory_order_relaxed);
+    alloc_slice(slice)->epoch.store(e << 1 | 1, std::memory_order_seq_cst);
+}
+
+void alloc_leave(char* slice){
+    alloc_slice(slice)->epoch.store(0, std::memory_order_release);
+}
+
+uint64_t alloc_try_advance(){
+    uint64_t e = alloc_epoch.load(std::memory_order_seq_cst);
+
+    int slots = arena_max_threads();
+    for (int slot = 0; slot < slots; slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        uint64_t seen = alloc_slice(slice)->epoch.load(std::memory_order_seq_cst);
+        if ((seen & 1) && (seen >> 1) != e) return e;
+    }
+
+    if (alloc_epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst)) e++;
+    return e;
+}
+
+void alloc_destroy(){
+    int slots = arena_max_threads();
+    for (int slot = 0; slot < slots; slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        AllocState* st = alloc_slice(slice);
+        AllocChunk* c = st->chunks;
+        while (c){
+            AllocChunk* next = c->next;
+            munmap(c, c->bytes);
+            c = next;
+        }
+        memset((void*)st, 0, sizeof(AllocState));
+    }
+
+    {
+        std::lock_guard<std::mutex> g(alloc_large_mu);
+        AllocChunk* c = alloc_large;
+        while (c){
+            AllocChunk* next = c->next;
+            munmap(c, c->bytes);
+            c = next;
+        }
+        alloc_large = nullptr;
+    }
+
+    for (int cls = 0; cls < ALLOC_CLASSES; cls++)
+        alloc_depot[cls].chains.store(nullptr, std::memory_order_relaxed);
+}
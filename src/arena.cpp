@@ -4,8 +4,14 @@
 #include <sys/mman.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include "arena.h"
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #ifdef __APPLE__
 #include <mach/vm_statistics.h>
 #endif
@@ -14,18 +20,109 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define ARENA_MPOL_PREFERRED 1
+
 char* arena_base = nullptr;
 std::atomic<uint32_t> arena_next_slot{0};
 int arena_uses_huge_pages = 0;
+uint32_t arena_capacity = 0;
+size_t arena_size = 0;
+
+// One contiguous slot range per NUMA node. The free list of released slots
+// is (ABA tag << 32) | (slot + 1), 0 when empty; a free slice stores the next
+// link in its first word.
+struct ArenaNode{
+    std::atomic<uint32_t> next;
+    std::atomic<uint64_t> free_head;
+    uint32_t first;
+    uint32_t slots;
+};
+
+static ArenaNode arena_nodes[MAX_NUMA_NODES];
+static int arena_node_count = 0;
+static uint32_t arena_slots_per_node = 0;
+
+static inline std::atomic<uint32_t>* arena_free_link(uint32_t slot){
+    return (std::atomic<uint32_t>*)(arena_base + (size_t)slot * SLICE_SIZE);
+}
+
+// Highest online node id + 1, from /sys; 1 if unknown.
+static int arena_detect_nodes(){
+#ifdef __linux__
+    FILE* f = fopen("/sys/devices/system/node/online", "r");
+    if (!f) return 1;
+
+    int max_id = 0, a = 0, b = 0;
+    char sep = 0;
+    while (fscanf(f, "%d", &a) == 1){
+        b = a;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-'){
+            if (fscanf(f, "%d", &b) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = 0;
+        }
+        if (b > max_id) max_id = b;
+        if (sep != ',') break;
+    }
+    fclose(f);
+
+    int nodes = max_id + 1;
+    return nodes > MAX_NUMA_NODES ? MAX_NUMA_NODES : nodes;
+#else
+    return 1;
+#endif
+}
+
+// Best effort: a node that does not exist (fake topology) or a kernel without
+// mbind leaves the range to first touch.
+static void arena_bind_node(char* addr, size_t len, int node){
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[(MAX_NUMA_NODES + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long))] = {0};
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, addr, len, ARENA_MPOL_PREFERRED, mask, MAX_NUMA_NODES + 1, 0);
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+#endif
+}
+
+int arena_current_node(){
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return (int)node;
+#endif
+    return 0;
+}
 
 int arena_init(int try_huge_pages){
-    if (arena_base != nullptr) return -1;
+    return arena_init_threads(try_huge_pages, MAX_THREADS);
+}
+
+int arena_init_threads(int try_huge_pages, uint32_t max_threads){
+    return arena_init_numa(try_huge_pages, max_threads, 0);
+}
+
+int arena_init_numa(int try_huge_pages, uint32_t max_threads, int nodes){
+    if (arena_base != nullptr || max_threads == 0) return -1;
+    if (nodes <= 0) nodes = arena_detect_nodes();
+    if (nodes > MAX_NUMA_NODES) return -1;
+    if ((uint32_t)nodes > max_threads) nodes = (int)max_threads;
+
+    size_t raw = (size_t)max_threads * SLICE_SIZE;
+    size_t size = ((raw + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
 
     void* mem = MAP_FAILED;
 
     if (try_huge_pages){
 #if defined(MAP_HUGETLB)
-        mem = mmap(nullptr, ARENA_SIZE,
+        // No MAP_NORESERVE here: hugetlb pages must be reserved up front, or
+        // an exhausted pool shows up as SIGBUS on first touch instead of as
+        // a failed mmap we can fall back from.
+        mem = mmap(nullptr, size,
                    PROT_READ | PROT_WRITE,
                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
                    -1, 0);
@@ -33,7 +130,7 @@ int arena_init(int try_huge_pages){
             arena_uses_huge_pages = 1;
         }
 #elif defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
-        mem = mmap(nullptr, ARENA_SIZE,
+        mem = mmap(nullptr, size,
                    PROT_READ | PROT_WRITE,
                    MAP_PRIVATE | MAP_ANONYMOUS,
                    VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
@@ -44,21 +141,40 @@ int arena_init(int try_huge_pages){
     }
 
     if (mem == MAP_FAILED){
-        mem = mmap(nullptr, ARENA_SIZE,
+        mem = mmap(nullptr, size,
                    PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
                    -1, 0);
         if (mem == MAP_FAILED) return -1;
 
 #ifdef MADV_HUGEPAGE
         if (try_huge_pages){
-            madvise(mem, ARENA_SIZE, MADV_HUGEPAGE);
+            madvise(mem, size, MADV_HUGEPAGE);
         }
 #endif
         arena_uses_huge_pages = 0;
     }
 
     arena_base = (char*)mem;
+    arena_size = size;
+    arena_capacity = max_threads;
+    arena_node_count = nodes;
+    arena_slots_per_node = (max_threads + nodes - 1) / nodes;
+
+    for (int n = 0; n < nodes; n++){
+        ArenaNode* node = &arena_nodes[n];
+        node->first = (uint32_t)n * arena_slots_per_node;
+        node->slots = node->first >= max_threads ? 0 :
+                      (max_threads - node->first < arena_slots_per_node ?
+                       max_threads - node->first : arena_slots_per_node);
+        node->next.store(0, std::memory_order_relaxed);
+        node->free_head.store(0, std::memory_order_relaxed);
+
+        if (nodes > 1 && node->slots)
+            arena_bind_node(arena_base + (size_t)node->first * SLICE_SIZE,
+                            (size_t)node->slots * SLICE_SIZE, n);
+    }
+
     arena_next_slot.store(0, std::memory_order_release);
     return 0;
 }
@@ -66,28 +182,116 @@ int arena_init(int try_huge_pages){
 void arena_destroy(){
     if (arena_base == nullptr) return;
 
-    munmap(arena_base, ARENA_SIZE);
+    munmap(arena_base, arena_size);
 
     arena_base = nullptr;
+    arena_size = 0;
+    arena_capacity = 0;
+    arena_node_count = 0;
+    arena_slots_per_node = 0;
     arena_next_slot.store(0, std::memory_order_relaxed);
     arena_uses_huge_pages = 0;
 }
 
+static int arena_pop_free(ArenaNode* node, uint32_t* slot){
+    uint64_t head = node->free_head.load(std::memory_order_acquire);
+
+    while (head & 0xFFFFFFFFULL){
+        uint32_t top = (uint32_t)head - 1;
+        uint32_t next = arena_free_link(top)->load(std::memory_order_relaxed);
+        uint64_t desired = ((head >> 32) + 1) << 32 | next;
+
+        if (node->free_head.compare_exchange_weak(head, desired,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_acquire)){
+            *slot = top;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int arena_take_slot(ArenaNode* node, uint32_t* slot){
+    if (arena_pop_free(node, slot)) return 1;
+
+    uint32_t i = node->next.fetch_add(1, std::memory_order_acq_rel);
+    if (i >= node->slots){
+        node->next.fetch_sub(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    arena_next_slot.fetch_add(1, std::memory_order_acq_rel);
+    *slot = node->first + i;
+    return 1;
+}
+
 char* arena_register_thread(){
     if (arena_base == nullptr) return nullptr;
 
-    uint32_t slot = arena_next_slot.fetch_add(1, std::memory_order_acq_rel);
+    int home = arena_node_count > 1 ? arena_current_node() % arena_node_count : 0;
 
-    if (slot >= MAX_THREADS){
-        arena_next_slot.fetch_sub(1, std::memory_order_relaxed);
-        return nullptr;
+    for (int k = 0; k < arena_node_count; k++){
+        uint32_t slot;
+        if (arena_take_slot(&arena_nodes[(home + k) % arena_node_count], &slot))
+            return arena_base + ((size_t)slot * SLICE_SIZE);
     }
 
-    return arena_base + ((size_t)slot * SLICE_SIZE);
+    return nullptr;
+}
+
+int arena_release_thread(char* slice){
+    if (arena_base == nullptr || slice < arena_base) return -1;
+
+    size_t off = (size_t)(slice - arena_base);
+    if (off % SLICE_SIZE != 0) return -1;
+
+    size_t slot = off / SLICE_SIZE;
+    if (slot >= arena_capacity) return -1;
+
+    ArenaNode* node = &arena_nodes[slot / arena_slots_per_node];
+    if (slot - node->first >= node->next.load(std::memory_order_acquire)) return -1;
+
+    uint64_t head = node->free_head.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do {
+        arena_free_link((uint32_t)slot)->store((uint32_t)head, std::memory_order_relaxed);
+        desired = ((head >> 32) + 1) << 32 | (slot + 1);
+    } while (!node->free_head.compare_exchange_weak(head, desired,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+
+    return 0;
 }
 
 int arena_slot_count(){
     uint32_t n = arena_next_slot.load(std::memory_order_acquire);
-    if (n > MAX_THREADS) return MAX_THREADS;
+    if (n > arena_capacity) return (int)arena_capacity;
     return (int)n;
 }
+
+int arena_max_threads(){
+    return (int)arena_capacity;
+}
+
+char* arena_slot_slice(int slot){
+    if (arena_base == nullptr || slot < 0 || (uint32_t)slot >= arena_capacity) return nullptr;
+
+    ArenaNode* node = &arena_nodes[(uint32_t)slot / arena_slots_per_node];
+    if ((uint32_t)slot - node->first >= node->next.load(std::memory_order_acquire)) return nullptr;
+
+    return arena_base + ((size_t)slot * SLICE_SIZE);
+}
+
+int arena_numa_nodes(){
+    return arena_node_count;
+}
+
+int arena_slice_node(char* slice){
+    if (arena_base == nullptr || slice < arena_base) return -1;
+
+    size_t slot = (size_t)(slice - arena_base) / SLICE_SIZE;
+    if (slot >= arena_capacity) return -1;
+
+    return (int)(slot / arena_slots_per_node);
+}
@@ -0,0 +1,91 @@
+// cm.cpp
+// Author: Anurag Choubey
+
+#include <sched.h>
+#include "cm.h"
+#include "vlock.h"
+
+int cm_policy = TL2_CM_POLICY;
+
+// (stripe + 1) << 32 | karma, clamped to 32 bits.
+static std::atomic<uint64_t> cm_holders[CM_HOLDER_SLOTS];
+
+int cm_set_policy(int policy){
+    if (policy < CM_BACKOFF || policy > CM_POLKA) return -1;
+    cm_policy = policy;
+    return 0;
+}
+
+void cm_init(CMState* cm, uint64_t seed){
+    cm->attempts = 0;
+    cm->karma = 0;
+    cm->seed = seed | 1;
+}
+
+static inline uint64_t cm_rand(CMState* cm){
+    uint64_t x = cm->seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    cm->seed = x;
+    return x;
+}
+
+// Pauses for a random number of iterations below 2^exp.
+static void cm_backoff(CMState* cm, uint32_t exp){
+    if (exp > CM_MAX_BACKOFF) exp = CM_MAX_BACKOFF;
+    uint64_t n = cm_rand(cm) & ((1ULL << exp) - 1);
+    for (uint64_t i = 0; i < n; i++)
+        cpu_relax();
+}
+
+void cm_publish(const CMState* cm, const std::atomic<uint64_t>* lock){
+    uint64_t stripe = vlock_lock_index(lock);
+    uint64_t karma = cm->karma < UINT32_MAX ? cm->karma : UINT32_MAX;
+    cm_holders[stripe & (CM_HOLDER_SLOTS - 1)].store((stripe + 1) << 32 | karma,
+                                                      std::memory_order_relaxed);
+}
+
+static uint64_t cm_holder_karma(const std::atomic<uint64_t>* lock){
+    uint64_t stripe = vlock_lock_index(lock);
+    uint64_t e = cm_holders[stripe & (CM_HOLDER_SLOTS - 1)].load(std::memory_order_relaxed);
+    return (e >> 32) == stripe + 1 ? (uint32_t)e : 0;
+}
+
+int cm_on_busy(CMState* cm, uint32_t tries, const std::atomic<uint64_t>* lock){
+    switch (cm_policy){
+    case CM_YIELD:
+        if (tries > CM_MAX_TRIES) return 0;
+        if (tries >= CM_YIELD_AFTER) sched_yield();
+        else cm_backoff(cm, tries + 4);
+        return 1;
+    case CM_POLKA: {
+        uint64_t holder = cm_holder_karma(lock);
+        uint64_t patience = CM_MAX_TRIES / 2;
+        if (cm->karma > holder) patience += (cm->karma - holder) / CM_KARMA_UNIT;
+        if (tries > patience) return 0;
+        cm_backoff(cm, tries + 4);
+        return 1;
+    }
+    default:
+        if (tries > CM_MAX_TRIES) return 0;
+        cm_backoff(cm, tries + 4);
+        return 1;
+    }
+}
+
+void cm_on_abort(CMState* cm, uint32_t work){
+    cm->attempts++;
+    cm->karma += work;
+
+    if (cm_policy == CM_YIELD && cm->attempts >= CM_YIELD_AFTER){
+        sched_yield();
+        return;
+    }
+    cm_backoff(cm, cm->attempts + 2);
+}
+
+void cm_on_commit(CMState* cm){
+    cm->attempts = 0;
+    cm->karma = 0;
+}
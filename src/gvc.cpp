@@ -1,20 +1,71 @@
+#define TL2_GVC_IMPL
 #include "gvc.h"
 
 std::atomic<uint64_t> gvc{0};
+int gvc_mode = TL2_GVC_MODE;
 
 void gvc_init(){
     gvc = 0;
 } 
 
+int gvc_set_mode(int mode){
+    if (mode < GVC_MODE_GV1 || mode > GVC_MODE_GV6) return -1;
+    gvc_mode = mode;
+    return 0;
+}
+
 uint64_t gvc_get(){
     return gvc.load(std::memory_order_relaxed);
 }
 
-uint64_t gvc_read(){
-    return gvc.load(std::memory_order_acquire);
-} 
-
 uint64_t gvc_inc(){
     return gvc.fetch_add(1, std::memory_order_release);
 }
 
+static uint64_t gvc_pass_on_failure(int* unique){
+    uint64_t g = gvc.load(std::memory_order_acquire);
+    if (gvc.compare_exchange_strong(g, g + 1,
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)){
+        *unique = 1;
+        return g + 1;
+    }
+    // g now holds the winner's timestamp, which is newer than any snapshot
+    // taken before we started committing.
+    *unique = 0;
+    return g;
+}
+
+uint64_t gvc_commit_version(int* unique){
+    static thread_local uint32_t commits = 0;
+
+    switch (gvc_mode){
+    case GVC_MODE_GV4:
+        return gvc_pass_on_failure(unique);
+    case GVC_MODE_GV6:
+        if (++commits % GVC_SAMPLE_PERIOD == 0){
+            // The other commits take clock + 1 without advancing it, so
+            // winning the CAS does not make the version ours alone.
+            uint64_t wv = gvc_pass_on_failure(unique);
+            *unique = 0;
+            return wv;
+        }
+        // fall through
+    case GVC_MODE_GV5:
+        *unique = 0;
+        return gvc.load(std::memory_order_acquire) + 1;
+    default:
+        *unique = 1;
+        return gvc_inc() + 1;
+    }
+}
+
+void gvc_observe(uint64_t version){
+    if (gvc_mode != GVC_MODE_GV5 && gvc_mode != GVC_MODE_GV6) return;
+
+    uint64_t g = gvc.load(std::memory_order_relaxed);
+    while (g < version &&
+           !gvc.compare_exchange_weak(g, version,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)){}
+}
@@ -0,0 +1,204 @@
+// mvcc.cpp
+// Author: Anurag Choubey
+
+#include <sys/mman.h>
+#include <cstring>
+#include "gvc.h"
+#include "mvcc.h"
+#include "vlock.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+std::atomic<int> mv_on{0};
+
+static char* mv_table = nullptr;
+static size_t mv_table_bytes = 0;
+static size_t mv_stride = 0;
+static unsigned mv_depth = 0;
+static unsigned mv_shift = 64;
+
+// Records at or below it are not needed by any running or future snapshot.
+static std::atomic<uint64_t> mv_horizon{0};
+static std::atomic<uint64_t> mv_global_floor{0};
+
+static inline MvBucket* mv_bucket(uint64_t word){
+    size_t i = mv_shift == 64 ? 0 : (size_t)(((word >> 3) * 0x9E3779B97F4A7C15ULL) >> mv_shift);
+    return (MvBucket*)(mv_table + i * mv_stride);
+}
+
+static inline uint64_t mv_load(const uint64_t* p){
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline void mv_store(uint64_t* p, uint64_t v){
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+void mv_default_config(MvConfig* cfg){
+    cfg->buckets = 1 << 16;
+    cfg->depth = 4;
+}
+
+int mv_enable(const MvConfig* cfg){
+    if (!cfg || cfg->buckets == 0 || (cfg->buckets & (cfg->buckets - 1))) return -1;
+    if (cfg->depth == 0 || cfg->depth > MV_DEPTH_MAX) return -1;
+
+    // A word must not straddle two stripes.
+    VLockConfig vc;
+    vlock_get_config(&vc);
+    if (vc.granularity < 3) return -1;
+
+    mv_disable();
+
+    size_t stride = mv_bucket_bytes(cfg->depth);
+    size_t bytes = cfg->buckets * stride;
+    void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return -1;
+
+    mv_table = (char*)mem;
+    mv_table_bytes = bytes;
+    mv_stride = stride;
+    mv_depth = cfg->depth;
+    mv_shift = 64 - (unsigned)__builtin_ctzll(cfg->buckets);
+    mv_horizon.store(0, std::memory_order_relaxed);
+    mv_global_floor.store(0, std::memory_order_relaxed);
+    mv_on.store(1, std::memory_order_release);
+    return 0;
+}
+
+void mv_disable(){
+    mv_on.store(0, std::memory_order_release);
+    if (mv_table) munmap(mv_table, mv_table_bytes);
+    mv_table = nullptr;
+    mv_table_bytes = 0;
+}
+
+size_t mv_bytes(){
+    return mv_table_bytes;
+}
+
+// Announce before read_version is sampled, like alloc_enter: a horizon scan
+// that misses the announcement read the clock before we did.
+void mv_enter(char* slice){
+    mv_slot(slice)->snapshot.store(gvc_read() << 1 | 1, std::memory_order_seq_cst);
+}
+
+void mv_leave(char* slice){
+    mv_slot(slice)->snapshot.store(0, std::memory_order_release);
+}
+
+static uint64_t mv_advance(){
+    uint64_t h = gvc_read();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    int slots = arena_max_threads();
+    for (int slot = 0; slot < slots; slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        uint64_t seen = mv_slot(slice)->snapshot.load(std::memory_order_seq_cst);
+        if ((seen & 1) && (seen >> 1) < h) h = seen >> 1;
+    }
+
+    mv_horizon.store(h, std::memory_order_relaxed);
+    return h;
+}
+
+// The slot for a new record: a free or dead one if there is any, otherwise
+// the oldest.
+static MvEntry* mv_victim(MvBucket* b, uint64_t horizon){
+    MvEntry* oldest = &b->entries[0];
+    for (unsigned i = 0; i < mv_depth; i++){
+        MvEntry* e = &b->entries[i];
+        if (e->version <= horizon) return e;
+        if (e->version < oldest->version) oldest = e;
+    }
+    return oldest;
+}
+
+static void mv_insert(uint64_t word, uint64_t version){
+    MvBucket* b = mv_bucket(word);
+
+    uint64_t seq = b->seq.load(std::memory_order_relaxed);
+    while (true){
+        if (!(seq & 1) &&
+            b->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) break;
+        cpu_relax();
+        seq = b->seq.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    MvEntry* e = mv_victim(b, mv_horizon.load(std::memory_order_relaxed));
+    if (e->version > mv_horizon.load(std::memory_order_relaxed))
+        e = mv_victim(b, mv_advance());
+    if (e->version > b->floor) mv_store(&b->floor, e->version);
+
+    mv_store(&e->addr, word);
+    mv_store(&e->version, version);
+    mv_store(&e->value, mv_load((const uint64_t*)word));
+
+    b->seq.store(seq + 2, std::memory_order_release);
+}
+
+void mv_record(void* addr, size_t size, uint64_t version){
+    if (!size) return;
+    uint64_t first = (uint64_t)(uintptr_t)addr & ~7ULL;
+    uint64_t last = ((uint64_t)(uintptr_t)addr + size - 1) & ~7ULL;
+    for (uint64_t w = first; w <= last; w += 8)
+        mv_insert(w, version);
+}
+
+void mv_raise_floor(uint64_t version){
+    uint64_t f = mv_global_floor.load(std::memory_order_relaxed);
+    while (f < version &&
+           !mv_global_floor.compare_exchange_weak(f, version, std::memory_order_release,
+                                                  std::memory_order_relaxed)){}
+}
+
+int mv_read(void* addr, void* dst, size_t size, uint64_t rv, int stable){
+    uintptr_t a = (uintptr_t)addr;
+    if ((a & 7) + size > 8) return 0;
+    if (mv_global_floor.load(std::memory_order_acquire) > rv) return 0;
+
+    uint64_t word = a & ~(uintptr_t)7;
+    MvBucket* b = mv_bucket(word);
+
+    for (int attempt = 0; attempt < 64; attempt++){
+        uint64_t s1 = b->seq.load(std::memory_order_acquire);
+        if (s1 & 1){
+            cpu_relax();
+            continue;
+        }
+
+        uint64_t floor = mv_load(&b->floor);
+        uint64_t best = UINT64_MAX, value = 0;
+        int tie = 0;
+        for (unsigned i = 0; i < mv_depth; i++){
+            MvEntry* e = &b->entries[i];
+            if (mv_load(&e->addr) != word) continue;
+            uint64_t v = mv_load(&e->version);
+            uint64_t x = mv_load(&e->value);
+            if (v <= rv) continue;
+            if (v < best){
+                best = v;
+                value = x;
+                tie = 0;
+            } else if (v == best && x != value){
+                tie = 1; // GV5 commits to one stripe can share a version
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (b->seq.load(std::memory_order_relaxed) != s1) continue;
+
+        if (floor > rv || tie) return 0;
+        if (best == UINT64_MAX) return stable;
+        memcpy(dst, (char*)&value + (a & 7), size);
+        return 1;
+    }
+    return 0;
+}
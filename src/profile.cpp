@@ -0,0 +1,182 @@
+// profile.cpp
+// Author: Anurag Choubey
+
+#include <algorithm>
+#include <vector>
+#include "profile.h"
+#include "vlock.h"
+
+static_assert(STATS_ABORT_READ_LOCKED < PROFILE_CAUSES &&
+              STATS_ABORT_READ_VALIDATE < PROFILE_CAUSES &&
+              STATS_ABORT_COMMIT_LOCKED < PROFILE_CAUSES &&
+              STATS_ABORT_COMMIT_VALIDATE < PROFILE_CAUSES,
+              "conflict causes must index ProfileSlot::by_cause");
+
+// key is stripe + 1, so 0 marks a free slot. A stripe with no slot in its
+// probe window claims a free one with a CAS or, if there is none, takes over
+// the window's least-counted slot (Space-Saving): it inherits that count as
+// its error, so a stripe that turns hot late still overtakes stale ones.
+// Counts are approximate while a takeover races with increments.
+struct ProfileSlot{
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> count;                   // including error
+    std::atomic<uint64_t> error;
+    std::atomic<uint64_t> by_cause[PROFILE_CAUSES]; // the stripe's own events
+    std::atomic<uintptr_t> addrs[PROFILE_ADDRS];
+    std::atomic<uint32_t> more_addrs;
+};
+
+static ProfileSlot profile_table[PROFILE_SLOTS];
+static std::atomic<uint64_t> profile_drops{0};
+std::atomic<uint32_t> profile_period{0};
+
+// Period of the last profile_start, still needed for scaling after a stop.
+static uint32_t profile_scale = 1;
+
+static thread_local uint32_t profile_tick = 0;
+
+int profile_start(uint32_t sample_period){
+    if (sample_period == 0) return -1;
+
+    for (ProfileSlot& s : profile_table){
+        s.key.store(0, std::memory_order_relaxed);
+        s.count.store(0, std::memory_order_relaxed);
+        s.error.store(0, std::memory_order_relaxed);
+        for (auto& c : s.by_cause) c.store(0, std::memory_order_relaxed);
+        for (auto& a : s.addrs) a.store(0, std::memory_order_relaxed);
+        s.more_addrs.store(0, std::memory_order_relaxed);
+    }
+    profile_drops.store(0, std::memory_order_relaxed);
+    profile_scale = sample_period;
+    profile_period.store(sample_period, std::memory_order_release);
+    return 0;
+}
+
+void profile_stop(){
+    profile_period.store(0, std::memory_order_release);
+}
+
+static void profile_note_addr(ProfileSlot* s, uintptr_t addr){
+    for (auto& a : s->addrs){
+        uintptr_t cur = a.load(std::memory_order_relaxed);
+        if (cur == 0 && a.compare_exchange_strong(cur, addr, std::memory_order_relaxed))
+            return;
+        if (cur == addr) return;
+    }
+    s->more_addrs.store(1, std::memory_order_relaxed);
+}
+
+static void profile_count(ProfileSlot* s, int cause, void* addr){
+    s->count.fetch_add(1, std::memory_order_relaxed);
+    s->by_cause[cause].fetch_add(1, std::memory_order_relaxed);
+    if (addr) profile_note_addr(s, (uintptr_t)addr);
+}
+
+void profile_record(int cause, const std::atomic<uint64_t>* lock, void* addr){
+    uint32_t period = profile_period.load(std::memory_order_relaxed);
+    if (!period || !lock || cause < 0 || cause >= PROFILE_CAUSES) return;
+    if (++profile_tick < period) return;
+    profile_tick = 0;
+
+    size_t stripe = vlock_lock_index(lock);
+    uint64_t key = (uint64_t)stripe + 1;
+    size_t h = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - PROFILE_BITS));
+
+    ProfileSlot* victim = nullptr;
+    uint64_t victim_key = 0, least = UINT64_MAX;
+    for (uint32_t p = 0; p < PROFILE_PROBES; p++){
+        ProfileSlot* s = &profile_table[(h + p) & (PROFILE_SLOTS - 1)];
+
+        uint64_t k = s->key.load(std::memory_order_acquire);
+        if (k == 0 && s->key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+            k = key;
+        if (k == key){
+            profile_count(s, cause, addr);
+            return;
+        }
+
+        uint64_t c = s->count.load(std::memory_order_relaxed);
+        if (c < least){
+            least = c;
+            victim = s;
+            victim_key = k;
+        }
+    }
+
+    // Window full: evict its least-counted stripe, unless another thread
+    // changed that slot first.
+    if (victim && victim->key.compare_exchange_strong(victim_key, key, std::memory_order_acq_rel)){
+        victim->error.store(victim->count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        for (auto& c : victim->by_cause) c.store(0, std::memory_order_relaxed);
+        for (auto& a : victim->addrs) a.store(0, std::memory_order_relaxed);
+        victim->more_addrs.store(0, std::memory_order_relaxed);
+        profile_count(victim, cause, addr);
+        return;
+    }
+
+    profile_drops.fetch_add(1, std::memory_order_relaxed);
+}
+
+int profile_top(ProfileHot* out, int n){
+    if (!out || n <= 0) return 0;
+
+    std::vector<ProfileHot> hot;
+    for (ProfileSlot& s : profile_table){
+        uint64_t key = s.key.load(std::memory_order_acquire);
+        if (key == 0) continue;
+
+        ProfileHot h = {};
+        h.stripe = (size_t)(key - 1);
+        h.count = s.count.load(std::memory_order_relaxed);
+        h.error = s.error.load(std::memory_order_relaxed);
+        for (int c = 0; c < PROFILE_CAUSES; c++)
+            h.by_cause[c] = s.by_cause[c].load(std::memory_order_relaxed);
+        for (auto& a : s.addrs){
+            uintptr_t v = a.load(std::memory_order_relaxed);
+            if (v) h.addrs[h.n_addrs++] = (void*)v;
+        }
+        if (s.more_addrs.load(std::memory_order_relaxed)) h.n_addrs = PROFILE_ADDRS + 1;
+        hot.push_back(h);
+    }
+
+    std::sort(hot.begin(), hot.end(), [](const ProfileHot& a, const ProfileHot& b){
+        return a.count != b.count ? a.count > b.count : a.stripe < b.stripe;
+    });
+
+    int m = std::min(n, (int)hot.size());
+    std::copy(hot.begin(), hot.begin() + m, out);
+    return m;
+}
+
+uint64_t profile_dropped(){
+    return profile_drops.load(std::memory_order_relaxed);
+}
+
+void profile_dump(FILE* f, int n){
+    if (!f || n <= 0) return;
+
+    std::vector<ProfileHot> hot(n);
+    int m = profile_top(hot.data(), n);
+    uint64_t scale = profile_scale;
+
+    fprintf(f, "rank,stripe,events,error,read_locked,read_validate,commit_locked,"
+               "commit_validate,addresses,aliased,sample_addrs\n");
+    for (int i = 0; i < m; i++){
+        const ProfileHot& h = hot[i];
+        fprintf(f, "%d,%zu,%llu,%llu,%llu,%llu,%llu,%llu,%s%u,%d,", i + 1, h.stripe,
+                (unsigned long long)(h.count * scale),
+                (unsigned long long)(h.error * scale),
+                (unsigned long long)(h.by_cause[STATS_ABORT_READ_LOCKED] * scale),
+                (unsigned long long)(h.by_cause[STATS_ABORT_READ_VALIDATE] * scale),
+                (unsigned long long)(h.by_cause[STATS_ABORT_COMMIT_LOCKED] * scale),
+                (unsigned long long)(h.by_cause[STATS_ABORT_COMMIT_VALIDATE] * scale),
+                h.n_addrs > PROFILE_ADDRS ? ">" : "",
+                h.n_addrs > PROFILE_ADDRS ? PROFILE_ADDRS : h.n_addrs,
+                h.n_addrs > 1);
+        for (uint32_t a = 0; a < h.n_addrs && a < PROFILE_ADDRS; a++)
+            fprintf(f, "%s%p", a ? " " : "", h.addrs[a]);
+        fprintf(f, "\n");
+    }
+    fprintf(f, "# sample_period=%llu dropped=%llu\n", (unsigned long long)scale,
+            (unsigned long long)profile_dropped());
+}
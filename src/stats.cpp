@@ -0,0 +1,37 @@
+// stats.cpp
+// Author: Anurag Choubey
+
+#include <cstring>
+#include "stats.h"
+
+int stats_collect(TxStats* out){
+    if (!out) return -1;
+    memset(out, 0, sizeof(TxStats));
+
+    int n = 0;
+    int slots = arena_max_threads();
+    for (int slot = 0; slot < slots; slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        uint64_t* src = (uint64_t*)stats_slice(slice);
+        uint64_t* dst = (uint64_t*)out;
+        for (size_t i = 0; i < sizeof(TxStats) / sizeof(uint64_t); i++)
+            dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        n++;
+    }
+
+    return n;
+}
+
+void stats_reset(){
+    int slots = arena_max_threads();
+    for (int slot = 0; slot < slots; slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        uint64_t* words = (uint64_t*)stats_slice(slice);
+        for (size_t i = 0; i < sizeof(TxStats) / sizeof(uint64_t); i++)
+            __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+    }
+}
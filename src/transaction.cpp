@@ -0,0 +1,882 @@
+// transaction.cpp
+// Author: Anurag Choubey
+
+#include <sched.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "transaction.h"
+#include "alloc.h"
+#include "arena.h"
+#include "cm.h"
+#include "gvc.h"
+#include "mvcc.h"
+#include "profile.h"
+#include "stats.h"
+#include "vlock.h"
+
+static_assert(sizeof(TransactionContext) <= TX_CTX_BYTES,
+              "TransactionContext does not fit in its slice region");
+
+// Bumped by tx_init so threads notice that their slice was unmapped.
+static std::atomic<uint32_t> tx_epoch{0};
+
+// Irrevocable mode: at most one transaction holds the token at a time.
+static std::atomic<uint32_t> tx_token{0};
+static std::atomic<uint32_t> tx_irrevocable_threshold{TL2_IRREVOCABLE_AFTER};
+static std::atomic<int> tx_extend_enabled{1};
+
+static thread_local TransactionContext* tls_tx = nullptr;
+static thread_local uint32_t tls_epoch = 0;
+
+// Gives the thread's slice back to the arena when the thread exits.
+struct TxThreadGuard{
+    int armed;
+    ~TxThreadGuard(){ if (armed) tx_thread_exit(); }
+};
+static thread_local TxThreadGuard tls_guard;
+
+// End of a transaction on the allocator side: a commit retires what it
+// freed, an abort returns what it allocated. Both also withdraw the snapshot
+// a read-only transaction announced to the version history.
+static inline void tx_alloc_commit(TransactionContext* tx){
+    AllocState* st = alloc_slice(tx->slice);
+    for (uint32_t i = 0; i < st->freed_count; i++)
+        alloc_retire(tx->slice, st->freed[i]);
+    st->fresh_count = 0;
+    st->freed_count = 0;
+    alloc_leave(tx->slice);
+    if (tx->read_only) mv_leave(tx->slice);
+}
+
+static inline void tx_alloc_abort(TransactionContext* tx){
+    AllocState* st = alloc_slice(tx->slice);
+    for (uint32_t i = 0; i < st->fresh_count; i++)
+        alloc_release(tx->slice, st->fresh[i]);
+    st->fresh_count = 0;
+    st->freed_count = 0;
+    alloc_leave(tx->slice);
+    if (tx->read_only) mv_leave(tx->slice);
+}
+
+// Conflict abort: the next tx_begin is a retry. Inside a closed nested
+// level the allocation logs are kept for tx_retry_nested to cut back.
+static inline void tx_fail(TransactionContext* tx, int cause){
+    tx->status = ABORTED;
+    tx->retry = 1;
+    if (!tx->nest_top) tx_alloc_abort(tx);
+    TX_STAT(stats_add(&stats_slice(tx->slice)->aborts[cause], 1));
+}
+
+// A write or free inside a read-only transaction.
+static inline int tx_fail_readonly(TransactionContext* tx){
+    tx->status = ABORTED;
+    tx_alloc_abort(tx);
+    TX_STAT(stats_add(&stats_slice(tx->slice)->aborts[STATS_ABORT_USER], 1));
+    return -2;
+}
+
+static inline void tx_count_commit(TransactionContext* tx){
+#if TL2_STATS
+    TxStats* st = stats_slice(tx->slice);
+    stats_add(&st->commits, 1);
+    if (tx->read_only){
+        stats_add(&st->readonly_commits, 1);
+        stats_add(&st->rs_hist[0], 1);
+        stats_add(&st->ws_hist[0], 1);
+    } else {
+        stats_add(&st->rs_hist[stats_bucket(tx->rs.count)], 1);
+        stats_add(&st->ws_hist[stats_bucket(tx->ws.count)], 1);
+    }
+#else
+    (void)tx;
+#endif
+}
+
+int tx_init(int try_huge_pages){
+    return tx_init_threads(try_huge_pages, MAX_THREADS);
+}
+
+int tx_init_threads(int try_huge_pages, uint32_t max_threads){
+    gvc_init();
+    vlock_init();
+    if (arena_init_threads(try_huge_pages, max_threads) != 0) return -1;
+
+    tx_epoch.fetch_add(1, std::memory_order_acq_rel);
+    return 0;
+}
+
+void tx_shutdown(){
+    mv_disable();
+    alloc_destroy();
+    arena_destroy();
+    tx_epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+static TransactionContext* tx_context_init(char* slice){
+    TransactionContext* tx = new (slice + TX_CTX_OFFSET) TransactionContext();
+    tx->slice = slice;
+    tx->status = COMMITTED;
+    tx->read_version = 0;
+    tx->read_only = 0;
+    tx->retry = 0;
+    tx->irrevocable = 0;
+    tx->borrowed = 0;
+    tx->committing.store(0, std::memory_order_relaxed);
+    tx->depth = 0;
+    tx->nest_top = 0;
+    cm_init(&tx->cm, (uint64_t)(uintptr_t)slice);
+    writeset_init(&tx->ws, slice);
+    readset_init(&tx->rs, slice);
+    return tx;
+}
+
+TransactionContext* tx_thread_init(){
+    uint32_t epoch = tx_epoch.load(std::memory_order_acquire);
+    if (tls_tx && tls_epoch == epoch) return tls_tx;
+
+    char* slice = arena_register_thread();
+    if (!slice) return nullptr;
+
+    TransactionContext* tx = tx_context_init(slice);
+    tls_tx = tx;
+    tls_epoch = epoch;
+    tls_guard.armed = 1;
+    return tx;
+}
+
+void tx_thread_exit(){
+    if (!tls_tx) return;
+
+    // After a tx_shutdown the slice (and the spill pointer in it) is gone.
+    if (tls_epoch == tx_epoch.load(std::memory_order_acquire)){
+        tx_abort(tls_tx);
+        writeset_destroy(&tls_tx->ws);
+        arena_release_thread(tls_tx->slice);
+    }
+
+    tls_tx = nullptr;
+}
+
+// A slice comes back from the arena as its last owner left it, and the
+// arena is mapped zeroed, so a context whose slice field points at its own
+// slice was set up since tx_init and its write-set index is still valid:
+// only the per-owner state is reset, which keeps a borrow per attempt cheap.
+TransactionContext* tx_context_borrow(){
+    char* slice = arena_register_thread();
+    if (!slice) return nullptr;
+
+    TransactionContext* tx = (TransactionContext*)(slice + TX_CTX_OFFSET);
+    if (tx->slice != slice){
+        tx = tx_context_init(slice);
+    } else {
+        tx->status = COMMITTED;
+        tx->read_only = 0;
+        tx->retry = 0;
+        tx->depth = 0;
+        tx->nest_top = 0;
+        cm_init(&tx->cm, (uint64_t)(uintptr_t)slice);
+    }
+    tx->borrowed = 1;
+    return tx;
+}
+
+int tx_context_return(TransactionContext* tx){
+    if (!tx || !tx->borrowed) return -1;
+
+    while (tx->status == ACTIVE) tx_abort(tx);
+    writeset_destroy(&tx->ws);
+    tx->borrowed = 0;
+    return arena_release_thread(tx->slice);
+}
+
+// Waiting on the token or on a committer can take a whole transaction, so
+// stop burning the CPU after a short spin.
+static inline void tx_pause(uint32_t* spins){
+    if (++*spins < CM_SPIN_BUDGET) cpu_relax();
+    else sched_yield();
+}
+
+// Takes the token, then waits until no speculative commit can still be
+// writing memory. A committer raises its flag before checking the token
+// (tx_commit_enter), so with both sides seq_cst one of them sees the other.
+static void tx_irrevocable_enter(TransactionContext* tx){
+    uint32_t free_token = 0, spins = 0;
+    while (!tx_token.compare_exchange_weak(free_token, 1, std::memory_order_seq_cst)){
+        free_token = 0;
+        tx_pause(&spins);
+    }
+
+    for (int slot = 0; slot < arena_max_threads(); slot++){
+        char* slice = arena_slot_slice(slot);
+        if (!slice) continue;
+
+        TransactionContext* other = (TransactionContext*)(slice + TX_CTX_OFFSET);
+        while (other->committing.load(std::memory_order_seq_cst))
+            tx_pause(&spins);
+    }
+
+    tx->irrevocable = 1;
+}
+
+// Publishes the in-place writes under a new version and hands the token on.
+// The write set holds one entry per stripe taken (see tx_write).
+static void tx_irrevocable_exit(TransactionContext* tx){
+    if (tx->ws.count){
+        int unique = 0;
+        uint64_t wv = gvc_commit_version(&unique);
+        if (mv_enabled()) mv_raise_floor(wv);
+        WriteEntry** entries = writeset_entries(&tx->ws);
+        for (uint16_t i = 0; i < tx->ws.count; i++)
+            vlock_release(entries[i]->lock, wv);
+    }
+
+    tx->irrevocable = 0;
+    tx_token.store(0, std::memory_order_seq_cst);
+}
+
+// Speculative committers stay out while an irrevocable transaction runs.
+static void tx_commit_enter(TransactionContext* tx){
+    uint32_t spins = 0;
+    while (true){
+        tx->committing.store(1, std::memory_order_seq_cst);
+        if (!tx_token.load(std::memory_order_seq_cst)) return;
+
+        tx->committing.store(0, std::memory_order_release);
+        while (tx_token.load(std::memory_order_acquire))
+            tx_pause(&spins);
+    }
+}
+
+static inline void tx_commit_exit(TransactionContext* tx){
+    tx->committing.store(0, std::memory_order_release);
+}
+
+static void tx_start(TransactionContext* tx, int read_only, int irrevocable){
+    if (tx->nest_top){
+        if (tx->status == ABORTED) tx_alloc_abort(tx);
+        tx->nest_top = 0;
+    }
+    tx->depth = 0;
+
+    if (tx->irrevocable){
+        tx_irrevocable_exit(tx);
+        tx_alloc_commit(tx);
+    }
+
+    if (tx->retry){
+        if (tx->borrowed) tx->cm.attempts++;
+        else cm_on_abort(&tx->cm, read_only ? 0 : tx->ws.count + tx->rs.count);
+        tx->retry = 0;
+
+        uint32_t after = tx_irrevocable_threshold.load(std::memory_order_relaxed);
+        if (after && tx->cm.attempts >= after) irrevocable = 1;
+    }
+
+    if (!read_only || irrevocable){
+        writeset_reset(&tx->ws);
+        readset_reset(&tx->rs);
+    }
+    if (irrevocable) tx_irrevocable_enter(tx);
+
+    alloc_enter(tx->slice);
+    if (read_only && !irrevocable && mv_enabled()) mv_enter(tx->slice);
+    tx->read_version = gvc_read();
+    tx->read_only = read_only;
+    tx->status = ACTIVE;
+}
+
+int tx_begin(TransactionContext* tx){
+    if (!tx) return -1;
+    if (tx->status == ACTIVE){
+        tx->depth++;
+        return 0;
+    }
+    tx_start(tx, 0, 0);
+    return 0;
+}
+
+int tx_begin_readonly(TransactionContext* tx){
+    if (!tx) return -1;
+    if (tx->status == ACTIVE){
+        tx->depth++;
+        return 0;
+    }
+    tx_start(tx, 1, 0);
+    return 0;
+}
+
+int tx_begin_irrevocable(TransactionContext* tx){
+    if (!tx) return -1;
+    if (tx->status == ACTIVE){
+        if (!tx->irrevocable) return -1;
+        tx->depth++;
+        return 0;
+    }
+    tx_start(tx, 0, 1);
+    return 0;
+}
+
+int tx_begin_closed(TransactionContext* tx){
+    if (!tx) return -1;
+    if (tx->status != ACTIVE){
+        tx_start(tx, 0, 0);
+        return 0;
+    }
+
+    tx->depth++;
+    if (tx->read_only || tx->irrevocable || tx->nest_top == TX_NEST_MAX) return 0;
+
+    AllocState* st = alloc_slice(tx->slice);
+    TxCheckpoint* cp = &tx->nest[tx->nest_top++];
+    cp->ws_count = tx->ws.count;
+    cp->rs_count = tx->rs.count;
+    cp->fresh_count = (uint16_t)st->fresh_count;
+    cp->freed_count = (uint16_t)st->freed_count;
+    cp->depth = tx->depth;
+    cp->retries = 0;
+    tx->ws.floor = tx->ws.count;
+    return 0;
+}
+
+// Undoes everything logged since cp; the level stays open.
+static void tx_nest_rollback(TransactionContext* tx, const TxCheckpoint* cp){
+    AllocState* st = alloc_slice(tx->slice);
+    for (uint32_t i = cp->fresh_count; i < st->fresh_count; i++)
+        alloc_release(tx->slice, st->fresh[i]);
+    st->fresh_count = cp->fresh_count;
+    st->freed_count = cp->freed_count;
+
+    if (tx->ws.count != cp->ws_count) writeset_truncate(&tx->ws, cp->ws_count);
+    tx->rs.count = cp->rs_count;
+    tx->depth = cp->depth;
+}
+
+// Closes the innermost level, dropping its checkpoint if it has one.
+static void tx_nest_close(TransactionContext* tx){
+    if (tx->nest_top && tx->nest[tx->nest_top - 1].depth == tx->depth){
+        tx->nest_top--;
+        tx->ws.floor = tx->nest_top ? tx->nest[tx->nest_top - 1].ws_count : 0;
+    }
+    tx->depth--;
+}
+
+int tx_retry_nested(TransactionContext* tx){
+    if (!tx || tx->status == ACTIVE) return -1;
+
+    if (tx->status == ABORTED && tx->retry && tx->nest_top){
+        TxCheckpoint* cp = &tx->nest[tx->nest_top - 1];
+        if (++cp->retries <= TL2_NEST_RETRIES){
+            tx_nest_rollback(tx, cp);
+
+            // Reads older than the checkpoint still at or below the old
+            // snapshot have not changed, so they hold at the new one too.
+            uint64_t rv = gvc_read();
+            if (readset_validate(&tx->rs, tx->read_version) == 1){
+                tx->read_version = rv;
+                tx->status = ACTIVE;
+                tx->retry = 0;
+                TX_STAT(stats_add(&stats_slice(tx->slice)->nested_retries, 1));
+                return 0;
+            }
+        }
+    }
+
+    // The whole transaction restarts: drop what tx_fail left for us.
+    if (tx->nest_top){
+        if (tx->status == ABORTED) tx_alloc_abort(tx);
+        tx->nest_top = 0;
+        tx->ws.floor = 0;
+    }
+    tx->depth = 0;
+    return -1;
+}
+
+void tx_set_irrevocable_after(uint32_t aborts){
+    tx_irrevocable_threshold.store(aborts, std::memory_order_relaxed);
+}
+
+uint32_t tx_irrevocable_after(){
+    return tx_irrevocable_threshold.load(std::memory_order_relaxed);
+}
+
+void tx_set_snapshot_extension(int enabled){
+    tx_extend_enabled.store(enabled != 0, std::memory_order_relaxed);
+}
+
+int tx_snapshot_extension(){
+    return tx_extend_enabled.load(std::memory_order_relaxed);
+}
+
+// Moves read_version up to cover `version`. The clock is sampled before the
+// read set is checked against the old snapshot: a commit that could still
+// take a version at or below the new one already holds its locks, so it
+// fails the check.
+static int tx_extend(TransactionContext* tx, uint64_t version){
+    if (tx->read_only || !tx_extend_enabled.load(std::memory_order_relaxed)) return 0;
+
+    gvc_observe(version);
+    uint64_t rv = gvc_read();
+    if (version > rv || readset_validate(&tx->rs, tx->read_version) != 1) return 0;
+
+    tx->read_version = rv;
+    TX_STAT(stats_add(&stats_slice(tx->slice)->extensions, 1));
+    return 1;
+}
+
+// TL2 post-read validation: the stripe must be unlocked, unchanged across
+// the copy and no newer than our snapshot; a newer one is retried if the
+// snapshot can be extended to it.
+// Read-only transactions check it inline and log nothing; with the version
+// history on, they fall back to it instead of aborting.
+int tx_read_check(TransactionContext* tx, void* addr, void* dst, size_t size,
+                  std::atomic<uint64_t>* lock, uint64_t pre){
+    uint64_t post = lock->load(std::memory_order_relaxed);
+
+    // Under GV5/GV6 a commit that read the clock before we moved it can
+    // rewrite the stripe at the same version after our copy, so a read that
+    // extends the snapshot is redone rather than trusted.
+    if (!(pre & 1ULL) && pre == post && (pre >> 1) > tx->read_version &&
+        tx_extend(tx, pre >> 1))
+        return TX_READ_RETRY;
+
+    if ((pre & 1ULL) || pre != post || (pre >> 1) > tx->read_version){
+        if (tx->read_only && mv_enabled() &&
+            mv_read(addr, dst, size, tx->read_version, !((pre | post) & 1ULL) && pre == post)){
+            TX_STAT(stats_add(&stats_slice(tx->slice)->mv_reads, 1));
+            return 0;
+        }
+
+        int cause = ((pre | post) & 1ULL) ? STATS_ABORT_READ_LOCKED : STATS_ABORT_READ_VALIDATE;
+        gvc_observe(pre >> 1);
+        profile_record(cause, lock, addr);
+        tx_fail(tx, cause);
+        return -1;
+    }
+
+    if (!tx->read_only && readset_add(&tx->rs, lock) != 0){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return -1;
+    }
+
+    return 0;
+}
+
+// addr's newest write-set entry is a deferred operation (tx_commute). Its
+// value is the log for addr replayed in order on top of the last plain
+// write to it, or of memory (a logged, validated read) if there is none;
+// it is kept as a plain write so that later reads and writes see it.
+static int tx_read_pending(TransactionContext* tx, void* addr, void* dst, size_t size){
+    WriteEntry** entries = writeset_entries(&tx->ws);
+    uint16_t first = tx->ws.count;
+    while (first > 0 && !(entries[first - 1]->addr == addr && entries[first - 1]->op == WS_OP_WRITE))
+        first--;
+
+    uint64_t cur = 0;
+    if (first == 0){
+        std::atomic<uint64_t>* lock = vlock_ptr(addr);
+        int r;
+        do {
+            uint64_t pre = lock->load(std::memory_order_acquire);
+            cur = __atomic_load_n((uint64_t*)addr, __ATOMIC_RELAXED);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            r = tx_read_check(tx, addr, &cur, sizeof(cur), lock, pre);
+        } while (r == TX_READ_RETRY);
+        if (r != 0) return -1;
+    } else {
+        first--;
+    }
+
+    for (uint16_t i = first; i < tx->ws.count; i++){
+        if (entries[i]->addr != addr) continue;
+        uint64_t operand;
+        memcpy(&operand, entries[i]->buf, sizeof(operand));
+        cur = writeset_apply(entries[i]->op, cur, operand);
+    }
+
+    if (writeset_add(&tx->ws, addr, &cur, sizeof(cur)) != 0){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return -1;
+    }
+    memcpy(dst, &cur, size < sizeof(cur) ? size : sizeof(cur));
+    return 0;
+}
+
+int tx_read(TransactionContext* tx, void* addr, void* dst, size_t size){
+    TL2_ARG_CHECK(tx && addr && dst, -1);
+    if (tx->status != ACTIVE) return -1;
+
+    // Nothing else writes memory while we hold the token; our own writes
+    // are already in place.
+    if (tx->irrevocable){
+        memcpy(dst, addr, size);
+        return 0;
+    }
+
+    WriteEntry* e = nullptr;
+    if (!tx->read_only && tx->ws.count){
+        TX_STAT(stats_add(&stats_slice(tx->slice)->ws_lookups, 1));
+        if (writeset_lookup(&tx->ws, addr, &e) == 1){
+            if (e->op != WS_OP_WRITE) return tx_read_pending(tx, addr, dst, size);
+            memcpy(dst, e->buf, size < e->size ? size : e->size);
+            return 0;
+        }
+    }
+
+    std::atomic<uint64_t>* lock = vlock_ptr(addr);
+
+    int r;
+    do {
+        uint64_t pre = lock->load(std::memory_order_acquire);
+        memcpy(dst, addr, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        r = tx_read_check(tx, addr, dst, size, lock, pre);
+    } while (r == TX_READ_RETRY);
+    return r;
+}
+
+int tx_write(TransactionContext* tx, void* addr, const void* src, size_t size){
+    TL2_ARG_CHECK(tx, -1);
+    if (tx->status != ACTIVE) return -1;
+
+    if (tx->read_only) return tx_fail_readonly(tx);
+
+    if (tx->irrevocable){
+        // A locked stripe can only be one we took: speculative commits and
+        // other irrevocable transactions are held off. The write set just
+        // remembers each stripe taken, for release at the end.
+        std::atomic<uint64_t>* lock = vlock_ptr(addr);
+        if (!vlock_is_locked(lock)){
+            if (writeset_add(&tx->ws, addr, src, size) != 0) return -1;
+            vlock_acquire(lock);
+        }
+        memcpy(addr, src, size);
+        return 0;
+    }
+
+    if (writeset_add(&tx->ws, addr, src, size) != 0){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return -1;
+    }
+
+    return 0;
+}
+
+int tx_commute(TransactionContext* tx, uint64_t* addr, uint32_t op, uint64_t operand){
+    if (!tx || !addr || ((uintptr_t)addr & 7) || op == WS_OP_WRITE || op > WS_OP_OR) return -1;
+    if (tx->status != ACTIVE) return -1;
+
+    if (tx->read_only) return tx_fail_readonly(tx);
+
+    // In place, as tx_write does: the stripe is ours until the end.
+    if (tx->irrevocable){
+        std::atomic<uint64_t>* lock = vlock_ptr(addr);
+        if (!vlock_is_locked(lock)){
+            if (writeset_add(&tx->ws, addr, &operand, sizeof(operand)) != 0) return -1;
+            vlock_acquire(lock);
+        }
+        __atomic_store_n(addr, writeset_apply(op, __atomic_load_n(addr, __ATOMIC_RELAXED), operand),
+                         __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    // After a plain write or another operation on addr the two do not
+    // merge: settle the value now (a read, see tx_read_pending) and write it.
+    WriteEntry* e = nullptr;
+    if (tx->ws.count && writeset_lookup(&tx->ws, addr, &e) == 1 && e->op != op){
+        uint64_t cur;
+        if (tx_read(tx, addr, &cur, sizeof(cur)) != 0) return -1;
+        cur = writeset_apply(op, cur, operand);
+        return tx_write(tx, addr, &cur, sizeof(cur));
+    }
+
+    uint32_t prev;
+    char* buf = writeset_reserve_op(&tx->ws, addr, sizeof(uint64_t), op, &prev);
+    if (!buf){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return -1;
+    }
+
+    uint64_t v = operand;
+    if (prev == op){
+        memcpy(&v, buf, sizeof(v));
+        v = writeset_apply(op, v, operand);
+    }
+    memcpy(buf, &v, sizeof(v));
+    return 0;
+}
+
+int tx_add(TransactionContext* tx, uint64_t* addr, uint64_t delta){
+    return tx_commute(tx, addr, WS_OP_ADD, delta);
+}
+
+int tx_min(TransactionContext* tx, uint64_t* addr, uint64_t v){
+    return tx_commute(tx, addr, WS_OP_MIN, v);
+}
+
+int tx_max(TransactionContext* tx, uint64_t* addr, uint64_t v){
+    return tx_commute(tx, addr, WS_OP_MAX, v);
+}
+
+int tx_or(TransactionContext* tx, uint64_t* addr, uint64_t bits){
+    return tx_commute(tx, addr, WS_OP_OR, bits);
+}
+
+// Collects the write set's stripes, sorted and deduplicated, so that entries
+// sharing a stripe take it once and concurrent committers acquire in the same
+// global order. Returns the number of distinct stripes, or -1 if there is no
+// room for the list.
+static int tx_collect_locks(TransactionContext* tx, std::atomic<uint64_t>*** out){
+    std::atomic<uint64_t>** locks = writeset_lock_buffer(&tx->ws, tx->ws.count);
+    if (!locks) return -1;
+
+    WriteEntry** entries = writeset_entries(&tx->ws);
+    for (uint16_t i = 0; i < tx->ws.count; i++)
+        locks[i] = entries[i]->lock;
+
+    std::sort(locks, locks + tx->ws.count);
+    *out = locks;
+    return (int)(std::unique(locks, locks + tx->ws.count) - locks);
+}
+
+// Profiler only: an address in the write set guarded by `lock`.
+static void* tx_lock_addr(TransactionContext* tx, std::atomic<uint64_t>* lock){
+    WriteEntry** entries = writeset_entries(&tx->ws);
+    for (uint16_t i = 0; i < tx->ws.count; i++)
+        if (entries[i]->lock == lock) return entries[i]->addr;
+    return nullptr;
+}
+
+int tx_commit(TransactionContext* tx){
+    if (!tx || tx->status != ACTIVE) return 0;
+
+    if (tx->depth){
+        tx_nest_close(tx);
+        return 1;
+    }
+
+    WriteSet* ws = &tx->ws;
+
+    if (tx->irrevocable){
+        TX_STAT(stats_add(&stats_slice(tx->slice)->irrevocable_commits, 1));
+        tx_count_commit(tx);
+        tx_irrevocable_exit(tx);
+        tx_alloc_commit(tx);
+        tx->status = COMMITTED;
+        cm_on_commit(&tx->cm);
+        return 1;
+    }
+
+    // Reads were validated as they happened, so a read-only transaction is
+    // already serialized at read_version.
+    if (tx->read_only || ws->count == 0){
+        tx_alloc_commit(tx);
+        tx->status = COMMITTED;
+        tx_count_commit(tx);
+        cm_on_commit(&tx->cm);
+        return 1;
+    }
+
+    tx_commit_enter(tx);
+
+    std::atomic<uint64_t>** locks = nullptr;
+    int collected = tx_collect_locks(tx, &locks);
+    if (collected < 0){
+        tx_commit_exit(tx);
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return 0;
+    }
+    uint16_t n = (uint16_t)collected;
+
+    // Bounded spins on each stripe; the contention manager decides whether
+    // to keep waiting or to give everything back and abort. A borrowed
+    // context aborts after the first round, its owner backs off instead.
+    uint32_t spun = 0;
+    for (uint16_t i = 0; i < n; i++){
+        uint32_t tries = 0;
+        while (!vlock_try_acquire_counted(locks[i], CM_SPIN_BUDGET, &spun)){
+            if (tx->borrowed || !cm_on_busy(&tx->cm, ++tries, locks[i])){
+                for (uint16_t j = 0; j < i; j++)
+                    vlock_release(locks[j], vlock_get_version(locks[j]));
+                TX_STAT(stats_add(&stats_slice(tx->slice)->lock_spins, spun));
+                if (profile_active())
+                    profile_record(STATS_ABORT_COMMIT_LOCKED, locks[i], tx_lock_addr(tx, locks[i]));
+                tx_commit_exit(tx);
+                tx_fail(tx, STATS_ABORT_COMMIT_LOCKED);
+                return 0;
+            }
+        }
+        if (cm_policy == CM_POLKA) cm_publish(&tx->cm, locks[i]);
+    }
+    TX_STAT(stats_add(&stats_slice(tx->slice)->lock_spins, spun));
+
+    int unique = 0;
+    uint64_t wv = gvc_commit_version(&unique);
+
+    // If nobody committed since we began, the read set cannot have changed.
+    if (!(unique && wv == tx->read_version + 1) &&
+        readset_validate_owned(&tx->rs, tx->read_version, locks, n) != 1){
+        if (profile_active())
+            profile_record(STATS_ABORT_COMMIT_VALIDATE,
+                           readset_find_invalid(&tx->rs, tx->read_version, locks, n), nullptr);
+        for (uint16_t i = 0; i < n; i++)
+            vlock_release(locks[i], vlock_get_version(locks[i]));
+        tx_commit_exit(tx);
+        tx_fail(tx, STATS_ABORT_COMMIT_VALIDATE);
+        return 0;
+    }
+
+    WriteEntry** entries = writeset_entries(ws);
+    if (mv_enabled()){
+        for (uint16_t i = 0; i < ws->count; i++)
+            mv_record(entries[i]->addr, entries[i]->size, wv);
+    }
+    for (uint16_t i = 0; i < ws->count; i++){
+        WriteEntry* e = entries[i];
+        if (e->op == WS_OP_WRITE){
+            memcpy(e->addr, e->buf, e->size);
+            continue;
+        }
+
+        // Deferred operation: nobody else can write the word while we hold
+        // its stripe.
+        uint64_t* word = (uint64_t*)e->addr;
+        uint64_t operand;
+        memcpy(&operand, e->buf, sizeof(operand));
+        __atomic_store_n(word, writeset_apply(e->op, __atomic_load_n(word, __ATOMIC_RELAXED), operand),
+                         __ATOMIC_RELAXED);
+    }
+
+    for (uint16_t i = 0; i < n; i++)
+        vlock_release(locks[i], wv);
+    tx_commit_exit(tx);
+    tx_alloc_commit(tx);
+
+    tx->status = COMMITTED;
+    tx_count_commit(tx);
+    cm_on_commit(&tx->cm);
+    return 1;
+}
+
+void tx_abort(TransactionContext* tx){
+    if (!tx || tx->status != ACTIVE) return;
+
+    if (tx->nest_top && tx->nest[tx->nest_top - 1].depth == tx->depth){
+        tx_nest_rollback(tx, &tx->nest[tx->nest_top - 1]);
+        tx_nest_close(tx);
+        return;
+    }
+    tx->depth = 0;
+    tx->nest_top = 0;
+    tx->ws.floor = 0;
+
+    // Irrevocable writes stay, so its allocations and frees stand too.
+    if (tx->irrevocable){
+        tx_irrevocable_exit(tx);
+        tx_alloc_commit(tx);
+    } else {
+        tx_alloc_abort(tx);
+    }
+    tx->status = ABORTED;
+    TX_STAT(stats_add(&stats_slice(tx->slice)->aborts[STATS_ABORT_USER], 1));
+}
+
+void* tx_malloc(TransactionContext* tx, size_t size){
+    if (!tx || tx->status != ACTIVE) return nullptr;
+
+    if (tx->irrevocable) return alloc_block(tx->slice, size);
+
+    AllocState* st = alloc_slice(tx->slice);
+    void* p = st->fresh_count < ALLOC_LOG_MAX ? alloc_block(tx->slice, size) : nullptr;
+    if (!p){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return nullptr;
+    }
+
+    st->fresh[st->fresh_count++] = p;
+    return p;
+}
+
+int tx_free(TransactionContext* tx, void* p){
+    if (!tx || tx->status != ACTIVE) return -1;
+    if (!p) return 0;
+    if (tx->read_only) return tx_fail_readonly(tx);
+
+    if (tx->irrevocable){
+        alloc_retire(tx->slice, p);
+        return 0;
+    }
+
+    AllocState* st = alloc_slice(tx->slice);
+    if (st->freed_count == ALLOC_LOG_MAX){
+        tx_fail(tx, STATS_ABORT_OVERFLOW);
+        return -1;
+    }
+
+    st->freed[st->freed_count++] = p;
+    return 0;
+}
+
+void* tx_malloc_private(size_t size){
+    TransactionContext* tx = tx_thread_init();
+    return tx ? alloc_block(tx->slice, size) : nullptr;
+}
+
+void tx_free_private(void* p){
+    TransactionContext* tx = tx_thread_init();
+    if (tx) alloc_release(tx->slice, p);
+}
+
+int tl2_kcas(size_t n, uint64_t* const addrs[], const uint64_t expected[],
+             const uint64_t desired[]){
+    if (n == 0 || n > KCAS_MAX || !addrs || !expected || !desired) return -1;
+
+    TransactionContext* tx = tx_thread_init();
+    if (!tx || tx->status == ACTIVE) return -1;
+
+    // Sorted, deduplicated stripes; n is small, so insertion sort.
+    std::atomic<uint64_t>* locks[KCAS_MAX];
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++){
+        std::atomic<uint64_t>* lock = vlock_ptr(addrs[i]);
+        size_t j = m;
+        while (j > 0 && locks[j - 1] > lock) j--;
+        if (j > 0 && locks[j - 1] == lock) continue;
+        memmove(&locks[j + 1], &locks[j], (m - j) * sizeof(locks[0]));
+        locks[j] = lock;
+        m++;
+    }
+
+    // Holders are committers that never wait for us, so plain spinning in
+    // global order cannot deadlock.
+    tx_commit_enter(tx);
+    for (size_t i = 0; i < m; i++){
+        uint32_t spins = 0;
+        while (!vlock_try_acquire(locks[i], CM_SPIN_BUDGET))
+            tx_pause(&spins);
+    }
+
+    int match = 1;
+    for (size_t i = 0; i < n && match; i++)
+        match = __atomic_load_n(addrs[i], __ATOMIC_RELAXED) == expected[i];
+
+    if (!match){
+        for (size_t i = 0; i < m; i++)
+            vlock_release(locks[i], vlock_get_version(locks[i]));
+        tx_commit_exit(tx);
+        return 0;
+    }
+
+    int unique = 0;
+    uint64_t wv = gvc_commit_version(&unique);
+    if (mv_enabled()){
+        for (size_t i = 0; i < n; i++)
+            mv_record(addrs[i], sizeof(uint64_t), wv);
+    }
+    for (size_t i = 0; i < n; i++)
+        __atomic_store_n(addrs[i], desired[i], __ATOMIC_RELAXED);
+    for (size_t i = 0; i < m; i++)
+        vlock_release(locks[i], wv);
+    tx_commit_exit(tx);
+    return 1;
+}
@@ -1,20 +1,128 @@
 // tset.cpp
 // Author: Anurag Choubey
 
+#include <sys/mman.h>
+#include <algorithm>
 #include <cstring>
+#define TL2_TSET_IMPL
 #include "tset.h"
 #include "arena.h"
+#include "stats.h"
 
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static_assert(sizeof(PtrFilter) <= BLOOM_BYTES_SZ, "PtrFilter does not fit in its slice region");
+
+
+void ptrfilter_reset(PtrFilter* f){
+    uint64_t dirty = f->dirty;
+    while (dirty){
+        f->words[__builtin_ctzll(dirty)] = 0;
+        dirty &= dirty - 1;
+    }
+    f->dirty = 0;
+}
+
+void ptrfilter_add(PtrFilter* f, void* addr){
+    uint64_t h = ptrfilter_hash(addr);
+    uint32_t a = (uint32_t)(h >> 54);
+    uint32_t b = (uint32_t)(h >> 44) & 1023;
+
+    f->words[a >> 6] |= 1ULL << (a & 63);
+    f->words[b >> 6] |= 1ULL << (b & 63);
+    f->dirty |= (1ULL << (a >> 6)) | (1ULL << (b >> 6));
+}
+
+static inline size_t align8(size_t n){
+    return (n + 7) & ~(size_t)7;
+}
+
+// Bump allocation from the thread's spill area, reserved on first use.
+static char* writeset_spill_alloc(WriteSet* set, size_t bytes){
+    if (!set->spill){
+        void* mem = mmap(nullptr, WS_SPILL_BYTES,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                         -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        set->spill = (char*)mem;
+        set->spill_used = 0;
+    }
+
+    bytes = align8(bytes);
+    if (set->spill_used + bytes > WS_SPILL_BYTES) return nullptr;
+
+    char* p = set->spill + set->spill_used;
+    set->spill_used += bytes;
+    return p;
+}
+
+// Keeps the index at most half full by rehashing into a table twice the
+// size, and the entry table large enough for one more entry.
+static int writeset_grow(WriteSet* set){
+    if ((uint32_t)set->count + 1 > (1U << set->index_bits) / 2){
+        uint8_t bits = set->index_bits + 1;
+        uint32_t* index = (uint32_t*)writeset_spill_alloc(set, sizeof(uint32_t) << bits);
+        if (!index) return -1;
+        memset(index, 0, sizeof(uint32_t) << bits);
+
+        set->index = index;
+        set->index_bits = bits;
+        for (uint32_t i = 0; i < set->count; i++)
+            *writeset_probe(set, set->table[i]->addr) = ((uint32_t)set->gen << 16) | i;
+    }
+
+    if (set->count == set->table_cap){
+        uint32_t cap = (uint32_t)set->table_cap * 2;
+        if (cap > WS_MAX_ENTRIES) cap = WS_MAX_ENTRIES;
+        WriteEntry** table = (WriteEntry**)writeset_spill_alloc(set, cap * sizeof(WriteEntry*));
+        if (!table) return -1;
+
+        memcpy(table, set->table, set->count * sizeof(WriteEntry*));
+        set->table = table;
+        set->table_cap = (uint16_t)cap;
+    }
+
+    return 0;
+}
+
+// Carves `bytes` from the in-slice log, or from the spill area once the
+// slice log is full.
+static char* writeset_log_alloc(WriteSet* set, size_t bytes){
+    bytes = align8(bytes);
+    if (set->log_cur + bytes <= set->log_end){
+        char* p = set->log_cur;
+        set->log_cur += bytes;
+        return p;
+    }
+    return writeset_spill_alloc(set, bytes);
+}
 
 int writeset_init(WriteSet* set, char* slice_base){
     if (!set || !slice_base) return -1;
 
     set->base = slice_base;
-    set->count = 0;
+    set->floor = 0;
+    set->gen = 1;
+    set->spill = nullptr;
+    set->spill_used = 0;
+    set->spill_high = 0;
+    set->spill_idle = 0;
 
-    memset(set->base + WS_KEYS_OFFSET, 0, WS_KEYS_BYTES);
+    memset(set->base + WS_INDEX_OFFSET, 0, WS_INDEX_BYTES);
 
-    bloom_init2(&set->bf, 1024, 0.01);
+    set->filter = (PtrFilter*)(set->base + BLOOM_OFFSET);
+    memset(set->filter, 0, sizeof(PtrFilter));
+
+    set->count = 0;
+    set->table = (WriteEntry**)(set->base + WS_TABLE_OFFSET);
+    set->table_cap = WS_SLOTS;
+    set->index = (uint32_t*)(set->base + WS_INDEX_OFFSET);
+    set->index_bits = WS_INDEX_BITS;
+    set->log_cur = set->base + WS_LOG_OFFSET;
+    set->log_end = set->log_cur + WS_LOG_BYTES;
 
     return 0;
 }
@@ -23,59 +131,141 @@ int writeset_reset(WriteSet* set){
     if (!set) return -1;
 
     set->count = 0;
-    memset(set->base + WS_KEYS_OFFSET, 0, WS_KEYS_BYTES);
-    bloom_reset(&set->bf);
+    set->floor = 0;
+    if (++set->gen == 0){
+        memset(set->base + WS_INDEX_OFFSET, 0, WS_INDEX_BYTES);
+        set->gen = 1;
+    }
+    ptrfilter_reset(set->filter);
+
+    set->table = (WriteEntry**)(set->base + WS_TABLE_OFFSET);
+    set->table_cap = WS_SLOTS;
+    set->index = (uint32_t*)(set->base + WS_INDEX_OFFSET);
+    set->index_bits = WS_INDEX_BITS;
+    set->log_cur = set->base + WS_LOG_OFFSET;
+
+    // See WS_SPILL_KEEP: release only after the large write sets stop.
+    if (set->spill_used > set->spill_high) set->spill_high = set->spill_used;
+    if (set->spill_used > WS_SPILL_KEEP){
+        set->spill_idle = 0;
+    } else if (set->spill_high > WS_SPILL_KEEP && ++set->spill_idle >= WS_SPILL_IDLE){
+        madvise(set->spill + WS_SPILL_KEEP, set->spill_high - WS_SPILL_KEEP, MADV_DONTNEED);
+        set->spill_high = WS_SPILL_KEEP;
+        set->spill_idle = 0;
+    }
+    set->spill_used = 0;
 
     return 0;
 }
 
-int writeset_add(WriteSet* set, void* addr, void* src, size_t size){
-    if (!set || !addr || !src || size == 0 || size > INLINE_CAP) return -1;
-    if (set->count >= WS_SLOTS) return -1;
+void writeset_destroy(WriteSet* set){
+    if (!set || !set->spill) return;
 
-    void** keys = (void**)(set->base + WS_KEYS_OFFSET);
-    keys[set->count] = addr;
+    munmap(set->spill, WS_SPILL_BYTES);
+    set->spill = nullptr;
+    set->spill_used = 0;
+    set->spill_high = 0;
+    set->spill_idle = 0;
+}
 
-    WriteEntry* entries = (WriteEntry*)(set->base + WS_VALUES_OFFSET);
-    WriteEntry* e = &entries[set->count];
+char* writeset_reserve(WriteSet* set, void* addr, size_t size){
+    uint32_t prev;
+    return writeset_reserve_op(set, addr, size, WS_OP_WRITE, &prev);
+}
+
+char* writeset_reserve_op(WriteSet* set, void* addr, size_t size, uint32_t op, uint32_t* prev){
+    if (!set || !addr || size == 0 || size > WS_SPILL_BYTES) return nullptr;
+
+    uint32_t* slot = writeset_probe(set, addr);
+    *prev = WS_OP_NONE;
+
+    // Repeated write to the same address: reuse the entry, and its payload
+    // if it is big enough, unless it is frozen below the floor.
+    if ((*slot >> 16) == set->gen && (*slot & 0xFFFF) >= set->floor){
+        WriteEntry* e = set->table[*slot & 0xFFFF];
+        if (size > e->cap){
+            char* buf = size > INLINE_CAP ? writeset_spill_alloc(set, size)
+                                          : writeset_log_alloc(set, size);
+            if (!buf) return nullptr;
+            e->buf = buf;
+            e->cap = (uint32_t)align8(size);
+        }
+        e->size = (uint32_t)size;
+        *prev = e->op;
+        e->op = op;
+        return e->buf;
+    }
 
+    if (set->count >= WS_MAX_ENTRIES) return nullptr;
+    if (set->count == set->table_cap || (uint32_t)set->count + 1 > (1U << set->index_bits) / 2){
+        if (writeset_grow(set) != 0) return nullptr;
+        slot = writeset_probe(set, addr);
+    }
+
+    size_t inline_bytes = size > INLINE_CAP ? 0 : align8(size);
+    WriteEntry* e = (WriteEntry*)writeset_log_alloc(set, sizeof(WriteEntry) + inline_bytes);
+    if (!e) return nullptr;
+
+    if (inline_bytes){
+        e->buf = (char*)(e + 1);
+    } else {
+        e->buf = writeset_spill_alloc(set, size);
+        if (!e->buf) return nullptr;
+    }
+
+    e->addr = addr;
     e->lock = vlock_ptr(addr);
-    e->size = size;
-    memcpy(e->buf, src, size);
+    e->size = (uint32_t)size;
+    e->cap = (uint32_t)align8(size);
+    e->op = op;
 
-    bloom_add(&set->bf, &addr, sizeof(addr));
+    set->table[set->count] = e;
+    ptrfilter_add(set->filter, addr);
+    *slot = ((uint32_t)set->gen << 16) | set->count;
 
     set->count++;
-    return 0;
+    return e->buf;
 }
 
-int writeset_lookup(WriteSet* set, void* addr, WriteEntry** entry){
-    if (!set || !addr || !entry) return -1;
-    *entry = nullptr;
+int writeset_add(WriteSet* set, void* addr, const void* src, size_t size){
+    if (!src) return -1;
 
-    if (bloom_check(&set->bf, &addr, sizeof(addr)) == 0) return 0;
+    char* buf = writeset_reserve(set, addr, size);
+    if (!buf) return -1;
 
-    void** keys = (void**)(set->base + WS_KEYS_OFFSET);
-    WriteEntry* entries = (WriteEntry*)(set->base + WS_VALUES_OFFSET);
+    memcpy(buf, src, size);
+    return 0;
+}
 
-    for (uint16_t i = 0; i < set->count; i++){
-        if (keys[i] == addr){
-            *entry = &entries[i];
-            return 1;
-        }
+int writeset_truncate(WriteSet* set, uint16_t count){
+    if (!set || count > set->count) return -1;
+
+    set->count = count;
+    if (++set->gen == 0){
+        // The slice index is stale too if the index has moved to the spill.
+        memset(set->base + WS_INDEX_OFFSET, 0, WS_INDEX_BYTES);
+        memset(set->index, 0, sizeof(uint32_t) << set->index_bits);
+        set->gen = 1;
     }
+    ptrfilter_reset(set->filter);
 
+    // Later entries overwrite the slot of earlier ones for the same address.
+    for (uint16_t i = 0; i < count; i++){
+        *writeset_probe(set, set->table[i]->addr) = ((uint32_t)set->gen << 16) | i;
+        ptrfilter_add(set->filter, set->table[i]->addr);
+    }
     return 0;
 }
 
-void** writeset_keys(WriteSet* set){
+WriteEntry** writeset_entries(WriteSet* set){
     if (!set) return nullptr;
-    return (void**)(set->base + WS_KEYS_OFFSET);
+    return set->table;
 }
 
-WriteEntry* writeset_values(WriteSet* set){
+std::atomic<uint64_t>** writeset_lock_buffer(WriteSet* set, uint32_t n){
     if (!set) return nullptr;
-    return (WriteEntry*)(set->base + WS_VALUES_OFFSET);
+    if (n <= WS_SLOTS) return (std::atomic<uint64_t>**)(set->base + WS_LOCKS_OFFSET);
+    return (std::atomic<uint64_t>**)writeset_spill_alloc(set, n * sizeof(void*));
 }
 
 int readset_init(ReadSet* set, char* slice_base){
@@ -95,28 +285,74 @@ int readset_reset(ReadSet* set){
     return 0;
 }
 
-int readset_add(ReadSet* set, std::atomic<uint64_t>* lock){
-    if (!set || !lock) return -1;
-    if (set->count >= RS_MAX) return -1;
+// Loads each lock word in [i, i + RS_BATCH) once and reports whether any is
+// locked or newer than rv. The compare loop has no branches so it can be
+// vectorized.
+static inline int readset_batch_ok(ReadEntry* entries, uint16_t i, uint16_t count,
+                                   uint64_t rv){
+    for (uint16_t k = 0; k < RS_BATCH; k++){
+        if (i + RS_PREFETCH + k < count)
+            __builtin_prefetch(entries[i + RS_PREFETCH + k].lock, 0, 0);
+    }
 
-    ReadEntry* entries = (ReadEntry*)(set->base + RS_OFFSET);
-    entries[set->count].lock = lock;
+    uint64_t words[RS_BATCH];
+    for (uint16_t k = 0; k < RS_BATCH; k++)
+        words[k] = entries[i + k].lock->load(std::memory_order_relaxed);
 
-    set->count++;
-    return 0;
+    uint64_t bad = 0;
+    for (uint16_t k = 0; k < RS_BATCH; k++)
+        bad |= (words[k] & 1ULL) | (uint64_t)((words[k] >> 1) > rv);
+
+    return bad == 0;
+}
+
+static inline int readset_entry_ok(std::atomic<uint64_t>* lock, uint64_t rv,
+                                   std::atomic<uint64_t>** owned, uint16_t n_owned){
+    uint64_t w = lock->load(std::memory_order_relaxed);
+
+    if ((w & 1ULL) && !std::binary_search(owned, owned + n_owned, lock)) return 0;
+    return (w >> 1) <= rv;
 }
 
 int readset_validate(ReadSet* set, uint64_t rv){
+    return readset_validate_owned(set, rv, nullptr, 0);
+}
+
+// Commit-time validation: stripes in `owned` (sorted) are locked by the
+// caller, whose lock word still carries the pre-acquisition version. Batches
+// that trip the fast check are re-examined entry by entry for that case.
+int readset_validate_owned(ReadSet* set, uint64_t rv,
+                           std::atomic<uint64_t>** owned, uint16_t n_owned){
     if (!set) return -1;
 
     ReadEntry* entries = (ReadEntry*)(set->base + RS_OFFSET);
+    uint16_t count = set->count;
+    uint16_t i = 0;
 
-    for (uint16_t i = 0; i < set->count; i++){
-        std::atomic<uint64_t>* lock = entries[i].lock;
+    for (; i + RS_BATCH <= count; i += RS_BATCH){
+        if (readset_batch_ok(entries, i, count, rv)) continue;
+        if (n_owned == 0) return 0;
 
-        if (vlock_is_locked(lock)) return 0;
-        if (vlock_get_version(lock) > rv) return 0;
+        for (uint16_t k = 0; k < RS_BATCH; k++){
+            if (!readset_entry_ok(entries[i + k].lock, rv, owned, n_owned)) return 0;
+        }
+    }
+
+    for (; i < count; i++){
+        if (!readset_entry_ok(entries[i].lock, rv, owned, n_owned)) return 0;
     }
 
     return 1;
-}
\ No newline at end of file
+}
+
+std::atomic<uint64_t>* readset_find_invalid(ReadSet* set, uint64_t rv,
+                                            std::atomic<uint64_t>** owned, uint16_t n_owned){
+    if (!set) return nullptr;
+
+    ReadEntry* entries = (ReadEntry*)(set->base + RS_OFFSET);
+    for (uint16_t i = 0; i < set->count; i++){
+        if (!readset_entry_ok(entries[i].lock, rv, owned, n_owned)) return entries[i].lock;
+    }
+
+    return nullptr;
+}
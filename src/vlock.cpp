@@ -1,14 +1,72 @@
 // vlock.cpp
 
+#include <sys/mman.h>
+#include <cstring>
+#define TL2_VLOCK_IMPL
 #include "vlock.h"
 
-std::atomic<uint64_t>* lockMap = new std::atomic<uint64_t>[NUM_STRIPES]{}; // remember to cleanup upon program exit!!
+#ifdef __APPLE__
+#include <mach/vm_statistics.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+VLockConfig vlock_cfg = {NUM_STRIPES, 3, 1, 0, 0};
+size_t vlock_mask = NUM_STRIPES - 1;
+static size_t vlock_bytes = 0;
+
+int vlock_uses_huge_pages = 0;
+
+static std::atomic<uint64_t>* vlock_map(size_t bytes, int try_huge_pages){
+    void* mem = MAP_FAILED;
+    vlock_uses_huge_pages = 0;
+
+    if (try_huge_pages){
+#if defined(MAP_HUGETLB)
+        mem = mmap(nullptr, bytes,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1, 0);
+#elif defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+        mem = mmap(nullptr, bytes,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+#endif
+        if (mem != MAP_FAILED){
+            vlock_uses_huge_pages = 1;
+        }
+    }
+
+    if (mem == MAP_FAILED){
+        mem = mmap(nullptr, bytes,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+
+#ifdef MADV_HUGEPAGE
+        if (try_huge_pages){
+            madvise(mem, bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    vlock_bytes = bytes;
+    return (std::atomic<uint64_t>*)mem;
+}
+
+// Anonymous mappings come back zeroed: every stripe unlocked at version 0.
+std::atomic<uint64_t>* lockMap = vlock_map(NUM_STRIPES * LOCK_SIZE, 0);
 
 void vlock_acquire(std::atomic<uint64_t>* lock){
     uint64_t curr = lock->load(std::memory_order_acquire);
 
     while(true){
         if (curr & 1ULL){ // if lowest bit == 1
+            cpu_relax();
             curr = lock->load(std::memory_order_acquire);
             continue;
         }
@@ -21,33 +79,78 @@ void vlock_acquire(std::atomic<uint64_t>* lock){
     }  
 }
 
+int vlock_try_acquire(std::atomic<uint64_t>* lock, uint32_t spins){
+    uint32_t spun = 0;
+    return vlock_try_acquire_counted(lock, spins, &spun);
+}
+
+int vlock_try_acquire_counted(std::atomic<uint64_t>* lock, uint32_t spins, uint32_t* spun){
+    uint64_t curr = lock->load(std::memory_order_acquire);
+
+    while(true){
+        if (curr & 1ULL){
+            if (spins-- == 0) return 0;
+            (*spun)++;
+            cpu_relax();
+            curr = lock->load(std::memory_order_acquire);
+            continue;
+        }
+        if (lock->compare_exchange_weak(curr, curr | 1ULL,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)){
+            return 1;
+        }
+    }
+}
+
 void vlock_release(std::atomic<uint64_t>* lock, uint64_t new_version){
     uint64_t new_val = new_version << 1;
     lock->store(new_val, std::memory_order_release);
 }
 
-size_t vlock_index(void* addr){
-    size_t idx = ((uintptr_t)addr >> 3) & ((1ULL << 20) - 1);
-    return idx;
+void vlock_clear_all() {
+    memset((void*)lockMap, 0, vlock_cfg.stripes * vlock_cfg.stride * LOCK_SIZE);
 }
 
-std::atomic<uint64_t>* vlock_ptr(void* addr) {
-    return &lockMap[vlock_index(addr)];
-}
+void vlock_init()  { vlock_clear_all(); }
 
-uint64_t vlock_get_version(const std::atomic<uint64_t>* lock) {
-    return lock->load(std::memory_order_relaxed) >> 1;
-}
+void vlock_reset() { vlock_clear_all(); }
 
-bool vlock_is_locked(const std::atomic<uint64_t>* lock) {
-    return (lock->load(std::memory_order_relaxed) & 1ULL);
+void vlock_default_config(VLockConfig* cfg){
+    cfg->stripes = NUM_STRIPES;
+    cfg->granularity = 3;
+    cfg->stride = 1;
+    cfg->scatter = 0;
+    cfg->try_huge_pages = 0;
 }
 
-void vlock_clear_all() {
-    for (size_t i = 0; i < NUM_STRIPES; ++i)
-        lockMap[i].store(0, std::memory_order_relaxed);
+// Not thread-safe: call while no transactions are running.
+int vlock_init_config(const VLockConfig* cfg){
+    if (!cfg || cfg->stripes == 0 || (cfg->stripes & (cfg->stripes - 1))) return -1;
+    if (cfg->stride == 0 || cfg->granularity > 16) return -1;
+
+    std::atomic<uint64_t>* old = lockMap;
+    size_t old_bytes = vlock_bytes;
+
+    std::atomic<uint64_t>* fresh = vlock_map(cfg->stripes * cfg->stride * LOCK_SIZE,
+                                             cfg->try_huge_pages);
+    if (!fresh){
+        vlock_bytes = old_bytes;
+        return -1;
+    }
+
+    lockMap = fresh;
+    vlock_cfg = *cfg;
+    vlock_mask = cfg->stripes - 1;
+
+    if (old) munmap((void*)old, old_bytes);
+    return 0;
 }
 
-void vlock_init()  { vlock_clear_all(); }
+void vlock_get_config(VLockConfig* cfg){
+    *cfg = vlock_cfg;
+}
 
-void vlock_reset() { vlock_clear_all(); }
+size_t vlock_stripe_count(){
+    return vlock_cfg.stripes;
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include "alloc.h"
+#include "transaction.h"
+
+TEST(Alloc, AbortReturnsBlocksAndFreesWaitForCommit) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    void* p = tx_malloc(tx, 40);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ((uintptr_t)p % ALLOC_ALIGN, 0u);
+    tx_abort(tx);
+
+    // The aborted block is the next one handed out.
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx_malloc(tx, 33), p);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    // A free in an aborted transaction never happened; a committed one is
+    // deferred, so the block is not handed out again right away.
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx_free(tx, p), 0);
+    tx_abort(tx);
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx_free(tx, p), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_NE(tx_malloc(tx, 40), p);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    // Large blocks get their own mapping.
+    ASSERT_EQ(tx_begin(tx), 0);
+    char* big = (char*)tx_malloc(tx, 3 * ALLOC_MAX_SMALL);
+    ASSERT_NE(big, nullptr);
+    memset(big, 0xAB, 3 * ALLOC_MAX_SMALL);
+    EXPECT_EQ(tx_free(tx, big), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    void* priv = tx_malloc_private(100);
+    ASSERT_NE(priv, nullptr);
+    tx_free_private(priv);
+    EXPECT_EQ(tx_malloc_private(100), priv);
+
+    tx_shutdown();
+}
+
+TEST(Alloc, ReadOnlyFreeAndLogOverflowAbort) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    int dummy;
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    EXPECT_EQ(tx_free(tx, &dummy), -2);
+    EXPECT_EQ(tx->status, ABORTED);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    for (int i = 0; i < ALLOC_LOG_MAX; i++)
+        ASSERT_NE(tx_malloc(tx, 16), nullptr);
+    EXPECT_EQ(tx_malloc(tx, 16), nullptr);
+    EXPECT_EQ(tx->status, ABORTED);
+
+    // Irrevocable transactions do not log, so they have no such limit.
+    ASSERT_EQ(tx_begin_irrevocable(tx), 0);
+    for (int i = 0; i <= ALLOC_LOG_MAX; i++)
+        ASSERT_NE(tx_malloc(tx, 16), nullptr);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    tx_shutdown();
+}
+
+TEST(Alloc, FreedBlocksWaitForRunningTransactions) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    // A reader that started before any of the frees below stays open.
+    std::atomic<int> started{0}, release{0};
+    std::thread reader([&](){
+        TransactionContext* rt = tx_thread_init();
+        tx_begin_readonly(rt);
+        started = 1;
+        while (!release.load()) std::this_thread::yield();
+        tx_commit(rt);
+    });
+    while (!started.load()) std::this_thread::yield();
+
+    std::set<void*> freed;
+    auto churn = [&](){
+        EXPECT_EQ(tx_begin(tx), 0);
+        void* p = tx_malloc(tx, 64);
+        EXPECT_EQ(tx_commit(tx), 1);
+        EXPECT_EQ(tx_begin(tx), 0);
+        EXPECT_EQ(tx_free(tx, p), 0);
+        EXPECT_EQ(tx_commit(tx), 1);
+        return p;
+    };
+
+    for (int i = 0; i < ALLOC_BATCH * 8; i++){
+        void* p = churn();
+        EXPECT_EQ(freed.count(p), 0u);
+        freed.insert(p);
+    }
+
+    release = 1;
+    reader.join();
+
+    int reused = 0;
+    for (int i = 0; i < ALLOC_BATCH * 8 && !reused; i++)
+        reused = freed.count(churn()) != 0;
+    EXPECT_TRUE(reused);
+
+    tx_shutdown();
+}
@@ -90,3 +90,107 @@ TEST(Arena, LifecycleIsolationAndReuse) {
 
     arena_destroy();
 }
+
+TEST(Arena, ReleasedSlicesAreRecycled) {
+    arena_destroy();
+    ASSERT_EQ(arena_init(0), 0);
+    EXPECT_EQ(arena_max_threads(), MAX_THREADS);
+
+    char* a = arena_register_thread();
+    char* b = arena_register_thread();
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    EXPECT_EQ(arena_release_thread(a + 1), -1);
+    EXPECT_EQ(arena_release_thread(arena_base + 5 * SLICE_SIZE), -1);
+    EXPECT_EQ(arena_release_thread(nullptr), -1);
+
+    EXPECT_EQ(arena_release_thread(a), 0);
+    EXPECT_EQ(arena_release_thread(b), 0);
+    EXPECT_EQ(arena_register_thread(), b);
+    EXPECT_EQ(arena_register_thread(), a);
+    EXPECT_EQ(arena_slot_count(), 2);
+
+    // Churn far past the cap: every thread gives its slice back.
+    std::atomic<int> nulls{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 16; i++){
+        threads.emplace_back([&nulls](){
+            for (int j = 0; j < 1000; j++){
+                char* s = arena_register_thread();
+                if (s == nullptr){
+                    nulls.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                s[SLICE_RAW - 1] = 1;
+                arena_release_thread(s);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(nulls.load(), 0);
+    EXPECT_LE(arena_slot_count(), 2 + 16);
+
+    arena_destroy();
+}
+
+TEST(Arena, CapacityIsConfigurableBeyondMaxThreads) {
+    arena_destroy();
+    const uint32_t cap = 4 * MAX_THREADS;
+    ASSERT_EQ(arena_init_threads(0, cap), 0);
+    EXPECT_EQ(arena_init_threads(0, cap), -1);
+    EXPECT_EQ(arena_max_threads(), (int)cap);
+
+    std::set<char*> unique;
+    for (uint32_t i = 0; i < cap; i++){
+        char* s = arena_register_thread();
+        ASSERT_NE(s, nullptr);
+        EXPECT_EQ(((uintptr_t)s - (uintptr_t)arena_base) % SLICE_SIZE, 0u);
+        EXPECT_EQ((uintptr_t)s % PAGE_SIZE, 0u);
+        ASSERT_LE(s + SLICE_SIZE, arena_base + arena_size);
+        unique.insert(s);
+    }
+    EXPECT_EQ(unique.size(), (size_t)cap);
+    EXPECT_EQ(arena_register_thread(), nullptr);
+
+    arena_destroy();
+    EXPECT_EQ(arena_init_threads(0, 0), -1);
+}
+
+TEST(Arena, FakeNumaTopologyServesHomeNodeThenFallsBack) {
+    arena_destroy();
+    ASSERT_EQ(arena_init_numa(0, 8, 2), 0);
+    EXPECT_EQ(arena_numa_nodes(), 2);
+
+    int home = arena_current_node() % 2;
+    std::vector<char*> slices;
+    for (int i = 0; i < 8; i++){
+        char* s = arena_register_thread();
+        ASSERT_NE(s, nullptr);
+        EXPECT_EQ(((uintptr_t)s - (uintptr_t)arena_base) % SLICE_SIZE, 0u);
+        EXPECT_EQ(arena_slice_node(s), i < 4 ? home : 1 - home);
+        memset(s, i + 1, SLICE_RAW);
+        slices.push_back(s);
+    }
+    EXPECT_EQ(arena_register_thread(), nullptr);
+    EXPECT_EQ(arena_slot_count(), 8);
+
+    for (int slot = 0; slot < 8; slot++)
+        EXPECT_NE(arena_slot_slice(slot), nullptr);
+    EXPECT_EQ(arena_slot_slice(8), nullptr);
+    EXPECT_EQ(arena_slice_node(arena_base + 8 * SLICE_SIZE), -1);
+
+    // A slice released on the other node is reused once home is full.
+    ASSERT_EQ(arena_release_thread(slices[6]), 0);
+    EXPECT_EQ(arena_register_thread(), slices[6]);
+
+    arena_destroy();
+    EXPECT_EQ(arena_numa_nodes(), 0);
+
+    ASSERT_EQ(arena_init_numa(0, 8, 0), 0);
+    EXPECT_GE(arena_numa_nodes(), 1);
+    char* first = arena_register_thread();
+    EXPECT_EQ(arena_slice_node(first), arena_numa_nodes() > 1 ? arena_current_node() % arena_numa_nodes() : 0);
+    EXPECT_EQ(arena_slot_slice(1), nullptr);
+    arena_destroy();
+}
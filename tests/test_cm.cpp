@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "cm.h"
+#include "vlock.h"
+
+TEST(CM, PoliciesBoundTheWaitOnABusyStripe) {
+    vlock_init();
+    uint64_t x = 0;
+    std::atomic<uint64_t>* lock = vlock_ptr(&x);
+    CMState cm;
+    cm_init(&cm, 1);
+    EXPECT_EQ(cm_set_policy(7), -1);
+
+    ASSERT_EQ(cm_set_policy(CM_BACKOFF), 0);
+    for (uint32_t t = 1; t <= CM_MAX_TRIES; t++)
+        EXPECT_EQ(cm_on_busy(&cm, t, lock), 1);
+    EXPECT_EQ(cm_on_busy(&cm, CM_MAX_TRIES + 1, lock), 0);
+
+    ASSERT_EQ(cm_set_policy(CM_YIELD), 0);
+    EXPECT_EQ(cm_on_busy(&cm, CM_YIELD_AFTER, lock), 1);
+    EXPECT_EQ(cm_on_busy(&cm, CM_MAX_TRIES + 1, lock), 0);
+
+    cm_set_policy(TL2_CM_POLICY);
+}
+
+TEST(CM, KarmaBuysPatience) {
+    vlock_init();
+    uint64_t x = 0;
+    std::atomic<uint64_t>* lock = vlock_ptr(&x);
+    ASSERT_EQ(cm_set_policy(CM_POLKA), 0);
+    CMState fresh, invested;
+    cm_init(&fresh, 1);
+    cm_init(&invested, 2);
+    // Held by a transaction with no karma.
+    cm_publish(&fresh, lock);
+
+    for (int i = 0; i < 4; i++)
+        cm_on_abort(&invested, 64);
+    EXPECT_EQ(invested.attempts, 4u);
+    EXPECT_EQ(invested.karma, 256u);
+
+    uint32_t tries = CM_MAX_TRIES;
+    EXPECT_EQ(cm_on_busy(&fresh, tries, lock), 0);
+    EXPECT_EQ(cm_on_busy(&invested, tries, lock), 1);
+
+    cm_on_commit(&invested);
+    EXPECT_EQ(invested.attempts, 0u);
+    EXPECT_EQ(invested.karma, 0u);
+    EXPECT_EQ(cm_on_busy(&invested, tries, lock), 0);
+
+    cm_set_policy(TL2_CM_POLICY);
+}
+
+TEST(CM, PolkaWeighsTheWaiterAgainstTheHolder) {
+    vlock_init();
+    uint64_t x = 0, y = 0;
+    std::atomic<uint64_t>* lx = vlock_ptr(&x);
+    std::atomic<uint64_t>* ly = vlock_ptr(&y);
+    ASSERT_NE(vlock_lock_index(lx) % CM_HOLDER_SLOTS, vlock_lock_index(ly) % CM_HOLDER_SLOTS);
+    ASSERT_EQ(cm_set_policy(CM_POLKA), 0);
+
+    CMState waiter, poor, rich;
+    cm_init(&waiter, 1);
+    cm_init(&poor, 2);
+    cm_init(&rich, 3);
+    for (int i = 0; i < 4; i++){
+        cm_on_abort(&waiter, 64);
+        cm_on_abort(&rich, 128);
+    }
+    cm_publish(&poor, lx);
+    cm_publish(&rich, ly);
+
+    // The same waiter insists on the poorer holder's stripe only.
+    uint32_t tries = CM_MAX_TRIES;
+    EXPECT_EQ(cm_on_busy(&waiter, tries, lx), 1);
+    EXPECT_EQ(cm_on_busy(&waiter, tries, ly), 0);
+    EXPECT_EQ(cm_on_busy(&waiter, CM_MAX_TRIES / 2, ly), 1);
+
+    // Patience grows with the difference, one try per CM_KARMA_UNIT.
+    uint32_t patience = CM_MAX_TRIES / 2 + 256 / CM_KARMA_UNIT;
+    EXPECT_EQ(cm_on_busy(&waiter, patience, lx), 1);
+    EXPECT_EQ(cm_on_busy(&waiter, patience + 1, lx), 0);
+
+    // A new holder of ly with less karma than the waiter.
+    cm_on_commit(&rich);
+    cm_publish(&rich, ly);
+    EXPECT_EQ(cm_on_busy(&waiter, tries, ly), 1);
+
+    cm_set_policy(TL2_CM_POLICY);
+}
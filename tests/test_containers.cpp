@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "tl2_hashmap.h"
+#include "tl2_queue.h"
+#include "tl2_skiplist.h"
+
+TEST(Containers, HashMapGrowsWhileKeepingEveryKey) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    {
+        tl2::HashMap<uint64_t, uint64_t> map(4);
+        const uint64_t n = 5000;
+
+        for (uint64_t k = 0; k < n; k++)
+            EXPECT_TRUE(map.put(k, k * 3));
+        EXPECT_FALSE(map.put(7, 70));
+
+        size_t buckets = tl2::atomically_readonly([&](tl2::Tx& tx){ return map.buckets(tx); });
+        EXPECT_GT(buckets, 4u);
+
+        for (uint64_t k = 0; k < n; k++){
+            uint64_t v = 0;
+            ASSERT_TRUE(map.get(k, &v));
+            EXPECT_EQ(v, k == 7 ? 70 : k * 3);
+        }
+        EXPECT_FALSE(map.contains(n));
+
+        for (uint64_t k = 0; k < n; k += 2)
+            EXPECT_TRUE(map.remove(k));
+        EXPECT_FALSE(map.remove(0));
+        for (uint64_t k = 0; k < n; k++)
+            EXPECT_EQ(map.contains(k), k % 2 == 1);
+    }
+    tx_shutdown();
+}
+
+TEST(Containers, SkipListKeepsKeysOrdered) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    {
+        tl2::SkipList<int64_t, int64_t> list;
+        for (int64_t k = 999; k >= 0; k--)
+            EXPECT_TRUE(list.put(k * 2, k));
+        EXPECT_FALSE(list.put(10, -5));
+
+        for (int64_t k = 0; k < 2000; k += 6)
+            EXPECT_TRUE(list.remove(k));
+
+        // Walk the list with ceiling: strictly increasing, removed keys gone.
+        int64_t key = -1, prev = -1, count = 0, v = 0;
+        while (tl2::atomically_readonly([&](tl2::Tx& tx){
+                   return list.ceiling(tx, prev + 1, &key, &v); })){
+            EXPECT_GT(key, prev);
+            EXPECT_EQ(key % 2, 0);
+            EXPECT_NE(key % 6, 0);
+            EXPECT_EQ(v, key == 10 ? -5 : key / 2);
+            prev = key;
+            count++;
+        }
+        EXPECT_EQ(count, 1000 - 334);
+    }
+    tx_shutdown();
+}
+
+TEST(Containers, QueueIsFifoAndComposesWithAMap) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    {
+        tl2::Queue<int> q;
+        tl2::HashMap<int, int> map;
+        int v = 0;
+
+        EXPECT_FALSE(q.pop(&v));
+        for (int i = 0; i < 10; i++) q.push(i);
+        EXPECT_TRUE(q.pop(&v));
+        EXPECT_EQ(v, 0);
+
+        // Move the next item from the queue into the map in one transaction.
+        tl2::atomically([&](tl2::Tx& tx){
+            int item;
+            if (q.pop(tx, &item)) map.put(tx, item, item * 10);
+        });
+        EXPECT_TRUE(map.get(1, &v));
+        EXPECT_EQ(v, 10);
+
+        // An exception rolls back both containers.
+        EXPECT_THROW(tl2::atomically([&](tl2::Tx& tx){
+            int item;
+            q.pop(tx, &item);
+            map.put(tx, item, 0);
+            throw std::runtime_error("undo");
+        }), std::runtime_error);
+        EXPECT_FALSE(map.contains(2));
+
+        for (int i = 2; i < 10; i++){
+            ASSERT_TRUE(q.pop(&v));
+            EXPECT_EQ(v, i);
+        }
+        EXPECT_TRUE(tl2::atomically_readonly([&](tl2::Tx& tx){ return q.empty(tx); }));
+    }
+    tx_shutdown();
+}
+
+TEST(Containers, ConcurrentMovesDeliverEveryItemOnce) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    {
+        const int producers = 2, consumers = 2, per_producer = 2000;
+        tl2::Queue<int> q;
+        tl2::HashMap<int, int> map(8);
+        tl2::SkipList<int, int> order;
+        std::atomic<int> moved{0};
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++){
+            threads.emplace_back([&, p](){
+                for (int i = 0; i < per_producer; i++) q.push(p * per_producer + i);
+            });
+        }
+        for (int c = 0; c < consumers; c++){
+            threads.emplace_back([&](){
+                while (moved.load() < producers * per_producer){
+                    bool got = tl2::atomically([&](tl2::Tx& tx){
+                        int item;
+                        if (!q.pop(tx, &item)) return false;
+                        EXPECT_TRUE(map.put(tx, item, item));
+                        EXPECT_TRUE(order.put(tx, item, item));
+                        return true;
+                    });
+                    if (got) moved++;
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+
+        for (int i = 0; i < producers * per_producer; i++){
+            EXPECT_TRUE(map.contains(i));
+            EXPECT_TRUE(order.contains(i));
+        }
+        int v;
+        EXPECT_FALSE(q.pop(&v));
+    }
+    tx_shutdown();
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "stats.h"
+#include "tl2_coro.h"
+
+// Fire-and-forget coroutine: runs until its first suspension when called.
+struct Task{
+    struct promise_type{
+        Task get_return_object(){ return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ std::terminate(); }
+    };
+};
+
+// Runs deferred calls in order, ignoring their delay. run() drives it from
+// `threads` threads until `done` reaches `until`.
+struct QueueExecutor{
+    struct Item{ void (*fn)(void*); void* arg; };
+
+    std::mutex m;
+    std::deque<Item> items;
+    int deferred = 0;
+
+    void defer(uint64_t, void (*fn)(void*), void* arg){
+        std::lock_guard<std::mutex> g(m);
+        items.push_back({fn, arg});
+        deferred++;
+    }
+
+    int run_one(){
+        Item it;
+        {
+            std::lock_guard<std::mutex> g(m);
+            if (items.empty()) return 0;
+            it = items.front();
+            items.pop_front();
+        }
+        it.fn(it.arg);
+        return 1;
+    }
+
+    void run(int threads, const std::atomic<int>& done, int until){
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++)
+            pool.emplace_back([&](){
+                while (done.load() < until)
+                    if (!run_one()) std::this_thread::yield();
+            });
+        for (std::thread& th : pool) th.join();
+    }
+};
+
+// Continues the awaiting coroutine from the executor.
+struct Hop{
+    QueueExecutor& ex;
+    bool await_ready(){ return false; }
+    void await_suspend(std::coroutine_handle<> h){ ex.defer(0, &Hop::resume, h.address()); }
+    void await_resume(){}
+    static void resume(void* h){ std::coroutine_handle<>::from_address(h).resume(); }
+};
+
+// Commits x = v from a thread of its own.
+static void commit_elsewhere(tl2::TVar<int64_t>& x, int64_t v){
+    std::thread([&](){
+        tl2::atomically([&](tl2::Tx& tx){ tx.write(x, v); });
+        tx_thread_exit();
+    }).join();
+}
+
+TEST(Coro, CommitsWithoutSuspendingAndRetriesOnTheExecutor) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    QueueExecutor ex;
+    tl2::TVar<int64_t> a(100), b(0);
+    int runs = 0;
+    int64_t first = 0, second = 0;
+    uint32_t attempts = 0;
+    bool finished = false;
+
+    // Named: the coroutine refers to the captures, so the closure must
+    // outlive it.
+    auto co = [&]() -> Task {
+        // Commits at once: no suspension, no slice left behind.
+        first = co_await tl2::atomically(ex, [&](tl2::Tx& tx){
+            tx.write(a, tx.read(a) - 10);
+            return tx.read(a);
+        });
+
+        // The first attempt is overtaken by another commit and suspends.
+        auto aw = tl2::atomically(ex, [&](tl2::Tx& tx){
+            int64_t v = tx.read(a);
+            if (++runs == 1) commit_elsewhere(a, 50);
+            tx.write(b, v);
+            return v;
+        });
+        second = co_await aw;
+        attempts = aw.attempts();
+        finished = true;
+    };
+    co();
+
+    EXPECT_EQ(first, 90);
+    EXPECT_FALSE(finished);
+    EXPECT_EQ(ex.deferred, 1);
+    EXPECT_EQ(arena_slot_count(), 2); // ours, then the committing thread's
+
+    while (ex.run_one()) {}
+    EXPECT_TRUE(finished);
+    EXPECT_EQ(second, 50);
+    EXPECT_EQ(attempts, 2u);
+    EXPECT_EQ(runs, 2);
+    EXPECT_EQ(b.unsafe_get(), 50);
+
+    tx_shutdown();
+}
+
+TEST(Coro, ExceptionsPropagateAndNestedAtomicallyJoins) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    QueueExecutor ex;
+    tl2::TVar<int64_t> a(1);
+    int caught = 0;
+    int64_t seen = 0;
+
+    auto co = [&]() -> Task {
+        try {
+            co_await tl2::atomically(ex, [&](tl2::Tx& tx){
+                tx.write(a, (int64_t)2);
+                throw std::runtime_error("body");
+            });
+        } catch (const std::runtime_error&){
+            caught++;
+        }
+
+        // The inner atomically runs on the borrowed context, so the outer
+        // transaction sees its write before committing.
+        seen = co_await tl2::atomically(ex, [&](tl2::Tx& tx){
+            tl2::atomically([&](tl2::Tx& inner){ inner.write(a, (int64_t)3); });
+            return tx.read(a);
+        });
+
+        try {
+            co_await tl2::atomically_readonly(ex, [&](tl2::Tx& tx){ tx.write(a, (int64_t)4); });
+        } catch (const std::logic_error&){
+            caught++;
+        }
+    };
+    co();
+
+    while (ex.run_one()) {}
+    EXPECT_EQ(caught, 2);
+    EXPECT_EQ(seen, 3);
+    EXPECT_EQ(a.unsafe_get(), 3);
+    // Nothing ever bound a slice to this thread.
+    EXPECT_EQ(arena_slot_count(), 1);
+
+    tx_shutdown();
+}
+
+TEST(Coro, ThousandsOfCoroutinesShareAFewSlices) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    QueueExecutor ex;
+
+    const int accounts = 16, coroutines = 2000, transfers = 20, threads = 4;
+    std::vector<tl2::TVar<int64_t>> bank(accounts);
+    for (tl2::TVar<int64_t>& acct : bank) acct.unsafe_set(100);
+    std::atomic<int> done{0};
+
+    auto client = [&](uint64_t seed) -> Task {
+        co_await Hop{ex};
+        for (int i = 0; i < transfers; i++){
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            int from = seed % accounts, to = (seed >> 8) % accounts;
+            co_await tl2::atomically(ex, [&](tl2::Tx& tx){
+                tx.write(bank[from], tx.read(bank[from]) - 1);
+                tx.write(bank[to], tx.read(bank[to]) + 1);
+            });
+            co_await Hop{ex};
+        }
+        done++;
+    };
+    for (int c = 0; c < coroutines; c++) client(0x9E3779B97F4A7C15ULL * (c + 1));
+    ex.run(threads, done, coroutines);
+
+    int64_t total = 0;
+    for (tl2::TVar<int64_t>& acct : bank) total += acct.unsafe_get();
+    EXPECT_EQ(total, accounts * 100);
+    EXPECT_LE(arena_slot_count(), threads);
+
+#if TL2_STATS
+    TxStats st;
+    stats_collect(&st);
+    EXPECT_EQ(st.commits, (uint64_t)coroutines * transfers);
+#endif
+
+    tx_shutdown();
+}
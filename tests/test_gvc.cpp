@@ -53,3 +53,62 @@ TEST(GVC, AcquireReleaseSemantics) {
     writer.join();
     reader.join();
 }
+
+TEST(GVC, PassOnFailureAdoptsWinnerTimestamp) {
+    gvc_init();
+    ASSERT_EQ(gvc_set_mode(GVC_MODE_GV4), 0);
+    int unique = 0;
+    EXPECT_EQ(gvc_commit_version(&unique), 1u);
+    EXPECT_EQ(unique, 1);
+    EXPECT_EQ(gvc_get(), 1u);
+
+    const int num_threads = 8;
+    const int iters = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]() {
+            uint64_t last = 0;
+            for (int j = 0; j < iters; ++j) {
+                int u = 0;
+                uint64_t wv = gvc_commit_version(&u);
+                EXPECT_GT(wv, last);
+                EXPECT_LE(wv, gvc_get());
+                last = wv;
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+    EXPECT_LE(gvc_get(), (uint64_t)num_threads * iters + 1);
+    gvc_set_mode(TL2_GVC_MODE);
+}
+
+TEST(GVC, DeferredIncrementAdvancesOnlyOnObserve) {
+    gvc_init();
+    EXPECT_EQ(gvc_set_mode(42), -1);
+    ASSERT_EQ(gvc_set_mode(GVC_MODE_GV5), 0);
+    int unique = 1;
+    EXPECT_EQ(gvc_commit_version(&unique), 1u);
+    EXPECT_EQ(unique, 0);
+    EXPECT_EQ(gvc_commit_version(&unique), 1u);
+    EXPECT_EQ(gvc_get(), 0u);
+
+    gvc_observe(1);
+    EXPECT_EQ(gvc_get(), 1u);
+    gvc_observe(0);
+    EXPECT_EQ(gvc_get(), 1u);
+    EXPECT_EQ(gvc_commit_version(&unique), 2u);
+
+    ASSERT_EQ(gvc_set_mode(GVC_MODE_GV6), 0);
+    for (int i = 0; i < 2 * GVC_SAMPLE_PERIOD; i++){
+        unique = 1;
+        gvc_commit_version(&unique);
+        // Sampled commits share versions with the deferred ones.
+        EXPECT_EQ(unique, 0);
+    }
+    EXPECT_EQ(gvc_get(), 3u);
+
+    ASSERT_EQ(gvc_set_mode(GVC_MODE_GV1), 0);
+    gvc_observe(100);
+    EXPECT_EQ(gvc_get(), 3u);
+    gvc_set_mode(TL2_GVC_MODE);
+}
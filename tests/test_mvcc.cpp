@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "gvc.h"
+#include "mvcc.h"
+#include "stats.h"
+#include "transaction.h"
+#include "vlock.h"
+
+// Commits *addr = v from a thread of its own, so the caller's transaction
+// stays open.
+static void commit_elsewhere(uint64_t* addr, uint64_t v){
+    std::thread([=](){
+        TransactionContext* w = tx_thread_init();
+        uint64_t val = v;
+        while (true){
+            tx_begin(w);
+            if (tx_write(w, addr, &val, sizeof(val)) == 0 && tx_commit(w)) break;
+        }
+        tx_thread_exit();
+    }).join();
+}
+
+TEST(Mvcc, ReadOnlySnapshotsReadTheValueAtTheirVersion) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    MvConfig cfg;
+    mv_default_config(&cfg);
+    ASSERT_EQ(mv_enable(&cfg), 0);
+    EXPECT_EQ(mv_bytes(), cfg.buckets * mv_bucket_bytes(cfg.depth));
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    alignas(8) uint64_t x = 1, y = 2;
+    alignas(8) uint32_t halves[2] = {3, 4};
+    uint64_t v = 0;
+    uint32_t h = 0;
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    commit_elsewhere(&x, 10);
+    commit_elsewhere(&x, 11);
+    commit_elsewhere((uint64_t*)halves, 0x0000000500000006ULL);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 1u);
+    ASSERT_EQ(tx_read(tx, &halves[1], &h, sizeof(h)), 0);
+    EXPECT_EQ(h, 4u);
+
+    // A newer stripe with no record for the word: the word itself did not
+    // change, so memory holds the snapshot's value.
+    vlock_release(vlock_ptr(&y), gvc_inc() + 1);
+    ASSERT_EQ(tx_read(tx, &y, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 2u);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    // A new snapshot sees the latest value.
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 11u);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+#if TL2_STATS
+    TxStats st;
+    stats_collect(&st);
+    EXPECT_EQ(st.mv_reads, 3u);
+#endif
+
+    // Update transactions keep plain TL2 validation.
+    ASSERT_EQ(tx_begin(tx), 0);
+    tx_set_snapshot_extension(0);
+    commit_elsewhere(&x, 12);
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    tx_set_snapshot_extension(1);
+
+    tx_shutdown();
+    EXPECT_FALSE(mv_enabled());
+}
+
+TEST(Mvcc, EvictedAndIrrevocableHistoryAborts) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    MvConfig cfg = {1, 2};
+    ASSERT_EQ(mv_enable(&cfg), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 1, y = 2, z = 3, v = 0;
+
+    // Three live records for a two-entry bucket: the oldest (x's) goes.
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    commit_elsewhere(&x, 10);
+    commit_elsewhere(&y, 20);
+    commit_elsewhere(&z, 30);
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 10u);
+    tx_commit(tx);
+
+    // With no snapshot older than them, records are reused without raising
+    // the floor.
+    commit_elsewhere(&x, 11);
+    commit_elsewhere(&y, 21);
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    commit_elsewhere(&z, 31);
+    commit_elsewhere(&x, 12);
+    ASSERT_EQ(tx_read(tx, &z, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 30u);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 11u);
+    tx_commit(tx);
+
+    // Irrevocable writes leave no records behind.
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    std::thread([&](){
+        TransactionContext* w = tx_thread_init();
+        uint64_t val = 13;
+        ASSERT_EQ(tx_begin_irrevocable(w), 0);
+        ASSERT_EQ(tx_write(w, &x, &val, sizeof(val)), 0);
+        EXPECT_EQ(tx_commit(w), 1);
+        tx_thread_exit();
+    }).join();
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+
+    MvConfig bad = {3, 2};
+    EXPECT_EQ(mv_enable(&bad), -1);
+    bad = {4, MV_DEPTH_MAX + 1};
+    EXPECT_EQ(mv_enable(&bad), -1);
+
+    tx_shutdown();
+}
+
+TEST(Mvcc, ScansSeeConsistentTotalsUnderTransfers) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    MvConfig cfg = {1 << 12, 8};
+    ASSERT_EQ(mv_enable(&cfg), 0);
+
+    const int accounts = 256;
+    std::vector<uint64_t> bank(accounts, 100);
+    std::atomic<int> done{0};
+
+    std::thread writer([&](){
+        TransactionContext* w = tx_thread_init();
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        while (!done.load()){
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            int from = seed % accounts, to = (seed >> 8) % accounts;
+            if (from == to) continue;
+            while (true){
+                tx_begin(w);
+                uint64_t a, b;
+                if (tx_read(w, &bank[from], &a, sizeof(a)) != 0 ||
+                    tx_read(w, &bank[to], &b, sizeof(b)) != 0) continue;
+                a--;
+                b++;
+                if (tx_write(w, &bank[from], &a, sizeof(a)) == 0 &&
+                    tx_write(w, &bank[to], &b, sizeof(b)) == 0 &&
+                    tx_commit(w)) break;
+            }
+        }
+        tx_thread_exit();
+    });
+
+    TransactionContext* tx = tx_thread_init();
+    for (int scan = 0; scan < 200; scan++){
+        while (true){
+            tx_begin_readonly(tx);
+            uint64_t sum = 0, v;
+            int k = 0;
+            for (; k < accounts; k++){
+                if (tx_read(tx, &bank[k], &v, sizeof(v)) != 0) break;
+                sum += v;
+                if (k % 32 == 31) std::this_thread::yield();
+            }
+            if (k < accounts) continue;
+            ASSERT_EQ(tx_commit(tx), 1);
+            EXPECT_EQ(sum, (uint64_t)accounts * 100);
+            break;
+        }
+    }
+    done = 1;
+    writer.join();
+
+    tx_shutdown();
+}
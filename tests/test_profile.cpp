@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstdint>
+#include "gvc.h"
+#include "profile.h"
+#include "transaction.h"
+#include "vlock.h"
+
+// Two words that share a stripe without being the same data.
+static void find_alias(std::vector<uint64_t>& buf, uint64_t** a, uint64_t** b){
+    *a = &buf[0];
+    size_t idx = vlock_index(*a);
+    for (size_t i = 1; i < buf.size(); i++){
+        if (vlock_index(&buf[i]) == idx){
+            *b = &buf[i];
+            return;
+        }
+    }
+    *b = nullptr;
+}
+
+TEST(Profile, RanksStripesAndFlagsAliasedAddresses) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    std::vector<uint64_t> buf(2 * NUM_STRIPES + 1, 0);
+    uint64_t *a, *b;
+    find_alias(buf, &a, &b);
+    ASSERT_NE(b, nullptr);
+    uint64_t* lone = &buf[1];
+    ASSERT_NE(vlock_index(lone), vlock_index(a));
+
+    EXPECT_EQ(profile_start(0), -1);
+    ASSERT_EQ(profile_start(1), 0);
+    EXPECT_TRUE(profile_active());
+
+    uint64_t v = 0;
+    // Three read-validation aborts on the aliased stripe, via both addresses.
+    for (uint64_t* p : {a, b, a}){
+        ASSERT_EQ(tx_begin(tx), 0);
+        vlock_release(vlock_ptr(p), gvc_inc() + 1);
+        EXPECT_EQ(tx_read(tx, p, &v, sizeof(v)), -1);
+    }
+
+    // One held-stripe abort at commit on a stripe of its own.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_write(tx, lone, &v, sizeof(v)), 0);
+    vlock_acquire(vlock_ptr(lone));
+    EXPECT_EQ(tx_commit(tx), 0);
+    vlock_release(vlock_ptr(lone), vlock_get_version(vlock_ptr(lone)));
+
+    profile_stop();
+    EXPECT_FALSE(profile_active());
+
+    // Not recorded once stopped.
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_release(vlock_ptr(lone), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, lone, &v, sizeof(v)), -1);
+
+    ProfileHot hot[4];
+    ASSERT_EQ(profile_top(hot, 4), 2);
+
+    EXPECT_EQ(hot[0].stripe, vlock_index(a));
+    EXPECT_EQ(hot[0].count, 3u);
+    EXPECT_EQ(hot[0].by_cause[STATS_ABORT_READ_VALIDATE], 3u);
+    EXPECT_EQ(hot[0].n_addrs, 2u);
+
+    EXPECT_EQ(hot[1].stripe, vlock_index(lone));
+    EXPECT_EQ(hot[1].count, 1u);
+    EXPECT_EQ(hot[1].by_cause[STATS_ABORT_COMMIT_LOCKED], 1u);
+    EXPECT_EQ(hot[1].n_addrs, 1u);
+    EXPECT_EQ(hot[1].addrs[0], (void*)lone);
+    EXPECT_EQ(profile_dropped(), 0u);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(Profile, LateHotStripeEvictsColdOnes) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    VLockConfig cfg;
+    vlock_get_config(&cfg);
+
+    // One cold event on every other stripe fills every probe window.
+    const size_t stripes = vlock_stripe_count(), hot_i = 12345;
+    auto stripe_addr = [&](size_t i){ return (void*)((uintptr_t)i << cfg.granularity); };
+    ASSERT_EQ(profile_start(1), 0);
+    for (size_t i = 0; i < stripes; i++)
+        if (i != hot_i)
+            profile_record(STATS_ABORT_READ_VALIDATE, vlock_ptr(stripe_addr(i)), stripe_addr(i));
+
+    ProfileHot cold[1];
+    ASSERT_EQ(profile_top(cold, 1), 1);
+    uint64_t coldest_top = cold[0].count;
+
+    void* hot_addr = stripe_addr(hot_i);
+    const uint64_t hot_events = 1000;
+    for (uint64_t e = 0; e < hot_events; e++)
+        profile_record(STATS_ABORT_COMMIT_LOCKED, vlock_ptr(hot_addr), hot_addr);
+    profile_stop();
+
+    ProfileHot hot[2];
+    ASSERT_EQ(profile_top(hot, 2), 2);
+    EXPECT_EQ(hot[0].stripe, vlock_index(hot_addr));
+    EXPECT_GE(hot[0].count - hot[0].error, hot_events);
+    EXPECT_EQ(hot[0].by_cause[STATS_ABORT_COMMIT_LOCKED], hot_events);
+    EXPECT_EQ(hot[0].by_cause[STATS_ABORT_READ_VALIDATE], 0u);
+    EXPECT_EQ(hot[0].n_addrs, 1u);
+    EXPECT_EQ(hot[0].addrs[0], hot_addr);
+    EXPECT_LE(hot[1].count, coldest_top);
+    EXPECT_EQ(profile_dropped(), 0u);
+
+    tx_shutdown();
+}
+
+TEST(Profile, SamplesEveryNthConflict) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 0, v = 0;
+    ASSERT_EQ(profile_start(4), 0);
+    for (int i = 0; i < 16; i++){
+        ASSERT_EQ(tx_begin(tx), 0);
+        vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+        EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    }
+    profile_stop();
+
+    ProfileHot hot[1];
+    ASSERT_EQ(profile_top(hot, 1), 1);
+    EXPECT_EQ(hot[0].count, 4u);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
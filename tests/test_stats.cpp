@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "arena.h"
+#include "gvc.h"
+#include "stats.h"
+#include "transaction.h"
+#include "vlock.h"
+
+TEST(Stats, CommitsAndAbortsAreCountedByCause) {
+#if !TL2_STATS
+    GTEST_SKIP() << "built with TL2_STATS=0";
+#endif
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 1, y = 2, v = 0;
+
+    // One read, two writes, read-own-write.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_read(tx, &y, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_commit(tx), 1);
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_commit(tx), 1);
+
+    // Newer version: read validation.
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+
+    // Held stripe: read and commit.
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_acquire(vlock_ptr(&y));
+    EXPECT_EQ(tx_read(tx, &y, &v, sizeof(v)), -1);
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(tx), 0);
+    vlock_release(vlock_ptr(&y), vlock_get_version(vlock_ptr(&y)));
+
+    // Commit-time validation: x changes after we read it.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+    gvc_inc();
+    EXPECT_EQ(tx_commit(tx), 0);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    tx_abort(tx);
+    tx_abort(tx);
+
+    TxStats st;
+    EXPECT_EQ(stats_collect(&st), 1);
+    EXPECT_EQ(st.commits, 2u);
+    EXPECT_EQ(st.readonly_commits, 1u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_READ_VALIDATE], 1u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_READ_LOCKED], 1u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_COMMIT_LOCKED], 1u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_COMMIT_VALIDATE], 1u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_OVERFLOW], 0u);
+    EXPECT_EQ(st.aborts[STATS_ABORT_USER], 1u);
+    EXPECT_GE(st.lock_spins, (uint64_t)CM_SPIN_BUDGET);
+    EXPECT_EQ(st.ws_lookups, 1u);
+
+    // First commit: 1 read, 2 writes; read-only commit: empty sets.
+    EXPECT_EQ(st.rs_hist[stats_bucket(1)], 1u);
+    EXPECT_EQ(st.ws_hist[stats_bucket(2)], 1u);
+    EXPECT_EQ(st.rs_hist[0], 1u);
+    EXPECT_EQ(st.ws_hist[0], 1u);
+
+    stats_reset();
+    stats_collect(&st);
+    EXPECT_EQ(st.commits, 0u);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(Stats, HistogramBucketsAreLog2) {
+    EXPECT_EQ(stats_bucket(0), 0u);
+    EXPECT_EQ(stats_bucket(1), 1u);
+    EXPECT_EQ(stats_bucket(2), 2u);
+    EXPECT_EQ(stats_bucket(3), 2u);
+    EXPECT_EQ(stats_bucket(4), 3u);
+    EXPECT_EQ(stats_bucket(2048), 12u);
+    EXPECT_EQ(stats_bucket(1u << 20), (uint32_t)STATS_HIST_BUCKETS - 1);
+}
+
+TEST(Stats, CollectSumsSlicesOfExitedThreads) {
+#if !TL2_STATS
+    GTEST_SKIP() << "built with TL2_STATS=0";
+#endif
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    const int num_threads = 4, iters = 100;
+    std::vector<uint64_t> counters(num_threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++){
+        threads.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            ASSERT_NE(tx, nullptr);
+            for (int i = 0; i < iters; i++){
+                uint64_t v;
+                do {
+                    tx_begin(tx);
+                } while (tx_read(tx, &counters[t], &v, sizeof(v)) != 0 ||
+                         (v++, tx_write(tx, &counters[t], &v, sizeof(v))) != 0 ||
+                         !tx_commit(tx));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    TxStats st;
+    EXPECT_GE(stats_collect(&st), 1);
+    EXPECT_EQ(st.commits, (uint64_t)num_threads * iters);
+    EXPECT_EQ(st.ws_hist[stats_bucket(1)], (uint64_t)num_threads * iters);
+
+    tx_shutdown();
+}
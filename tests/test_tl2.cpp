@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "tl2.h"
+#include "gvc.h"
+#include "vlock.h"
+
+struct Pair{
+    uint64_t lo, hi;
+};
+
+struct Odd{
+    char bytes[13];
+};
+
+TEST(TL2, AtomicallyReadsWritesAndReturns) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    tl2::TVar<uint8_t> a(1);
+    tl2::TVar<uint16_t> b(2);
+    tl2::TVar<uint32_t> c(3);
+    tl2::TVar<uint64_t> d(4);
+    tl2::TVar<Pair> e(Pair{5, 6});
+    tl2::TVar<Odd> f;
+
+    uint64_t sum = tl2::atomically([&](tl2::Tx& tx){
+        tx.write(a, (uint8_t)(tx.read(a) + 1));
+        tx.write(b, (uint16_t)(tx.read(b) + 1));
+        tx.write(c, tx.read(c) + 1);
+        tx.write(d, tx.read(d) + 1);
+        Pair p = tx.read(e);
+        tx.write(e, Pair{p.hi, p.lo});
+        Odd o = tx.read(f);
+        o.bytes[12] = 'x';
+        tx.write(f, o);
+
+        // Reads after writes see the transaction's own values.
+        return (uint64_t)tx.read(a) + tx.read(b) + tx.read(c) + tx.read(d) +
+               tx.read(e).lo + (tx.read(f).bytes[12] == 'x');
+    });
+
+    EXPECT_EQ(sum, 2u + 3 + 4 + 5 + 6 + 1);
+    EXPECT_EQ(a.unsafe_get(), 2);
+    EXPECT_EQ(b.unsafe_get(), 3);
+    EXPECT_EQ(c.unsafe_get(), 4u);
+    EXPECT_EQ(d.unsafe_get(), 5u);
+    EXPECT_EQ(e.unsafe_get().lo, 6u);
+    EXPECT_EQ(e.unsafe_get().hi, 5u);
+    EXPECT_EQ(f.unsafe_get().bytes[12], 'x');
+    EXPECT_EQ(alignof(tl2::TVar<Pair>), 16u);
+
+    tx_shutdown();
+}
+
+TEST(TL2, AtomicallyRetriesConflictsAndPropagatesOtherErrors) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+
+    tl2::TVar<uint64_t> x(7);
+    int runs = 0;
+
+    // First run: someone commits x after we began, so the read aborts.
+    uint64_t v = tl2::atomically([&](tl2::Tx&){ return (uint64_t)0; });
+    EXPECT_EQ(v, 0u);
+    v = tl2::atomically([&](tl2::Tx& tx){
+        if (runs++ == 0) vlock_release(vlock_ptr(x.addr()), gvc_inc() + 1);
+        return tx.read(x);
+    });
+    EXPECT_EQ(v, 7u);
+    EXPECT_EQ(runs, 2);
+
+    EXPECT_THROW(tl2::atomically([&](tl2::Tx& tx){
+        tx.write(x, (uint64_t)9);
+        throw std::runtime_error("user error");
+    }), std::runtime_error);
+    EXPECT_EQ(x.unsafe_get(), 7u);
+
+    EXPECT_THROW(tl2::atomically_readonly([&](tl2::Tx& tx){
+        tx.write(x, (uint64_t)9);
+    }), std::logic_error);
+    EXPECT_EQ(tl2::atomically_readonly([&](tl2::Tx& tx){ return tx.read(x); }), 7u);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(TL2, ConcurrentTransfersPreserveTotal) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    const int num_accounts = 16, num_threads = 4, iters = 2000;
+    std::vector<tl2::TVar<int64_t>> accounts(num_accounts);
+    for (auto& acc : accounts) acc.unsafe_set(100);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++){
+        threads.emplace_back([&, t](){
+            for (int i = 0; i < iters; i++){
+                int from = (t + i) % num_accounts;
+                int to = (t * 7 + i * 3 + 1) % num_accounts;
+                if (from == to) continue;
+
+                tl2::atomically([&](tl2::Tx& tx){
+                    tx.write(accounts[from], tx.read(accounts[from]) - 1);
+                    tx.write(accounts[to], tx.read(accounts[to]) + 1);
+                });
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    int64_t total = tl2::atomically_readonly([&](tl2::Tx& tx){
+        int64_t sum = 0;
+        for (auto& acc : accounts) sum += tx.read(acc);
+        return sum;
+    });
+    EXPECT_EQ(total, 100 * num_accounts);
+
+    tx_shutdown();
+}
+
+TEST(TL2, NestedAtomicallyFlattensAndClosedRerunsOnlyItsBody) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+
+    tl2::TVar<uint64_t> x(1), y(2);
+
+    // Flattened: an exception in the inner body aborts the whole thing.
+    EXPECT_THROW(tl2::atomically([&](tl2::Tx& tx){
+        tx.write(x, (uint64_t)5);
+        tl2::atomically([&](tl2::Tx& inner){
+            inner.write(y, (uint64_t)6);
+            throw std::runtime_error("inner");
+        });
+    }), std::runtime_error);
+    EXPECT_EQ(x.unsafe_get(), 1u);
+    EXPECT_EQ(y.unsafe_get(), 2u);
+
+    // Closed: a conflict inside reruns the inner body, not the outer one.
+    int outer_runs = 0, inner_runs = 0;
+    uint64_t sum = tl2::atomically([&](tl2::Tx& tx){
+        outer_runs++;
+        uint64_t a = tx.read(x);
+        tx.write(x, a + 10);
+        uint64_t b = tl2::atomically_closed([&](tl2::Tx& inner){
+            if (inner_runs++ == 0) vlock_release(vlock_ptr(y.addr()), gvc_inc() + 1);
+            return inner.read(y);
+        });
+        return a + b;
+    });
+    EXPECT_EQ(sum, 3u);
+    EXPECT_EQ(outer_runs, 1);
+    EXPECT_EQ(inner_runs, 2);
+    EXPECT_EQ(x.unsafe_get(), 11u);
+
+    // Closed: an exception undoes only the inner writes.
+    tl2::atomically([&](tl2::Tx& tx){
+        tx.write(x, (uint64_t)20);
+        try {
+            tl2::atomically_closed([&](tl2::Tx& inner){
+                inner.write(x, (uint64_t)30);
+                inner.write(y, (uint64_t)30);
+                throw std::runtime_error("inner");
+            });
+        } catch (const std::runtime_error&) {}
+        EXPECT_EQ(tx.read(x), 20u);
+    });
+    EXPECT_EQ(x.unsafe_get(), 20u);
+    EXPECT_EQ(y.unsafe_get(), 2u);
+
+    // An irrevocable body restarts its speculative parent irrevocably.
+    outer_runs = 0;
+    tl2::atomically([&](tl2::Tx& tx){
+        outer_runs++;
+        tx.write(y, (uint64_t)7);
+        tl2::atomically_irrevocable([&](tl2::Tx& inner){
+            EXPECT_EQ(inner.context()->irrevocable, 1);
+        });
+    });
+    EXPECT_EQ(outer_runs, 2);
+    EXPECT_EQ(y.unsafe_get(), 7u);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(TL2, CountersUpdatedCommutativelyKeepEveryIncrement) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    const int threads = 4, per_thread = 2000;
+    tl2::TVar<int64_t> hits(0), low(0), high(0);
+    tl2::TVar<uint64_t> seen(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            for (int i = 0; i < per_thread; i++){
+                tl2::atomically([&](tl2::Tx& tx){
+                    tx.add(hits, (int64_t)1);
+                    tx.min(low, (int64_t)-i);
+                    tx.max(high, (int64_t)(t * per_thread + i));
+                    tx.bit_or(seen, (uint64_t)1 << t);
+                });
+            }
+            tx_thread_exit();
+        });
+    }
+    for (std::thread& th : pool) th.join();
+
+    EXPECT_EQ(hits.unsafe_get(), threads * per_thread);
+    EXPECT_EQ(low.unsafe_get(), -(per_thread - 1));
+    EXPECT_EQ(high.unsafe_get(), threads * per_thread - 1);
+    EXPECT_EQ(seen.unsafe_get(), (1u << threads) - 1);
+
+    // A read in the same transaction sees the pending update.
+    int64_t v = tl2::atomically([&](tl2::Tx& tx){
+        tx.add(hits, (int64_t)-1);
+        return tx.read(hits);
+    });
+    EXPECT_EQ(v, threads * per_thread - 1);
+
+    tx_shutdown();
+}
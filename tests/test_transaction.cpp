@@ -0,0 +1,850 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "arena.h"
+#include "transaction.h"
+#include "cm.h"
+#include "gvc.h"
+#include "stats.h"
+#include "vlock.h"
+
+TEST(Transaction, CommitPublishesWritesAndReadsOwnWrites) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+    EXPECT_EQ(tx_thread_init(), tx);
+
+    uint64_t x = 1, y = 2;
+    uint64_t v = 0;
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 1u);
+
+    uint64_t nx = 10, ny = 20, ny2 = 21;
+    ASSERT_EQ(tx_write(tx, &x, &nx, sizeof(nx)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &ny, sizeof(ny)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &ny2, sizeof(ny2)), 0);
+
+    ASSERT_EQ(tx_read(tx, &y, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 21u);
+    EXPECT_EQ(x, 1u);
+
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx->status, COMMITTED);
+    EXPECT_EQ(x, 10u);
+    EXPECT_EQ(y, 21u);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&x)));
+    EXPECT_EQ(vlock_get_version(vlock_ptr(&x)), gvc_read());
+
+    tx_shutdown();
+}
+
+TEST(Transaction, ConflictingCommitAborts) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 5, y = 0, v = 0;
+
+    // A newer version than read_version aborts the read itself.
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx->status, ABORTED);
+    EXPECT_EQ(tx_write(tx, &y, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx_commit(tx), 0);
+
+    // A stripe overwritten after our read fails commit-time validation.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+    EXPECT_EQ(tx_commit(tx), 0);
+    EXPECT_EQ(y, 0u);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&y)));
+
+    // A locked stripe aborts the read.
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_acquire(vlock_ptr(&x));
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    vlock_release(vlock_ptr(&x), vlock_get_version(vlock_ptr(&x)));
+
+    tx_abort(tx);
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(Transaction, AddressesSharingAStripeDoNotSelfDeadlock) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    std::vector<uint64_t> mem(NUM_STRIPES + 1, 0);
+    uint64_t* a = &mem[0];
+    uint64_t* b = &mem[NUM_STRIPES];
+    ASSERT_EQ(vlock_ptr(a), vlock_ptr(b));
+
+    uint64_t va = 0, vb = 0, one = 1, two = 2;
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, a, &va, sizeof(va)), 0);
+    ASSERT_EQ(tx_read(tx, b, &vb, sizeof(vb)), 0);
+    ASSERT_EQ(tx_write(tx, a, &one, sizeof(one)), 0);
+    ASSERT_EQ(tx_write(tx, b, &two, sizeof(two)), 0);
+
+    // Force the validation path, which must accept our own locked stripe.
+    gvc_inc();
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(*a, 1u);
+    EXPECT_EQ(*b, 2u);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(a)));
+
+    tx_shutdown();
+}
+
+static void run_transfers(int num_threads, int iters) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    const int num_accounts = 16;
+    std::vector<uint64_t> accounts(num_accounts, 100);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++){
+        threads.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            ASSERT_NE(tx, nullptr);
+            uint32_t seed = t + 1;
+            for (int i = 0; i < iters; i++){
+                seed = seed * 1103515245u + 12345u;
+                int from = (seed >> 8) % num_accounts;
+                int to = (seed >> 16) % num_accounts;
+                while (true){
+                    tx_begin(tx);
+                    uint64_t a, b;
+                    if (tx_read(tx, &accounts[from], &a, sizeof(a)) != 0) continue;
+                    if (tx_read(tx, &accounts[to], &b, sizeof(b)) != 0) continue;
+                    if (a == 0){ tx_abort(tx); break; }
+                    a -= 1;
+                    if (tx_write(tx, &accounts[from], &a, sizeof(a)) != 0) continue;
+                    if (tx_read(tx, &accounts[to], &b, sizeof(b)) != 0) continue;
+                    b += 1;
+                    if (tx_write(tx, &accounts[to], &b, sizeof(b)) != 0) continue;
+                    if (tx_commit(tx)) break;
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    uint64_t total = 0;
+    for (uint64_t a : accounts) total += a;
+    EXPECT_EQ(total, (uint64_t)num_accounts * 100);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, ConcurrentTransfersPreserveTotal) {
+    run_transfers(4, 5000);
+}
+
+TEST(Transaction, ConcurrentTransfersPreserveTotalUnderEveryClockMode) {
+    for (int mode = GVC_MODE_GV1; mode <= GVC_MODE_GV6; mode++){
+        ASSERT_EQ(gvc_set_mode(mode), 0);
+        run_transfers(4, 2000);
+    }
+    gvc_set_mode(TL2_GVC_MODE);
+}
+
+TEST(Transaction, ReadOnlyModeLogsNothingAndRejectsWrites) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 7, y = 8, v = 0;
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 7u);
+    ASSERT_EQ(tx_read(tx, &y, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 8u);
+    EXPECT_EQ(tx->rs.count, 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    vlock_release(vlock_ptr(&y), gvc_inc() + 1);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_read(tx, &y, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx_commit(tx), 0);
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    EXPECT_EQ(tx_write(tx, &x, &v, sizeof(v)), -2);
+    EXPECT_EQ(tx->status, ABORTED);
+    EXPECT_EQ(tx_commit(tx), 0);
+    EXPECT_EQ(x, 7u);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, CommitAbortsInsteadOfSpinningOnAHeldStripe) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 0, y = 0, one = 1;
+    std::atomic<uint64_t>* held = vlock_ptr(&y);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_write(tx, &x, &one, sizeof(one)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &one, sizeof(one)), 0);
+    vlock_acquire(held);
+    EXPECT_EQ(tx_commit(tx), 0);
+    EXPECT_EQ(tx->status, ABORTED);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&x)));
+    EXPECT_EQ(x, 0u);
+    vlock_release(held, vlock_get_version(held));
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx->cm.attempts, 1u);
+    ASSERT_EQ(tx_write(tx, &y, &one, sizeof(one)), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx->cm.attempts, 0u);
+    EXPECT_EQ(y, 1u);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, ConcurrentTransfersPreserveTotalUnderEveryCMPolicy) {
+    for (int policy = CM_BACKOFF; policy <= CM_POLKA; policy++){
+        ASSERT_EQ(cm_set_policy(policy), 0);
+        run_transfers(8, 1000);
+    }
+    cm_set_policy(TL2_CM_POLICY);
+}
+
+TEST(Transaction, LargeBuffersAndLongWriteSetsCommit) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    struct Record { char payload[1000]; };
+    Record rec = {}, src;
+    memset(src.payload, 'x', sizeof(src.payload));
+
+    std::vector<uint64_t> words(3 * WS_SLOTS, 0);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_write(tx, &rec, &src, sizeof(src)), 0);
+    for (size_t i = 0; i < words.size(); i++){
+        uint64_t v = i + 1;
+        ASSERT_EQ(tx_write(tx, &words[i], &v, sizeof(v)), 0);
+    }
+    Record seen;
+    ASSERT_EQ(tx_read(tx, &rec, &seen, sizeof(seen)), 0);
+    EXPECT_EQ(memcmp(seen.payload, src.payload, sizeof(src.payload)), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+
+    EXPECT_EQ(memcmp(rec.payload, src.payload, sizeof(src.payload)), 0);
+    for (size_t i = 0; i < words.size(); i++)
+        ASSERT_EQ(words[i], i + 1);
+    for (size_t i = 0; i < words.size(); i++)
+        ASSERT_FALSE(vlock_is_locked(vlock_ptr(&words[i])));
+
+    writeset_destroy(&tx->ws);
+    tx_shutdown();
+}
+
+TEST(Transaction, ExitingThreadsGiveTheirSliceBack) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    uint64_t counter = 0;
+    for (int i = 0; i < 4 * MAX_THREADS; i++){
+        std::thread worker([&counter](){
+            TransactionContext* tx = tx_thread_init();
+            ASSERT_NE(tx, nullptr);
+            while (true){
+                tx_begin(tx);
+                uint64_t v;
+                if (tx_read(tx, &counter, &v, sizeof(v)) != 0) continue;
+                v++;
+                if (tx_write(tx, &counter, &v, sizeof(v)) != 0) continue;
+                if (tx_commit(tx)) break;
+            }
+        });
+        worker.join();
+    }
+    EXPECT_EQ(counter, (uint64_t)4 * MAX_THREADS);
+    EXPECT_EQ(arena_slot_count(), 1);
+
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+    tx_thread_exit();
+    EXPECT_NE(tx_thread_init(), nullptr);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, IrrevocableWritesInPlaceAndHoldsOffCommitters) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 1, y = 0, v = 0, seven = 7;
+    std::atomic<int> other_done{0};
+
+    ASSERT_EQ(tx_begin_irrevocable(tx), 0);
+    EXPECT_EQ(tx->irrevocable, 1);
+    ASSERT_EQ(tx_write(tx, &x, &seven, sizeof(seven)), 0);
+    ASSERT_EQ(tx_write(tx, &x, &seven, sizeof(seven)), 0);
+    EXPECT_EQ(x, 7u);
+    EXPECT_TRUE(vlock_is_locked(vlock_ptr(&x)));
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 7u);
+
+    std::thread other([&](){
+        TransactionContext* otx = tx_thread_init();
+        ASSERT_NE(otx, nullptr);
+
+        // A speculative read of a stripe we hold aborts.
+        uint64_t r;
+        ASSERT_EQ(tx_begin(otx), 0);
+        EXPECT_EQ(tx_read(otx, &x, &r, sizeof(r)), -1);
+
+        // A speculative commit waits for the irrevocable transaction.
+        uint64_t one = 1;
+        ASSERT_EQ(tx_begin(otx), 0);
+        ASSERT_EQ(tx_write(otx, &y, &one, sizeof(one)), 0);
+        EXPECT_EQ(tx_commit(otx), 1);
+        other_done = 1;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(other_done.load(), 0);
+    EXPECT_EQ(y, 0u);
+
+    uint64_t before = gvc_read();
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx->irrevocable, 0);
+    other.join();
+
+    EXPECT_EQ(other_done.load(), 1);
+    EXPECT_EQ(y, 1u);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&x)));
+    EXPECT_GT(vlock_get_version(vlock_ptr(&x)), before);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, RepeatedAbortsFallBackToIrrevocable) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+    tx_set_irrevocable_after(2);
+
+    uint64_t x = 0, v = 0;
+    for (int i = 0; i < 2; i++){
+        ASSERT_EQ(tx_begin(tx), 0);
+        EXPECT_EQ(tx->irrevocable, 0);
+        vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+        EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), -1);
+    }
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx->irrevocable, 1);
+    vlock_release(vlock_ptr(&x), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    v++;
+    EXPECT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(x, 1u);
+
+    // The streak is over: the next transaction is speculative again.
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx->irrevocable, 0);
+    tx_abort(tx);
+
+    tx_set_irrevocable_after(TL2_IRREVOCABLE_AFTER);
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(Transaction, ConcurrentTransfersPreserveTotalWithIrrevocableRetries) {
+    tx_set_irrevocable_after(1);
+    run_transfers(4, 2000);
+    tx_set_irrevocable_after(TL2_IRREVOCABLE_AFTER);
+}
+
+TEST(Transaction, NestedBeginFlattensAndClosedLevelsRollBackAlone) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t x = 0, y = 0, v = 0;
+
+    // Flattened: the inner commit publishes nothing.
+    ASSERT_EQ(tx_begin(tx), 0);
+    v = 1;
+    ASSERT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx->depth, 1);
+    v = 2;
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx->status, ACTIVE);
+    EXPECT_EQ(y, 0u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(x, 1u);
+    EXPECT_EQ(y, 2u);
+
+    // Closed: aborting the inner level keeps the outer one and its writes.
+    ASSERT_EQ(tx_begin(tx), 0);
+    v = 10;
+    ASSERT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_begin_closed(tx), 0);
+    EXPECT_EQ(tx->nest_top, 1);
+    v = 11;
+    ASSERT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_write(tx, &y, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 11u);
+    tx_abort(tx);
+    EXPECT_EQ(tx->status, ACTIVE);
+    EXPECT_EQ(tx->depth, 0);
+    EXPECT_EQ(tx->nest_top, 0);
+    ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 10u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(x, 10u);
+    EXPECT_EQ(y, 2u);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, ClosedRetryExtendsTheSnapshotOnlyIfOuterReadsHold) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    tx_set_snapshot_extension(0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t a = 1, b = 2, v = 0;
+
+    // b changes under the inner level: only the inner level reruns.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_begin_closed(tx), 0);
+    ASSERT_EQ(tx_write(tx, &a, &v, sizeof(v)), 0);
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx->status, ABORTED);
+
+    ASSERT_EQ(tx_retry_nested(tx), 0);
+    EXPECT_EQ(tx->status, ACTIVE);
+    EXPECT_EQ(tx->ws.count, 0);
+    EXPECT_EQ(tx->read_version, gvc_read());
+    ASSERT_EQ(tx_read(tx, &b, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 2u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx->status, COMMITTED);
+
+    // a (read before the checkpoint) changes too: the whole transaction
+    // has to restart.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_begin_closed(tx), 0);
+    vlock_release(vlock_ptr(&a), gvc_inc() + 1);
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx_retry_nested(tx), -1);
+    EXPECT_EQ(tx->status, ABORTED);
+    EXPECT_EQ(tx->depth, 0);
+    EXPECT_EQ(tx->nest_top, 0);
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx->depth, 0);
+    tx_abort(tx);
+
+    tx_set_snapshot_extension(1);
+    tx_shutdown();
+}
+
+TEST(Transaction, KcasSwapsAllWordsOrNoneAndBumpsVersions) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+
+    uint64_t a = 1, b = 2, c = 3;
+    uint64_t* addrs[] = {&a, &b, &c};
+    uint64_t expected[] = {1, 2, 3}, desired[] = {10, 20, 30};
+
+    // One stale word: nothing changes.
+    uint64_t stale[] = {1, 5, 3};
+    EXPECT_EQ(tl2_kcas(3, addrs, stale, desired), 0);
+    EXPECT_EQ(a, 1u);
+    EXPECT_EQ(b, 2u);
+    EXPECT_EQ(c, 3u);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&a)));
+
+    // A reader that saw a before the swap cannot commit after it.
+    uint64_t v = 0;
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    EXPECT_EQ(tl2_kcas(3, addrs, expected, desired), -1); // inside a transaction
+    tx_abort(tx);
+
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    uint64_t before = tx->read_version;
+    std::thread([&](){
+        EXPECT_EQ(tl2_kcas(3, addrs, expected, desired), 1);
+        tx_thread_exit();
+    }).join();
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx->status, ABORTED);
+
+    EXPECT_EQ(a, 10u);
+    EXPECT_EQ(b, 20u);
+    EXPECT_EQ(c, 30u);
+    EXPECT_GT(vlock_get_version(vlock_ptr(&a)), before);
+    EXPECT_EQ(vlock_get_version(vlock_ptr(&a)), vlock_get_version(vlock_ptr(&c)));
+
+    // Repeated words share a stripe and are locked once.
+    uint64_t* twice[] = {&a, &a};
+    uint64_t exp2[] = {10, 10}, des2[] = {11, 11};
+    EXPECT_EQ(tl2_kcas(2, twice, exp2, des2), 1);
+    EXPECT_EQ(a, 11u);
+    EXPECT_EQ(tl2_kcas(0, addrs, expected, desired), -1);
+    EXPECT_EQ(tl2_kcas(KCAS_MAX + 1, addrs, expected, desired), -1);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, KcasAndTransactionalTransfersPreserveTotal) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+
+    const int accounts = 16, threads = 4, rounds = 2000;
+    std::vector<uint64_t> bank(accounts, 100);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++){
+        pool.emplace_back([&, t](){
+            TransactionContext* tx = tx_thread_init();
+            uint64_t seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+            for (int i = 0; i < rounds; i++){
+                seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+                int from = seed % accounts, to = (seed >> 8) % accounts;
+                if (from == to) continue;
+                if (t & 1){
+                    while (true){
+                        uint64_t* addrs[] = {&bank[from], &bank[to]};
+                        uint64_t exp[] = {__atomic_load_n(&bank[from], __ATOMIC_RELAXED),
+                                          __atomic_load_n(&bank[to], __ATOMIC_RELAXED)};
+                        uint64_t des[] = {exp[0] - 1, exp[1] + 1};
+                        if (tl2_kcas(2, addrs, exp, des) == 1) break;
+                    }
+                } else {
+                    while (true){
+                        tx_begin(tx);
+                        uint64_t a, b;
+                        if (tx_read(tx, &bank[from], &a, sizeof(a)) != 0 ||
+                            tx_read(tx, &bank[to], &b, sizeof(b)) != 0) continue;
+                        a--;
+                        b++;
+                        if (tx_write(tx, &bank[from], &a, sizeof(a)) == 0 &&
+                            tx_write(tx, &bank[to], &b, sizeof(b)) == 0 &&
+                            tx_commit(tx)) break;
+                    }
+                }
+            }
+            tx_thread_exit();
+        });
+    }
+    for (auto& th : pool) th.join();
+
+    uint64_t total = 0;
+    for (uint64_t v : bank) total += v;
+    EXPECT_EQ(total, (uint64_t)accounts * 100);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, SnapshotExtensionSkipsAbortsOnlyWhileReadsHold) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    ASSERT_NE(tx, nullptr);
+    ASSERT_EQ(tx_snapshot_extension(), 1);
+
+    uint64_t a = 1, b = 2, v = 0;
+
+    // b is committed after we began, a is untouched: read_version moves up.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    uint64_t rv = tx->read_version;
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    ASSERT_EQ(tx_read(tx, &b, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 2u);
+    EXPECT_GT(tx->read_version, rv);
+    EXPECT_EQ(tx->read_version, gvc_read());
+    EXPECT_EQ(tx_write(tx, &a, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(a, 2u);
+
+    // a changed too: the snapshot cannot move, the read aborts.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_read(tx, &a, &v, sizeof(v)), 0);
+    vlock_release(vlock_ptr(&a), gvc_inc() + 1);
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+    EXPECT_EQ(tx->status, ABORTED);
+
+    // Read-only transactions have no read set to revalidate.
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+
+    // Disabled: plain TL2.
+    tx_set_snapshot_extension(0);
+    ASSERT_EQ(tx_begin(tx), 0);
+    vlock_release(vlock_ptr(&b), gvc_inc() + 1);
+    EXPECT_EQ(tx_read(tx, &b, &v, sizeof(v)), -1);
+    tx_set_snapshot_extension(1);
+
+#if TL2_STATS
+    TxStats st;
+    stats_collect(&st);
+    EXPECT_EQ(st.extensions, 1u);
+#endif
+
+    tx_shutdown();
+}
+
+TEST(Transaction, ExtendingReadIsRedoneAfterACommitAtTheSameVersion) {
+    for (int mode : {GVC_MODE_GV5, GVC_MODE_GV6}){
+        tx_shutdown();
+        ASSERT_EQ(tx_init(0), 0);
+        ASSERT_EQ(gvc_set_mode(mode), 0);
+
+        // A fresh thread, so that GV6 makes no sampled commit here.
+        std::thread([&](){
+            TransactionContext* tx = tx_thread_init();
+            TransactionContext* other = tx_context_borrow();
+            ASSERT_NE(tx, nullptr);
+            ASSERT_NE(other, nullptr);
+
+            alignas(8) uint64_t x = 0, v = 0, w;
+            std::atomic<uint64_t>* lock = vlock_ptr(&x);
+
+            ASSERT_EQ(tx_begin(tx), 0);
+            ASSERT_EQ(tx_begin(other), 0);
+            w = 10;
+            ASSERT_EQ(tx_write(other, &x, &w, sizeof(w)), 0);
+            ASSERT_EQ(tx_commit(other), 1);
+
+            // The reader copies 10, newer than its snapshot...
+            uint64_t pre = lock->load(std::memory_order_acquire);
+            memcpy(&v, &x, sizeof(v));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            EXPECT_GT(pre >> 1, tx->read_version);
+
+            // ...and before it checks, a blind write of 15 commits at the
+            // very same version, since nothing has moved the clock yet.
+            ASSERT_EQ(tx_begin(other), 0);
+            w = 15;
+            ASSERT_EQ(tx_write(other, &x, &w, sizeof(w)), 0);
+            ASSERT_EQ(tx_commit(other), 1);
+            EXPECT_EQ(lock->load(), pre);
+
+            // The snapshot is extended, but the stale copy is not accepted.
+            EXPECT_EQ(tx_read_check(tx, &x, &v, sizeof(v), lock, pre), TX_READ_RETRY);
+            EXPECT_EQ(tx->status, ACTIVE);
+            EXPECT_GE(tx->read_version, pre >> 1);
+
+            ASSERT_EQ(tx_read(tx, &x, &v, sizeof(v)), 0);
+            EXPECT_EQ(v, 15u);
+            v++;
+            ASSERT_EQ(tx_write(tx, &x, &v, sizeof(v)), 0);
+            EXPECT_EQ(tx_commit(tx), 1);
+            EXPECT_EQ(x, 16u);
+
+            tx_context_return(other);
+            tx_thread_exit();
+        }).join();
+    }
+    gvc_set_mode(TL2_GVC_MODE);
+    tx_shutdown();
+}
+
+TEST(Transaction, BorrowedContextsAbortOnHeldStripesAndGoBackToTheArena) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init_threads(0, 2), 0);
+
+    TransactionContext* a = tx_context_borrow();
+    TransactionContext* b = tx_context_borrow();
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(tx_context_borrow(), nullptr);
+    EXPECT_EQ(tx_context_return(nullptr), -1);
+
+    uint64_t x = 1, v = 0;
+
+    // A held stripe makes the commit give up at once.
+    vlock_acquire(vlock_ptr(&x));
+    ASSERT_EQ(tx_begin(a), 0);
+    v = 2;
+    ASSERT_EQ(tx_write(a, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(a), 0);
+    EXPECT_EQ(a->retry, 1);
+    vlock_release(vlock_ptr(&x), vlock_get_version(vlock_ptr(&x)));
+
+    // The retry does not back off and commits.
+    ASSERT_EQ(tx_begin(a), 0);
+    EXPECT_EQ(a->cm.attempts, 1u);
+    ASSERT_EQ(tx_write(a, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(tx_commit(a), 1);
+    EXPECT_EQ(x, 2u);
+
+    // Returning aborts what is still running; the slice is handed out again
+    // with a fresh context.
+    ASSERT_EQ(tx_begin(b), 0);
+    v = 3;
+    ASSERT_EQ(tx_write(b, &x, &v, sizeof(v)), 0);
+    char* slice = b->slice;
+    EXPECT_EQ(tx_context_return(b), 0);
+    EXPECT_EQ(x, 2u);
+
+    TransactionContext* c = tx_context_borrow();
+    ASSERT_NE(c, nullptr);
+    EXPECT_EQ(c->slice, slice);
+    EXPECT_EQ(c->status, COMMITTED);
+    EXPECT_EQ(c->borrowed, 1);
+    ASSERT_EQ(tx_begin(c), 0);
+    ASSERT_EQ(tx_read(c, &x, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 2u);
+    EXPECT_EQ(tx_commit(c), 1);
+
+    EXPECT_EQ(tx_context_return(c), 0);
+    EXPECT_EQ(tx_context_return(a), 0);
+    EXPECT_EQ(tx_context_return(a), -1);
+    EXPECT_EQ(arena_slot_count(), 2);
+
+    tx_shutdown();
+}
+
+TEST(Transaction, CommutativeUpdatesMergeWithoutReadsUntilRead) {
+    tx_shutdown();
+    ASSERT_EQ(tx_init(0), 0);
+    TransactionContext* tx = tx_thread_init();
+    TransactionContext* other = tx_context_borrow();
+    ASSERT_NE(tx, nullptr);
+    ASSERT_NE(other, nullptr);
+
+    alignas(8) uint64_t c = 10, m = 50, flags = 1, v = 0;
+    int64_t s = -5;
+
+    // Interleaved updates of the same words both commit.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 5), 0);
+    ASSERT_EQ(tx_add(tx, &c, 2), 0);
+    ASSERT_EQ(tx_max(tx, &m, 70), 0);
+    ASSERT_EQ(tx_or(tx, &flags, 4), 0);
+    EXPECT_EQ(tx->ws.count, 3);
+    EXPECT_EQ(tx->rs.count, 0);
+
+    ASSERT_EQ(tx_begin(other), 0);
+    ASSERT_EQ(tx_add(other, &c, 100), 0);
+    ASSERT_EQ(tx_max(other, &m, 60), 0);
+    ASSERT_EQ(tx_commit(other), 1);
+    EXPECT_EQ(c, 110u);
+
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(c, 117u);
+    EXPECT_EQ(m, 70u);
+    EXPECT_EQ(flags, 5u);
+
+    // A read settles the pending value and is logged; later updates apply
+    // to it.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 3), 0);
+    ASSERT_EQ(tx_read(tx, &c, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 120u);
+    EXPECT_EQ(tx->rs.count, 1);
+    ASSERT_EQ(tx_add(tx, &c, 1), 0);
+    ASSERT_EQ(tx_read(tx, &c, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 121u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(c, 121u);
+
+    // ... so a concurrent update of a word read after updating it aborts.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 1), 0);
+    ASSERT_EQ(tx_read(tx, &c, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_begin(other), 0);
+    ASSERT_EQ(tx_add(other, &c, 1), 0);
+    ASSERT_EQ(tx_commit(other), 1);
+    EXPECT_EQ(tx_commit(tx), 0);
+    EXPECT_EQ(c, 122u);
+
+    // Mixed with a plain write or another operation, the value is computed
+    // at once; signed comparisons for IMIN / IMAX.
+    ASSERT_EQ(tx_begin(tx), 0);
+    v = 7;
+    ASSERT_EQ(tx_write(tx, &m, &v, sizeof(v)), 0);
+    ASSERT_EQ(tx_add(tx, &m, 3), 0);
+    ASSERT_EQ(tx_add(tx, &c, 8), 0);
+    ASSERT_EQ(tx_max(tx, &c, 100), 0);
+    ASSERT_EQ(tx_commute(tx, (uint64_t*)&s, WS_OP_IMIN, (uint64_t)-9), 0);
+    ASSERT_EQ(tx_commute(tx, (uint64_t*)&s, WS_OP_IMIN, 4), 0);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(m, 10u);
+    EXPECT_EQ(c, 130u);
+    EXPECT_EQ(s, -9);
+
+    // A closed level's updates roll back alone.
+    ASSERT_EQ(tx_begin(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 1), 0);
+    ASSERT_EQ(tx_begin_closed(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 10), 0);
+    tx_abort(tx);
+    ASSERT_EQ(tx_begin_closed(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 100), 0);
+    ASSERT_EQ(tx_read(tx, &c, &v, sizeof(v)), 0);
+    EXPECT_EQ(v, 231u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_EQ(c, 231u);
+
+    // Irrevocable updates go in place.
+    ASSERT_EQ(tx_begin_irrevocable(tx), 0);
+    ASSERT_EQ(tx_add(tx, &c, 9), 0);
+    EXPECT_EQ(c, 240u);
+    EXPECT_EQ(tx_commit(tx), 1);
+    EXPECT_FALSE(vlock_is_locked(vlock_ptr(&c)));
+
+    ASSERT_EQ(tx_begin(tx), 0);
+    EXPECT_EQ(tx_commute(tx, &c, WS_OP_WRITE, 1), -1);
+    EXPECT_EQ(tx_add(tx, (uint64_t*)((char*)&c + 1), 1), -1);
+    tx_abort(tx);
+    ASSERT_EQ(tx_begin_readonly(tx), 0);
+    EXPECT_EQ(tx_add(tx, &c, 1), -2);
+
+    tx_context_return(other);
+    tx_shutdown();
+}
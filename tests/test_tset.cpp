@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <cstring>
+#include <vector>
 #include "tset.h"
 #include "vlock.h"
 #include "arena.h"
@@ -34,10 +37,228 @@ TEST(WriteSet, AddThenLookupRecoversBufferedData) {
     EXPECT_EQ(writeset_lookup(&ws, &missing, &e), 0);
     EXPECT_EQ(e, nullptr);
 
-    bloom_free(&ws.bf);
     delete[] arena;
 }
 
+TEST(WriteSet, RepeatedWritesCoalesceInPlace) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, arena);
+
+    uint64_t var = 0;
+    for (uint64_t i = 1; i <= 1000; i++)
+        ASSERT_EQ(writeset_add(&ws, &var, &i, sizeof(i)), 0);
+    EXPECT_EQ(ws.count, 1);
+
+    WriteEntry* e = nullptr;
+    ASSERT_EQ(writeset_lookup(&ws, &var, &e), 1);
+    uint64_t recovered = 0;
+    memcpy(&recovered, e->buf, sizeof(recovered));
+    EXPECT_EQ(recovered, 1000u);
+    EXPECT_EQ(writeset_entries(&ws)[0]->addr, (void*)&var);
+
+    uint32_t small = 7;
+    ASSERT_EQ(writeset_add(&ws, &var, &small, sizeof(small)), 0);
+    ASSERT_EQ(writeset_lookup(&ws, &var, &e), 1);
+    EXPECT_EQ(e->size, sizeof(small));
+
+    delete[] arena;
+}
+
+TEST(WriteSet, LogChainsPastTheSliceAndResetForgetsEverything) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, arena);
+
+    const uint64_t n = 4 * WS_SLOTS;
+    uint64_t* vars = new uint64_t[n];
+    for (uint64_t i = 0; i < n; i++)
+        ASSERT_EQ(writeset_add(&ws, &vars[i], &i, sizeof(i)), 0);
+    EXPECT_EQ(ws.count, n);
+    EXPECT_NE(ws.spill, nullptr);
+
+    uint64_t again = 42;
+    EXPECT_EQ(writeset_add(&ws, &vars[5], &again, sizeof(again)), 0);
+    EXPECT_EQ(ws.count, n);
+
+    for (uint64_t i = 0; i < n; i++){
+        WriteEntry* e = nullptr;
+        ASSERT_EQ(writeset_lookup(&ws, &vars[i], &e), 1);
+        EXPECT_EQ(e->addr, (void*)&vars[i]);
+        uint64_t recovered = 0;
+        memcpy(&recovered, e->buf, sizeof(recovered));
+        EXPECT_EQ(recovered, i == 5 ? 42u : i);
+    }
+
+    // Enough resets to wrap the generation counter.
+    for (int r = 0; r < 70000; r++)
+        writeset_reset(&ws);
+    EXPECT_EQ(ws.count, 0);
+    for (uint64_t i = 0; i < n; i++){
+        WriteEntry* e = nullptr;
+        EXPECT_EQ(writeset_lookup(&ws, &vars[i], &e), 0);
+    }
+
+    uint64_t v = 9;
+    ASSERT_EQ(writeset_add(&ws, &vars[3], &v, sizeof(v)), 0);
+    EXPECT_EQ(ws.count, 1);
+
+    writeset_destroy(&ws);
+    delete[] vars;
+    delete[] arena;
+}
+
+TEST(WriteSet, FrozenEntriesAreShadowedAndTruncateRestoresThem) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, arena);
+
+    uint64_t a = 0, b = 0, v = 1;
+    ASSERT_EQ(writeset_add(&ws, &a, &v, sizeof(v)), 0);
+
+    // Checkpoint: a's entry is frozen, so the next write shadows it.
+    ws.floor = ws.count;
+    v = 2;
+    ASSERT_EQ(writeset_add(&ws, &a, &v, sizeof(v)), 0);
+    v = 3;
+    ASSERT_EQ(writeset_add(&ws, &a, &v, sizeof(v)), 0);
+    ASSERT_EQ(writeset_add(&ws, &b, &v, sizeof(v)), 0);
+    EXPECT_EQ(ws.count, 3);
+
+    WriteEntry* e = nullptr;
+    ASSERT_EQ(writeset_lookup(&ws, &a, &e), 1);
+    EXPECT_EQ(*(uint64_t*)e->buf, 3u);
+
+    // Rolling back to the checkpoint brings back the older value.
+    ASSERT_EQ(writeset_truncate(&ws, 1), 0);
+    EXPECT_EQ(ws.count, 1);
+    ASSERT_EQ(writeset_lookup(&ws, &a, &e), 1);
+    EXPECT_EQ(*(uint64_t*)e->buf, 1u);
+    EXPECT_EQ(writeset_lookup(&ws, &b, &e), 0);
+    EXPECT_EQ(writeset_truncate(&ws, 2), -1);
+
+    writeset_reset(&ws);
+    EXPECT_EQ(ws.floor, 0);
+
+    delete[] arena;
+}
+
+TEST(WriteSet, SmallWritesArePackedAndLargeWritesSpill) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, arena);
+
+    uint8_t a = 1;
+    uint64_t b = 2;
+    ASSERT_EQ(writeset_add(&ws, &a, &a, sizeof(a)), 0);
+    ASSERT_EQ(writeset_add(&ws, &b, &b, sizeof(b)), 0);
+    WriteEntry** entries = writeset_entries(&ws);
+    EXPECT_EQ((char*)entries[1] - (char*)entries[0], (ptrdiff_t)(sizeof(WriteEntry) + 8));
+    EXPECT_EQ(ws.spill, nullptr);
+
+    std::vector<char> big(64 * 1024), src(64 * 1024);
+    for (size_t i = 0; i < src.size(); i++) src[i] = (char)i;
+    ASSERT_EQ(writeset_add(&ws, big.data(), src.data(), src.size()), 0);
+    ASSERT_NE(ws.spill, nullptr);
+
+    WriteEntry* e = nullptr;
+    ASSERT_EQ(writeset_lookup(&ws, big.data(), &e), 1);
+    EXPECT_EQ(e->size, src.size());
+    EXPECT_EQ(memcmp(e->buf, src.data(), src.size()), 0);
+
+    // Growing an inline entry moves its payload; shrinking keeps it.
+    char* before = entries[1]->buf;
+    ASSERT_EQ(writeset_add(&ws, &b, src.data(), 32), 0);
+    EXPECT_NE(entries[1]->buf, before);
+    EXPECT_EQ(memcmp(entries[1]->buf, src.data(), 32), 0);
+    ASSERT_EQ(writeset_add(&ws, &b, &b, sizeof(b)), 0);
+    EXPECT_EQ(entries[1]->size, sizeof(b));
+
+    writeset_destroy(&ws);
+    delete[] arena;
+}
+
+TEST(WriteSet, SpillPagesAboveTheKeptPrefixAreReleasedOnceLargeWriteSetsStop) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    WriteSet ws;
+    writeset_init(&ws, arena);
+
+    const size_t chunk = 64 * 1024, chunks = 3 * WS_SPILL_KEEP / chunk;
+    std::vector<char> src(chunk, 7);
+    std::vector<std::vector<char>> vars(chunks, std::vector<char>(chunk));
+    for (size_t i = 0; i < chunks; i++)
+        ASSERT_EQ(writeset_add(&ws, vars[i].data(), src.data(), chunk), 0);
+    ASSERT_GT(ws.spill_used, 2 * WS_SPILL_KEEP);
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t used = ws.spill_used, pages = (used + page - 1) / page;
+    std::vector<unsigned char> resident(pages);
+    ASSERT_EQ(mincore(ws.spill, used, resident.data()), 0);
+    EXPECT_TRUE(resident[0] & 1);
+    EXPECT_TRUE(resident[pages - 1] & 1);
+
+    // Large write sets in a row keep their pages.
+    for (int r = 0; r < 2 * WS_SPILL_IDLE; r++){
+        writeset_reset(&ws);
+        for (size_t i = 0; i < chunks; i++)
+            ASSERT_EQ(writeset_add(&ws, vars[i].data(), src.data(), chunk), 0);
+    }
+    writeset_reset(&ws);
+    ASSERT_EQ(mincore(ws.spill, used, resident.data()), 0);
+    EXPECT_TRUE(resident[pages - 1] & 1);
+
+    // Small ones: released after WS_SPILL_IDLE resets.
+    for (int r = 1; r < WS_SPILL_IDLE; r++){
+        ASSERT_EQ(writeset_add(&ws, vars[0].data(), src.data(), chunk), 0);
+        writeset_reset(&ws);
+    }
+    ASSERT_EQ(mincore(ws.spill, used, resident.data()), 0);
+    EXPECT_TRUE(resident[pages - 1] & 1);
+
+    writeset_reset(&ws);
+    ASSERT_EQ(mincore(ws.spill, used, resident.data()), 0);
+    EXPECT_TRUE(resident[0] & 1);
+    for (size_t p = WS_SPILL_KEEP / page; p < pages; p++)
+        EXPECT_FALSE(resident[p] & 1) << "page " << p;
+
+    // The released range is usable again.
+    ASSERT_EQ(writeset_add(&ws, vars[0].data(), src.data(), chunk), 0);
+    EXPECT_EQ(ws.count, 1);
+
+    writeset_destroy(&ws);
+    delete[] arena;
+}
+
+TEST(PtrFilter, NoFalseNegativesAndResetClearsDirtyWords) {
+    PtrFilter f;
+    memset(&f, 0, sizeof(f));
+
+    uint64_t vars[64];
+    for (int i = 0; i < 64; i++)
+        ptrfilter_add(&f, &vars[i]);
+    for (int i = 0; i < 64; i++)
+        EXPECT_EQ(ptrfilter_check(&f, &vars[i]), 1);
+    EXPECT_NE(f.dirty, 0u);
+
+    ptrfilter_reset(&f);
+    EXPECT_EQ(f.dirty, 0u);
+    for (int w = 0; w < FILTER_WORDS; w++)
+        EXPECT_EQ(f.words[w], 0u);
+
+    // A handful of entries should leave most absent pointers filtered out.
+    for (int i = 0; i < 8; i++)
+        ptrfilter_add(&f, &vars[i]);
+    int positives = 0;
+    for (int i = 8; i < 64; i++)
+        positives += ptrfilter_check(&f, &vars[i]);
+    EXPECT_LT(positives, 8);
+}
+
 TEST(ReadSet, ValidateFailsWhenVersionAdvances) {
     vlock_init();
     char* arena = new char[SLICE_SIZE]();
@@ -63,3 +284,56 @@ TEST(ReadSet, ValidateFailsWhenVersionAdvances) {
 
     delete[] arena;
 }
+
+TEST(ReadSet, RepeatedReadsOfAStripeAreLoggedOnce) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    ReadSet rs;
+    readset_init(&rs, arena);
+
+    uint64_t var;
+    std::atomic<uint64_t>* lock = vlock_ptr(&var);
+    for (int i = 0; i < 5 * RS_MAX; i++)
+        ASSERT_EQ(readset_add(&rs, lock), 0);
+    EXPECT_EQ(rs.count, 1);
+
+    readset_reset(&rs);
+    EXPECT_EQ(rs.count, 0);
+    ASSERT_EQ(readset_add(&rs, lock), 0);
+    EXPECT_EQ(rs.count, 1);
+
+    delete[] arena;
+}
+
+TEST(ReadSet, BatchedValidationCatchesEveryPosition) {
+    vlock_init();
+    char* arena = new char[SLICE_SIZE]();
+    ReadSet rs;
+    readset_init(&rs, arena);
+
+    const int n = 3 * RS_BATCH + 5;
+    uint64_t* vars = new uint64_t[n];
+    for (int i = 0; i < n; i++)
+        ASSERT_EQ(readset_add(&rs, vlock_ptr(&vars[i])), 0);
+    EXPECT_EQ(rs.count, n);
+    EXPECT_EQ(readset_validate(&rs, 0), 1);
+
+    for (int i = 0; i < n; i++){
+        std::atomic<uint64_t>* victim = vlock_ptr(&vars[i]);
+
+        vlock_acquire(victim);
+        EXPECT_EQ(readset_validate(&rs, 10), 0) << i;
+        std::atomic<uint64_t>* owned[1] = {victim};
+        EXPECT_EQ(readset_validate_owned(&rs, 10, owned, 1), 1) << i;
+
+        vlock_release(victim, 11);
+        EXPECT_EQ(readset_validate(&rs, 10), 0) << i;
+        EXPECT_EQ(readset_validate_owned(&rs, 10, owned, 1), 0) << i;
+        EXPECT_EQ(readset_validate(&rs, 11), 1) << i;
+
+        vlock_release(victim, 0);
+    }
+
+    delete[] vars;
+    delete[] arena;
+}
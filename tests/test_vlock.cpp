@@ -70,3 +70,66 @@ TEST(VLock, ClearAllResetsEverything) {
     for (size_t i = 0; i < NUM_STRIPES; ++i)
         EXPECT_EQ(lockMap[i].load(std::memory_order_relaxed), 0);
 }
+
+TEST(VLock, ConfigurableLayoutSeparatesNeighbouringStripes) {
+    VLockConfig cfg;
+    vlock_default_config(&cfg);
+    EXPECT_EQ(cfg.stripes, NUM_STRIPES);
+
+    VLockConfig bad = cfg;
+    bad.stripes = 1000;
+    EXPECT_EQ(vlock_init_config(&bad), -1);
+    bad = cfg;
+    bad.stride = 0;
+    EXPECT_EQ(vlock_init_config(&bad), -1);
+
+    alignas(64) uint64_t fields[8];
+
+    // Packed: eight neighbouring fields share one lock cache line.
+    EXPECT_EQ((uintptr_t)vlock_ptr(&fields[7]) - (uintptr_t)vlock_ptr(&fields[0]),
+              7 * LOCK_SIZE);
+
+    VLockConfig padded = cfg;
+    padded.stripes = 1 << 16;
+    padded.stride = 8;
+    ASSERT_EQ(vlock_init_config(&padded), 0);
+    EXPECT_EQ(vlock_stripe_count(), (size_t)1 << 16);
+    for (int i = 1; i < 8; i++)
+        EXPECT_EQ((uintptr_t)vlock_ptr(&fields[i]) / 64 - (uintptr_t)vlock_ptr(&fields[i - 1]) / 64, 1u);
+
+    VLockConfig scattered = cfg;
+    scattered.scatter = 1;
+    scattered.try_huge_pages = 1;
+    ASSERT_EQ(vlock_init_config(&scattered), 0);
+    for (int i = 1; i < 8; i++)
+        EXPECT_NE((uintptr_t)vlock_ptr(&fields[i]) / 64, (uintptr_t)vlock_ptr(&fields[i - 1]) / 64);
+
+    VLockConfig coarse = cfg;
+    coarse.granularity = 6;
+    ASSERT_EQ(vlock_init_config(&coarse), 0);
+    EXPECT_EQ(vlock_ptr(&fields[0]), vlock_ptr(&fields[7]));
+
+    std::atomic<uint64_t>* lock = vlock_ptr(&fields[3]);
+    vlock_acquire(lock);
+    vlock_release(lock, 5);
+    EXPECT_EQ(vlock_get_version(vlock_ptr(&fields[3])), 5u);
+    vlock_clear_all();
+    EXPECT_EQ(vlock_get_version(lock), 0u);
+
+    ASSERT_EQ(vlock_init_config(&cfg), 0);
+    VLockConfig now;
+    vlock_get_config(&now);
+    EXPECT_EQ(now.stride, 1u);
+    EXPECT_EQ(now.scatter, 0);
+}
+
+TEST(VLock, TryAcquireGivesUpAfterSpinBudget) {
+    vlock_init();
+    std::atomic<uint64_t>* lock = vlock_ptr(reinterpret_cast<void*>(0x3333));
+    EXPECT_EQ(vlock_try_acquire(lock, 0), 1);
+    EXPECT_TRUE(vlock_is_locked(lock));
+    EXPECT_EQ(vlock_try_acquire(lock, 100), 0);
+    vlock_release(lock, 3);
+    EXPECT_EQ(vlock_try_acquire(lock, 100), 1);
+    EXPECT_EQ(vlock_get_version(lock), 3u);
+}